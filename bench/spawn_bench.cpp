@@ -0,0 +1,103 @@
+// measures how many commands per second can be started with fork + exec and with posix_spawn,
+// depending on the resident memory of the parent; cppb starts every command with posix_spawn,
+// because fork copies the page tables of the whole parent process
+//
+// usage: spawn_bench [<parent RSS in MiB>...]
+// e.g. 'spawn_bench 16 256 1024 2048'
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static constexpr char const *command = "/bin/true";
+static constexpr auto measure_duration = std::chrono::seconds(2);
+
+static bool run_with_fork(void)
+{
+	char *const argv[] = { const_cast<char *>(command), nullptr };
+	auto const pid = fork();
+	if (pid < 0)
+	{
+		return false;
+	}
+	if (pid == 0)
+	{
+		execve(command, argv, environ);
+		_exit(127);
+	}
+	int status = 0;
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool run_with_posix_spawn(void)
+{
+	char *const argv[] = { const_cast<char *>(command), nullptr };
+	pid_t pid = 0;
+	if (posix_spawn(&pid, command, nullptr, nullptr, argv, environ) != 0)
+	{
+		return false;
+	}
+	int status = 0;
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// returns the number of commands started per second, or a negative value if a command failed
+static double measure_spawn_rate(bool (*run)(void))
+{
+	auto const begin = std::chrono::steady_clock::now();
+	auto end = begin;
+	std::size_t count = 0;
+	while (end - begin < measure_duration)
+	{
+		if (!run())
+		{
+			return -1.0;
+		}
+		count += 1;
+		end = std::chrono::steady_clock::now();
+	}
+	return static_cast<double>(count) / std::chrono::duration<double>(end - begin).count();
+}
+
+int main(int argc, char **argv)
+{
+	auto sizes = std::vector<std::size_t>();
+	for (int i = 1; i < argc; ++i)
+	{
+		sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+	}
+	if (sizes.empty())
+	{
+		sizes = { 16, 256, 1024, 2048 };
+	}
+
+	std::printf("parent RSS   fork         posix_spawn\n");
+	for (auto const size : sizes)
+	{
+		// every page is written, so it's resident and has to be mapped in the child by fork;
+		// the writes are volatile, so they aren't removed as dead stores
+		auto memory = std::vector<char>(size << 20);
+		auto const page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		for (std::size_t i = 0; i < memory.size(); i += page_size)
+		{
+			static_cast<char volatile *>(memory.data())[i] = 1;
+		}
+
+		auto const fork_rate = measure_spawn_rate(&run_with_fork);
+		auto const posix_spawn_rate = measure_spawn_rate(&run_with_posix_spawn);
+		if (fork_rate < 0.0 || posix_spawn_rate < 0.0)
+		{
+			std::fprintf(stderr, "unable to run %s\n", command);
+			return 1;
+		}
+		std::printf("%5zu MiB    %6.0f/s     %6.0f/s\n", size, fork_rate, posix_spawn_rate);
+		std::fflush(stdout);
+	}
+	return 0;
+}
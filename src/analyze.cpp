@@ -1,9 +1,13 @@
 #include "analyze.h"
+#include "file_hash.h"
+#include "thread_pool.h"
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
 #include <cassert>
 #include <string_view>
+#include <unordered_set>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -28,9 +32,54 @@ static std::string get_file(fs::path const &file_path)
 	return result;
 }
 
-static cppb::vector<include_file> get_includes(fs::path const &file_path)
+// skips a comment starting at 'it' and returns true, or returns false if there's no comment at 'it';
+// the '\n' at the end of a line comment is not skipped
+static bool skip_comment(std::string::const_iterator &it, std::string::const_iterator end)
+{
+	assert(it != end && *it == '/');
+	if (it + 1 != end && *(it + 1) == '*')
+	{
+		++it; ++it; // '/*'
+		while (it != end && it + 1 != end && !(*it == '*' && *(it + 1) == '/'))
+		{
+			++it;
+		}
+
+		if (it + 1 == end)
+		{
+			++it;
+		}
+		else if (it != end)
+		{
+			++it; ++it; // '*/'
+		}
+		return true;
+	}
+	else if (it + 1 != end && *(it + 1) == '/')
+	{
+		++it; ++it; // '//'
+		while (it != end && *it != '\n')
+		{
+			++it;
+		}
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+static bool is_identifier_char(char c)
+{
+	return (c >= '0' && c <= '9')
+		|| (c >= 'a' && c <= 'z')
+		|| (c >= 'A' && c <= 'Z')
+		|| c == '_';
+}
+
+static cppb::vector<include_file> get_includes(std::string const &file)
 {
-	auto const file = get_file(file_path);
 	auto it = file.begin();
 	auto const end = file.end();
 
@@ -59,32 +108,7 @@ static cppb::vector<include_file> get_includes(fs::path const &file_path)
 				++it;
 				break;
 			case '/':
-				if (it + 1 != end && *(it + 1) == '*')
-				{
-					++it; ++it; // '/*'
-					while (it != end && it + 1 != end && !(*it == '*' && *(it + 1) == '/'))
-					{
-						++it;
-					}
-
-					if (it + 1 == end)
-					{
-						++it;
-					}
-					else if (it != end)
-					{
-						++it; ++it; // '*/'
-					}
-				}
-				else if (it + 1 != end && *(it + 1) == '/')
-				{
-					++it; ++it; // '//'
-					while (it != end && *it != '\n')
-					{
-						++it;
-					}
-				}
-				else
+				if (!skip_comment(it, end))
 				{
 					is_line_begin = false;
 					++it;
@@ -112,13 +136,7 @@ static cppb::vector<include_file> get_includes(fs::path const &file_path)
 		}
 
 		auto const directive_begin = it;
-		while (it != end && [&]() {
-			auto const c = *it;
-			return (c >= '0' && c <= '9')
-				|| (c >= 'a' && c <= 'z')
-				|| (c >= 'A' && c <= 'Z')
-				|| c == '_';
-		}())
+		while (it != end && is_identifier_char(*it))
 		{
 			++it;
 		}
@@ -170,13 +188,137 @@ static cppb::vector<include_file> get_includes(fs::path const &file_path)
 	return result;
 }
 
+std::string get_token_fingerprint(fs::path const &file_path)
+{
+	auto const file = get_file(file_path);
+	auto it = file.begin();
+	auto const end = file.end();
+
+	// comments and runs of whitespace are replaced by a single space, and leading and trailing
+	// whitespace is removed from every line; newlines are kept, so edits that shift lines
+	// (and with that __LINE__ and debug info) still change the fingerprint
+	std::string tokens;
+	tokens.reserve(file.size());
+	bool is_space_pending = false;
+
+	auto const append = [&](auto begin, auto end_) {
+		if (is_space_pending && !tokens.empty() && tokens.back() != '\n')
+		{
+			tokens += ' ';
+		}
+		is_space_pending = false;
+		tokens.append(begin, end_);
+	};
+
+	auto const find_literal_end = [&](char quote) {
+		auto literal_it = it + 1;
+		while (literal_it != end && *literal_it != quote && *literal_it != '\n')
+		{
+			if (*literal_it == '\\' && literal_it + 1 != end)
+			{
+				++literal_it;
+			}
+			++literal_it;
+		}
+		return literal_it == end || *literal_it == '\n' ? literal_it : literal_it + 1;
+	};
+
+	auto const find_raw_string_literal_end = [&]() {
+		auto const delimiter_begin = it + 1;
+		auto const delimiter_end = std::find(delimiter_begin, end, '(');
+		if (delimiter_end == end)
+		{
+			return end;
+		}
+		auto terminator = std::string(")");
+		terminator.append(delimiter_begin, delimiter_end);
+		terminator += '"';
+		auto const literal_end = std::search(delimiter_end, end, terminator.begin(), terminator.end());
+		return literal_end == end ? end : literal_end + static_cast<std::ptrdiff_t>(terminator.size());
+	};
+
+	while (it != end)
+	{
+		auto const c = *it;
+		switch (c)
+		{
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\f':
+		case '\v':
+			is_space_pending = true;
+			++it;
+			break;
+		case '\n':
+			tokens += '\n';
+			is_space_pending = false;
+			++it;
+			break;
+		case '/':
+		{
+			auto const comment_begin = it;
+			if (skip_comment(it, end))
+			{
+				auto const newline_count = static_cast<std::size_t>(std::count(comment_begin, it, '\n'));
+				if (newline_count == 0)
+				{
+					is_space_pending = true;
+				}
+				else
+				{
+					tokens.append(newline_count, '\n');
+					is_space_pending = false;
+				}
+			}
+			else
+			{
+				append(it, it + 1);
+				++it;
+			}
+			break;
+		}
+		case '"':
+		case '\'':
+		{
+			auto const previous_char = tokens.empty() || is_space_pending ? '\0' : tokens.back();
+			// digit separators, e.g. 1'000'000
+			if (c == '\'' && previous_char >= '0' && previous_char <= '9')
+			{
+				append(it, it + 1);
+				++it;
+				break;
+			}
+			// string literals are kept as is, because they may contain "//" or "/*"
+			auto const literal_end = c == '"' && previous_char == 'R'
+				? find_raw_string_literal_end()
+				: find_literal_end(c);
+			append(it, literal_end);
+			it = literal_end;
+			break;
+		}
+		default:
+		{
+			auto const token_end = std::find_if(it + 1, end, [](char next) { return !is_identifier_char(next); });
+			auto const next = is_identifier_char(c) ? token_end : it + 1;
+			append(it, next);
+			it = next;
+			break;
+		}
+		}
+	}
+
+	return hash_string(tokens);
+}
+
 static cppb::vector<fs::path> get_dependencies(
 	fs::path const &source,
+	std::string const &file_content,
 	cppb::vector<fs::path> const &include_directories
 )
 {
 	auto const source_directory = source.parent_path();
-	return get_includes(source)
+	return get_includes(file_content)
 		.transform([&source_directory, &include_directories](auto const &include) {
 			if (include.is_library)
 			{
@@ -218,7 +360,8 @@ static source_file analyze_source_file(
 	cppb::vector<fs::path> const &include_directories
 )
 {
-	return { source, get_dependencies(source, include_directories), fs::file_time_type::min() };
+	auto const file = get_file(source);
+	return { source, get_dependencies(source, file, include_directories), fs::file_time_type::min(), file.size() };
 }
 
 cppb::vector<fs::path> get_source_files_in_directory(fs::path const &dir)
@@ -234,52 +377,36 @@ cppb::vector<fs::path> get_source_files_in_directory(fs::path const &dir)
 		.collect<cppb::vector>();
 }
 
-static void add_source_file(
-	cppb::vector<std::size_t> &hashes,
-	cppb::vector<source_file> &source_files,
-	fs::path const &source,
-	cppb::vector<fs::path> const &include_directories,
-	fs::file_time_type dependency_file_last_update
-)
+static fs::file_time_type get_and_fill_last_modified_time(fs::path const &file, cppb::vector<std::size_t> const &hashes, cppb::vector<source_file> &sources)
 {
-	auto const find_source_file = [&hashes, &source_files](std::size_t hash_, fs::path const &source_) {
-		assert(hashes.size() == source_files.size());
+	auto const find_source_file = [&hashes, &sources](std::size_t hash_, fs::path const &source_) {
+		assert(hashes.size() == sources.size());
 		auto hashes_it = hashes.begin();
-		auto source_files_it = source_files.begin();
-		auto const source_files_end = source_files.end();
-		for (; source_files_it != source_files_end; ++source_files_it, ++hashes_it)
+		auto sources_it = sources.begin();
+		auto const source_files_end = sources.end();
+		for (; sources_it != source_files_end; ++sources_it, ++hashes_it)
 		{
-			if (*hashes_it == hash_ && source_files_it->file_path == source_)
+			if (*hashes_it == hash_ && sources_it->file_path == source_)
 			{
-				return source_files_it;
+				return sources_it;
 			}
 		}
-		return source_files_it;
+		return sources_it;
 	};
 
-	auto const hash = fs::hash_value(source);
-	auto const source_it = find_source_file(hash, source);
-
-	if (source_it != source_files.end())
-	{
-		return;
-	}
-
-	auto const source_index = source_files.size();
-	source_files.emplace_back(analyze_source_file(source, include_directories));
-	hashes.emplace_back(hash);
-
-	for (auto const &dep : source_files[source_index].dependencies)
+	auto const hash = fs::hash_value(file);
+	auto const it = find_source_file(hash, file);
+	assert(it != sources.end());
+	if (it->last_modified_time != fs::file_time_type::min())
 	{
-		add_source_file(hashes, source_files, dep, include_directories, dependency_file_last_update);
+		return it->last_modified_time;
 	}
-
-	auto const dependencies_last_modified = source_files[source_index].dependencies
-		.transform([&](auto const &dep) { return find_source_file(fs::hash_value(dep), dep); })
-		.filter([&](auto const it) { return it != source_files.end(); })
-		.transform([](auto const it) { return it->last_modified_time; })
-		.max(fs::file_time_type::min());
-	source_files[source_index].last_modified_time = std::max(fs::last_write_time(source), dependencies_last_modified);
+	// set it->last_modified_time first to avoid infinite recursion with circular dependencies
+	it->last_modified_time = fs::last_write_time(file);
+	it->last_modified_time = it->dependencies
+		.transform([&](auto const &dependency) { return get_and_fill_last_modified_time(dependency, hashes, sources); })
+		.max(it->last_modified_time);
+	return it->last_modified_time;
 }
 
 void analyze_source_files(
@@ -287,7 +414,8 @@ void analyze_source_files(
 	cppb::vector<fs::path> const &include_directories,
 	cppb::vector<source_file> &sources,
 	fs::file_time_type dependency_file_last_update,
-	fs::file_time_type config_last_update
+	fs::file_time_type config_last_update,
+	thread_pool &pool
 )
 {
 	auto non_updated_sources = sources
@@ -297,48 +425,54 @@ void analyze_source_files(
 				&& config_last_update < dependency_file_last_update;
 		})
 		.collect<cppb::vector>();
-	cppb::vector<std::size_t> hashes = non_updated_sources
-		.transform([](auto const &source) { return fs::hash_value(source.file_path); })
-		.collect<cppb::vector>();
+	auto const new_sources_begin = non_updated_sources.size();
 
-	for (auto const &file : files)
+	std::unordered_set<std::string> known_files;
+	for (auto const &source : non_updated_sources)
 	{
-		add_source_file(hashes, non_updated_sources, file, include_directories, dependency_file_last_update);
+		known_files.insert(source.file_path.generic_string());
 	}
 
-	sources = std::move(non_updated_sources);
-}
-
-static fs::file_time_type get_and_fill_last_modified_time(fs::path const &file, cppb::vector<std::size_t> const &hashes, cppb::vector<source_file> &sources)
-{
-	auto const find_source_file = [&hashes, &sources](std::size_t hash_, fs::path const &source_) {
-		assert(hashes.size() == sources.size());
-		auto hashes_it = hashes.begin();
-		auto sources_it = sources.begin();
-		auto const source_files_end = sources.end();
-		for (; sources_it != source_files_end; ++sources_it, ++hashes_it)
+	// files are scanned level by level, every file of a level is scanned concurrently
+	auto files_to_scan = files
+		.filter([&](auto const &file) { return known_files.insert(file.generic_string()).second; })
+		.collect<cppb::vector>();
+	if (!files_to_scan.empty())
+	{
+		while (!files_to_scan.empty())
 		{
-			if (*hashes_it == hash_ && sources_it->file_path == source_)
+			auto futures = files_to_scan
+				.transform([&](fs::path const &file) {
+					return pool.push_task([&]() { return analyze_source_file(file, include_directories); });
+				})
+				.collect<cppb::vector>();
+
+			cppb::vector<fs::path> next_files_to_scan;
+			for (auto &future : futures)
 			{
-				return sources_it;
+				auto source = future.get();
+				for (auto const &dep : source.dependencies)
+				{
+					if (known_files.insert(dep.generic_string()).second)
+					{
+						next_files_to_scan.push_back(dep);
+					}
+				}
+				non_updated_sources.push_back(std::move(source));
 			}
+			files_to_scan = std::move(next_files_to_scan);
 		}
-		return sources_it;
-	};
+	}
 
-	auto const hash = fs::hash_value(file);
-	auto const it = find_source_file(hash, file);
-	assert(it != sources.end());
-	if (it->last_modified_time != fs::file_time_type::min())
+	auto const hashes = non_updated_sources
+		.transform([](auto const &source) { return fs::hash_value(source.file_path); })
+		.collect<cppb::vector>();
+	for (std::size_t i = new_sources_begin; i < non_updated_sources.size(); ++i)
 	{
-		return it->last_modified_time;
+		get_and_fill_last_modified_time(non_updated_sources[i].file_path, hashes, non_updated_sources);
 	}
-	// set it->last_modified_time first to avoid infinite recursion with circular dependencies
-	it->last_modified_time = fs::last_write_time(file);
-	it->last_modified_time = it->dependencies
-		.transform([&](auto const &dependency) { return get_and_fill_last_modified_time(dependency, hashes, sources); })
-		.max(it->last_modified_time);
-	return it->last_modified_time;
+
+	sources = std::move(non_updated_sources);
 }
 
 void fill_last_modified_times(cppb::vector<source_file> &sources)
@@ -426,7 +560,7 @@ cppb::vector<source_file> read_dependency_json(fs::path const &dep_file_path, st
 				dependencies.emplace_back(std::move(path));
 			}
 		}
-		result.push_back({ std::move(name_path), std::move(dependencies), fs::file_time_type::min() });
+		result.push_back({ std::move(name_path), std::move(dependencies), fs::file_time_type::min(), 0 });
 	}
 
 	return result;
@@ -446,6 +580,7 @@ void write_compile_commands_json(cppb::vector<compile_command> const &compile_co
 		value["file"] = command.source_file;
 
 		auto args = json::array();
+		args.push_back(command.compiler);
 		for (auto const &arg : command.args)
 		{
 			args.push_back(arg);
@@ -2,6 +2,7 @@
 #define ANALYZE_H
 
 #include "core.h"
+#include "thread_pool.h"
 #include <filesystem>
 
 constexpr cppb::array<std::string_view, 4> source_extensions = {{ ".cpp", ".cxx", ".cc", ".c" }};
@@ -11,26 +12,34 @@ struct source_file
 	fs::path               file_path;
 	cppb::vector<fs::path> dependencies;
 	fs::file_time_type     last_modified_time;
+	// set when the file is scanned, 0 if it was read from the dependency file
+	std::uintmax_t         file_size;
 };
 
 struct compile_command
 {
+	std::string compiler;
 	std::string source_file;
 	cppb::vector<std::string> args;
 };
 
 cppb::vector<fs::path> get_source_files_in_directory(fs::path const &dir);
 
+// the files are scanned concurrently on 'pool'
 void analyze_source_files(
 	cppb::vector<fs::path> const &files,
 	cppb::vector<fs::path> const &include_directories,
 	cppb::vector<source_file> &sources,
 	fs::file_time_type dependency_file_last_update,
-	fs::file_time_type config_last_update
+	fs::file_time_type config_last_update,
+	thread_pool &pool
 );
 
 void fill_last_modified_times(cppb::vector<source_file> &sources);
 
+// a hash of the file's tokens, which doesn't change when only comments or whitespace are edited
+std::string get_token_fingerprint(fs::path const &file_path);
+
 void write_dependency_json(fs::path const &output_path, cppb::vector<source_file> const &sources);
 cppb::vector<source_file> read_dependency_json(fs::path const &dep_file_path, std::string &error);
 
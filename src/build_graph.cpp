@@ -0,0 +1,322 @@
+#include "build_graph.h"
+#include "process.h"
+#include <algorithm>
+#include <cassert>
+
+build_graph::build_graph(
+	thread_pool &pool,
+	jobserver *shared_jobserver,
+	std::uint64_t memory_budget,
+	std::size_t max_failure_count
+)
+	: _mutex(),
+	  _finished(),
+	  _memory_released(),
+	  _nodes(),
+	  _ready_nodes(),
+	  _unfinished_count(0),
+	  _active_task_count(0),
+	  _exit_code(0),
+	  _is_running(false),
+	  _jobserver(shared_jobserver),
+	  _memory_budget(memory_budget),
+	  _used_memory(0),
+	  _max_failure_count(max_failure_count),
+	  _failure_count(0),
+	  _is_cancelled(false),
+	  _pool(pool)
+{}
+
+build_graph::node_id build_graph::add_node(
+	std::function<int(void)> action,
+	cppb::span<node_id const> dependencies,
+	build_node_options options
+)
+{
+	auto lock = std::unique_lock(this->_mutex);
+
+	auto const id = this->_nodes.size();
+	this->_nodes.push_back({
+		.action = std::move(action),
+		.dependents = {},
+		.remaining_dependency_count = 0,
+		.is_any_dependency_failed = false,
+		.state = node_state::waiting,
+		.options = options,
+	});
+	this->_unfinished_count += 1;
+
+	auto &node = this->_nodes.back();
+	for (auto const dependency_id : dependencies)
+	{
+		auto &dependency = this->_nodes[dependency_id];
+		switch (dependency.state)
+		{
+		case node_state::waiting:
+		case node_state::running:
+			dependency.dependents.push_back(id);
+			node.remaining_dependency_count += 1;
+			break;
+		case node_state::succeeded:
+			break;
+		case node_state::failed:
+		case node_state::skipped:
+			node.is_any_dependency_failed = true;
+			break;
+		}
+	}
+
+	if (node.remaining_dependency_count != 0)
+	{
+		return id;
+	}
+
+	if (this->is_skipped_after_failure(node))
+	{
+		// one of the dependencies has already failed, so this node is skipped right away
+		node.state = node_state::skipped;
+		this->_unfinished_count -= 1;
+		[[maybe_unused]] auto const ready_count = this->release_dependents(id, true);
+		assert(ready_count == 0);
+		if (this->_unfinished_count == 0)
+		{
+			this->_finished.notify_all();
+		}
+	}
+	else
+	{
+		this->push_ready_node(id);
+		if (this->_is_running)
+		{
+			lock.unlock();
+			this->submit(1);
+		}
+	}
+	return id;
+}
+
+int build_graph::run(void)
+{
+	std::size_t ready_count = 0;
+	{
+		auto const guard = std::lock_guard(this->_mutex);
+		this->_is_running = true;
+		ready_count = this->_ready_nodes.size();
+	}
+	this->submit(ready_count);
+
+	auto lock = std::unique_lock(this->_mutex);
+	this->_finished.wait(lock, [this]() { return this->_unfinished_count == 0 && this->_active_task_count == 0; });
+	this->_is_running = false;
+	return this->_exit_code;
+}
+
+std::size_t build_graph::job_count(void) const
+{
+	return this->_pool.thread_count();
+}
+
+bool build_graph::is_cancelled(void) const
+{
+	return this->_is_cancelled.load();
+}
+
+bool build_graph::is_lower_priority(node_id lhs, node_id rhs) const
+{
+	auto const &lhs_options = this->_nodes[lhs].options;
+	auto const &rhs_options = this->_nodes[rhs].options;
+	if (lhs_options.group != rhs_options.group)
+	{
+		return lhs_options.group < rhs_options.group;
+	}
+	// nodes with the same priority are started in the order they were added
+	return lhs_options.priority != rhs_options.priority ? lhs_options.priority < rhs_options.priority : lhs > rhs;
+}
+
+void build_graph::push_ready_node(node_id id)
+{
+	auto &node = this->_nodes[id];
+	node.state = node_state::running;
+	this->_ready_nodes.push_back(id);
+	std::push_heap(this->_ready_nodes.begin(), this->_ready_nodes.end(), [this](node_id lhs, node_id rhs) {
+		return this->is_lower_priority(lhs, rhs);
+	});
+}
+
+std::optional<build_graph::node_id> build_graph::pop_ready_node(void)
+{
+	assert(!this->_ready_nodes.empty());
+	auto const is_lower_priority = [this](node_id lhs, node_id rhs) {
+		return this->is_lower_priority(lhs, rhs);
+	};
+	// a node is always started if nothing else is running, even if it's over the budget on its own
+	auto const fits_in_budget = [this](node_id id) {
+		return this->_memory_budget == 0
+			|| this->_used_memory == 0
+			|| this->_used_memory + this->_nodes[id].options.memory <= this->_memory_budget;
+	};
+
+	if (fits_in_budget(this->_ready_nodes.front()))
+	{
+		std::pop_heap(this->_ready_nodes.begin(), this->_ready_nodes.end(), is_lower_priority);
+		auto const id = this->_ready_nodes.back();
+		this->_ready_nodes.pop_back();
+		this->_used_memory += this->_nodes[id].options.memory;
+		return id;
+	}
+
+	auto best_it = this->_ready_nodes.end();
+	for (auto it = this->_ready_nodes.begin(); it != this->_ready_nodes.end(); ++it)
+	{
+		if (fits_in_budget(*it) && (best_it == this->_ready_nodes.end() || is_lower_priority(*best_it, *it)))
+		{
+			best_it = it;
+		}
+	}
+	if (best_it == this->_ready_nodes.end())
+	{
+		return std::nullopt;
+	}
+
+	auto const id = *best_it;
+	this->_ready_nodes.erase(best_it);
+	std::make_heap(this->_ready_nodes.begin(), this->_ready_nodes.end(), is_lower_priority);
+	this->_used_memory += this->_nodes[id].options.memory;
+	return id;
+}
+
+void build_graph::submit(std::size_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	{
+		auto const guard = std::lock_guard(this->_mutex);
+		this->_active_task_count += count;
+	}
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		this->_pool.push_task([this]() {
+			if (this->_jobserver != nullptr)
+			{
+				this->_jobserver->acquire();
+			}
+			// every task pushed to the pool corresponds to one ready node, but which one is only decided here,
+			// so a node that became ready later can still be started before the ones that were waiting
+			auto const [id, action] = [&]() -> std::pair<node_id, std::function<int(void)> *> {
+				auto lock = std::unique_lock(this->_mutex);
+				std::optional<node_id> ready_node;
+				// if only nodes that don't fit in the memory budget are ready, we wait for a running one to finish
+				this->_memory_released.wait(lock, [&]() {
+					ready_node = this->pop_ready_node();
+					return ready_node.has_value();
+				});
+				auto const ready_id = *ready_node;
+				// '_nodes' is a deque, so the reference stays valid when new nodes are added
+				return { ready_id, &this->_nodes[ready_id].action };
+			}();
+			// after a cancellation the nodes that were already ready are skipped when they're taken
+			auto const is_skipped = this->_is_cancelled.load() && [&]() {
+				auto const guard = std::lock_guard(this->_mutex);
+				return !this->_nodes[id].options.is_run_after_failure;
+			}();
+			auto const exit_code = is_skipped ? 0 : (*action)();
+			if (this->_jobserver != nullptr)
+			{
+				this->_jobserver->release();
+			}
+			if (is_skipped)
+			{
+				this->finish(id, node_state::skipped, 0);
+			}
+			else
+			{
+				this->finish(id, exit_code == 0 ? node_state::succeeded : node_state::failed, exit_code);
+			}
+
+			// the graph may be destroyed as soon as the mutex is unlocked here
+			auto const guard = std::lock_guard(this->_mutex);
+			this->_active_task_count -= 1;
+			if (this->_unfinished_count == 0 && this->_active_task_count == 0)
+			{
+				this->_finished.notify_all();
+			}
+		});
+	}
+}
+
+void build_graph::finish(node_id id, node_state state, int exit_code)
+{
+	std::size_t ready_count = 0;
+	bool is_newly_cancelled = false;
+	{
+		auto const guard = std::lock_guard(this->_mutex);
+		auto &node = this->_nodes[id];
+		node.state = state;
+		node.action = nullptr;
+		if (node.options.memory != 0)
+		{
+			this->_used_memory -= node.options.memory;
+			this->_memory_released.notify_all();
+		}
+		if (state == node_state::failed)
+		{
+			if (this->_exit_code == 0)
+			{
+				this->_exit_code = exit_code;
+			}
+			this->_failure_count += 1;
+			if (
+				this->_max_failure_count != 0
+				&& this->_failure_count >= this->_max_failure_count
+				&& !this->_is_cancelled.load()
+			)
+			{
+				this->_is_cancelled.store(true);
+				is_newly_cancelled = true;
+			}
+		}
+		this->_unfinished_count -= 1;
+		// 'run' is notified when the task that called this returns
+		ready_count = this->release_dependents(id, state != node_state::succeeded);
+	}
+	if (is_newly_cancelled)
+	{
+		terminate_child_processes();
+	}
+	this->submit(ready_count);
+}
+
+bool build_graph::is_skipped_after_failure(node_t const &node) const
+{
+	return node.is_any_dependency_failed && !node.options.is_run_after_failure;
+}
+
+std::size_t build_graph::release_dependents(node_id id, bool is_failed)
+{
+	std::size_t ready_count = 0;
+	for (auto const dependent_id : this->_nodes[id].dependents)
+	{
+		auto &dependent = this->_nodes[dependent_id];
+		dependent.is_any_dependency_failed |= is_failed;
+		dependent.remaining_dependency_count -= 1;
+		if (dependent.remaining_dependency_count != 0)
+		{
+			continue;
+		}
+
+		if (this->is_skipped_after_failure(dependent))
+		{
+			dependent.state = node_state::skipped;
+			this->_unfinished_count -= 1;
+			ready_count += this->release_dependents(dependent_id, true);
+		}
+		else
+		{
+			this->push_ready_node(dependent_id);
+			ready_count += 1;
+		}
+	}
+	return ready_count;
+}
@@ -0,0 +1,120 @@
+#ifndef BUILD_GRAPH_H
+#define BUILD_GRAPH_H
+
+#include "core.h"
+#include "thread_pool.h"
+#include "jobserver.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+struct build_node_options
+{
+	// the expected time from the start of the node to the end of the build
+	std::int64_t priority = 0;
+	// ready nodes of a higher group are started before the ones of lower groups, regardless of their priority
+	int group = 0;
+	// the expected peak memory use in bytes
+	std::uint64_t memory = 0;
+	// the node also runs if some of its dependencies failed or were skipped, e.g. to report errors
+	bool is_run_after_failure = false;
+};
+
+// A dependency graph of build steps (rules, dependency scanning, pre-compiled headers, translation units,
+// linking).  A node is started on the thread pool as soon as all of its dependencies have finished,
+// and nodes can be added while the graph is running, e.g. by the node that scans the source files.
+// A node returns an exit code; if it's not 0, every node that depends on it is skipped.
+// When more nodes are ready than there are free jobs, the ones in the highest group and with the highest priority
+// are started first; the caller usually sets the priority to the expected length of the longest path from the node
+// to the end of the build.
+// With a jobserver, every node takes a job token before it starts, so the limit is shared with other processes.
+// With a memory budget, a node is held back while the expected memory use of the running nodes and its own
+// would exceed the budget, and lower priority nodes that fit are started instead.
+// After 'max_failure_count' failed nodes the build is cancelled: the running commands are terminated, and the
+// nodes that haven't started yet are skipped, unless they're marked with 'is_run_after_failure'.
+struct build_graph
+{
+	using node_id = std::size_t;
+
+	// the nodes run on 'pool', which may be shared with other graphs, and its thread count is the job limit;
+	// 'shared_jobserver' may be nullptr, otherwise it must outlive the graph;
+	// a 'memory_budget' or 'max_failure_count' of 0 means no limit
+	build_graph(
+		thread_pool &pool,
+		jobserver *shared_jobserver,
+		std::uint64_t memory_budget,
+		std::size_t max_failure_count
+	);
+
+	build_graph(build_graph const &other) = delete;
+	build_graph(build_graph &&other) = delete;
+	build_graph &operator = (build_graph const &rhs) = delete;
+	build_graph &operator = (build_graph &&rhs) = delete;
+
+	// can be called before 'run' or from the action of a running node
+	node_id add_node(
+		std::function<int(void)> action,
+		cppb::span<node_id const> dependencies = {},
+		build_node_options options = {}
+	);
+
+	// blocks until every node has finished or was skipped and every task of the graph has returned,
+	// returns the exit code of the first failed node
+	int run(void);
+
+	std::size_t job_count(void) const;
+	bool is_cancelled(void) const;
+
+private:
+	enum class node_state
+	{
+		waiting, running, succeeded, failed, skipped,
+	};
+
+	struct node_t
+	{
+		std::function<int(void)> action;
+		cppb::vector<node_id> dependents;
+		std::size_t remaining_dependency_count;
+		bool is_any_dependency_failed;
+		node_state state;
+		build_node_options options;
+	};
+
+	bool is_lower_priority(node_id lhs, node_id rhs) const;
+	// the following three are called with '_mutex' locked
+	void push_ready_node(node_id id);
+	// returns the ready node with the highest priority that fits in the memory budget
+	std::optional<node_id> pop_ready_node(void);
+	// returns the number of nodes that became ready
+	std::size_t release_dependents(node_id id, bool is_failed);
+	bool is_skipped_after_failure(node_t const &node) const;
+
+	// starts 'count' tasks, each of which runs the ready node with the highest priority at the time it starts
+	void submit(std::size_t count);
+	// 'state' is either 'succeeded', 'failed' or 'skipped'
+	void finish(node_id id, node_state state, int exit_code);
+
+	std::mutex _mutex;
+	std::condition_variable _finished;
+	std::condition_variable _memory_released;
+	std::deque<node_t> _nodes;
+	// a heap ordered by priority, then by the order the nodes were added in
+	cppb::vector<node_id> _ready_nodes;
+	std::size_t _unfinished_count;
+	// tasks pushed to the pool that haven't returned yet; the graph can only be destroyed after all of them
+	std::size_t _active_task_count;
+	int _exit_code;
+	bool _is_running;
+	jobserver *_jobserver;
+	std::uint64_t _memory_budget;
+	std::uint64_t _used_memory;
+	std::size_t _max_failure_count;
+	std::size_t _failure_count;
+	std::atomic<bool> _is_cancelled;
+	thread_pool &_pool;
+};
+
+#endif // BUILD_GRAPH_H
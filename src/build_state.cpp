@@ -0,0 +1,284 @@
+#include "build_state.h"
+#include <chrono>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+std::int64_t get_current_time(void)
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()
+	).count();
+}
+
+std::string get_build_state_key(fs::path const &output_file)
+{
+	return fs::relative(output_file).lexically_normal().generic_string();
+}
+
+static resource_usage read_resource_usage(json const &value)
+{
+	auto result = resource_usage{};
+	auto const read_field = [&value]<typename T>(char const *key, T &field) {
+		auto const it = value.find(key);
+		if (it != value.end() && (std::is_signed_v<T> ? it.value().is_number_integer() : it.value().is_number_unsigned()))
+		{
+			field = it.value().get<T>();
+		}
+	};
+	read_field("user_time", result.user_time);
+	read_field("system_time", result.system_time);
+	read_field("peak_memory", result.peak_memory);
+	read_field("minor_page_faults", result.minor_page_faults);
+	read_field("major_page_faults", result.major_page_faults);
+	read_field("voluntary_context_switches", result.voluntary_context_switches);
+	read_field("involuntary_context_switches", result.involuntary_context_switches);
+	return result;
+}
+
+// fields that are 0 are left out, most of them are unknown on some platforms
+static void write_resource_usage(json &value, resource_usage const &usage)
+{
+	auto const write_field = [&value](char const *key, auto field) {
+		if (field != 0)
+		{
+			value[key] = field;
+		}
+	};
+	write_field("user_time", usage.user_time);
+	write_field("system_time", usage.system_time);
+	write_field("peak_memory", usage.peak_memory);
+	write_field("minor_page_faults", usage.minor_page_faults);
+	write_field("major_page_faults", usage.major_page_faults);
+	write_field("voluntary_context_switches", usage.voluntary_context_switches);
+	write_field("involuntary_context_switches", usage.involuntary_context_switches);
+}
+
+static std::unordered_map<std::string, resource_usage> read_resource_usages(json const &object, char const *object_key)
+{
+	auto result = std::unordered_map<std::string, resource_usage>();
+	if (auto const usages_it = object.find(object_key); usages_it != object.end() && usages_it.value().is_object())
+	{
+		for (auto const &[key, value] : usages_it.value().items())
+		{
+			if (value.is_object())
+			{
+				result.insert_or_assign(key, read_resource_usage(value));
+			}
+		}
+	}
+	return result;
+}
+
+static void write_resource_usages(json &object, char const *object_key, std::unordered_map<std::string, resource_usage> const &usages)
+{
+	if (usages.empty())
+	{
+		return;
+	}
+	auto values = json::object();
+	for (auto const &[name, usage] : usages)
+	{
+		auto value = json::object();
+		write_resource_usage(value, usage);
+		values[name] = std::move(value);
+	}
+	object[object_key] = std::move(values);
+}
+
+build_state read_build_state_json(fs::path const &build_state_json)
+{
+	std::ifstream input(build_state_json);
+	if (!input.is_open())
+	{
+		return {};
+	}
+
+	// the build state is only an optimization, so a corrupted file is simply discarded
+	auto const object = json::parse(input, nullptr, false);
+	if (object.is_discarded() || !object.is_object())
+	{
+		return {};
+	}
+
+	auto result = build_state{};
+
+	if (auto const it = object.find("cache_hits"); it != object.end() && it.value().is_number_unsigned())
+	{
+		result.cache_hits = it.value().get<std::uint64_t>();
+	}
+	if (auto const it = object.find("cache_misses"); it != object.end() && it.value().is_number_unsigned())
+	{
+		result.cache_misses = it.value().get<std::uint64_t>();
+	}
+
+	if (auto const outputs_it = object.find("outputs"); outputs_it != object.end() && outputs_it.value().is_object())
+	{
+		for (auto const &[key, value] : outputs_it.value().items())
+		{
+			if (!value.is_object())
+			{
+				continue;
+			}
+
+			auto state = output_state{};
+			if (auto const it = value.find("source"); it != value.end() && it.value().is_string())
+			{
+				state.source_file = it.value().get<std::string>();
+			}
+			if (auto const it = value.find("last_access"); it != value.end() && it.value().is_number_integer())
+			{
+				state.last_access_time = it.value().get<std::int64_t>();
+			}
+			if (auto const it = value.find("build_duration"); it != value.end() && it.value().is_number_integer())
+			{
+				state.build_duration = it.value().get<std::int64_t>();
+			}
+			state.usage = read_resource_usage(value);
+			result.outputs.insert_or_assign(key, std::move(state));
+		}
+	}
+
+	if (auto const sources_it = object.find("sources"); sources_it != object.end() && sources_it.value().is_object())
+	{
+		for (auto const &[key, value] : sources_it.value().items())
+		{
+			if (!value.is_object())
+			{
+				continue;
+			}
+
+			auto const write_time_it = value.find("last_write_time");
+			auto const fingerprint_it = value.find("token_fingerprint");
+			if (
+				write_time_it == value.end() || !write_time_it.value().is_number_integer()
+				|| fingerprint_it == value.end() || !fingerprint_it.value().is_string()
+			)
+			{
+				continue;
+			}
+
+			result.sources.insert_or_assign(key, source_state{
+				.last_write_time = fs::file_time_type(
+					fs::file_time_type::duration(write_time_it.value().get<fs::file_time_type::rep>())
+				),
+				.token_fingerprint = fingerprint_it.value().get<std::string>(),
+			});
+		}
+	}
+
+	if (auto const links_it = object.find("link_durations"); links_it != object.end() && links_it.value().is_object())
+	{
+		for (auto const &[key, value] : links_it.value().items())
+		{
+			if (value.is_number_integer())
+			{
+				result.link_durations.insert_or_assign(key, value.get<std::int64_t>());
+			}
+		}
+	}
+
+	result.link_usages = read_resource_usages(object, "link_usages");
+	result.rule_usages = read_resource_usages(object, "rule_usages");
+
+	if (auto const edits_it = object.find("source_edits"); edits_it != object.end() && edits_it.value().is_object())
+	{
+		for (auto const &[key, value] : edits_it.value().items())
+		{
+			if (!value.is_object())
+			{
+				continue;
+			}
+
+			auto const write_time_it = value.find("last_write_time");
+			auto const edit_count_it = value.find("edit_count");
+			auto const last_edit_it = value.find("last_edit");
+			if (
+				write_time_it == value.end() || !write_time_it.value().is_number_integer()
+				|| edit_count_it == value.end() || !edit_count_it.value().is_number_unsigned()
+				|| last_edit_it == value.end() || !last_edit_it.value().is_number_integer()
+			)
+			{
+				continue;
+			}
+
+			result.source_edits.insert_or_assign(key, source_edit_state{
+				.last_write_time = fs::file_time_type(
+					fs::file_time_type::duration(write_time_it.value().get<fs::file_time_type::rep>())
+				),
+				.edit_count = edit_count_it.value().get<std::uint32_t>(),
+				.last_edit_time = last_edit_it.value().get<std::int64_t>(),
+			});
+		}
+	}
+
+	return result;
+}
+
+void write_build_state_json(fs::path const &build_state_json, build_state const &state)
+{
+	auto object = json::object();
+
+	object["cache_hits"] = state.cache_hits;
+	object["cache_misses"] = state.cache_misses;
+
+	auto outputs = json::object();
+	for (auto const &[key, output] : state.outputs)
+	{
+		auto value = json::object();
+		value["source"] = output.source_file;
+		value["last_access"] = output.last_access_time;
+		if (output.build_duration != 0)
+		{
+			value["build_duration"] = output.build_duration;
+		}
+		write_resource_usage(value, output.usage);
+		outputs[key] = std::move(value);
+	}
+	object["outputs"] = std::move(outputs);
+
+	if (!state.sources.empty())
+	{
+		auto sources = json::object();
+		for (auto const &[key, source] : state.sources)
+		{
+			auto value = json::object();
+			value["last_write_time"] = source.last_write_time.time_since_epoch().count();
+			value["token_fingerprint"] = source.token_fingerprint;
+			sources[key] = std::move(value);
+		}
+		object["sources"] = std::move(sources);
+	}
+
+	if (!state.link_durations.empty())
+	{
+		auto link_durations = json::object();
+		for (auto const &[key, duration] : state.link_durations)
+		{
+			link_durations[key] = duration;
+		}
+		object["link_durations"] = std::move(link_durations);
+	}
+
+	write_resource_usages(object, "link_usages", state.link_usages);
+	write_resource_usages(object, "rule_usages", state.rule_usages);
+
+	if (!state.source_edits.empty())
+	{
+		auto source_edits = json::object();
+		for (auto const &[key, source] : state.source_edits)
+		{
+			auto value = json::object();
+			value["last_write_time"] = source.last_write_time.time_since_epoch().count();
+			value["edit_count"] = source.edit_count;
+			value["last_edit"] = source.last_edit_time;
+			source_edits[key] = std::move(value);
+		}
+		object["source_edits"] = std::move(source_edits);
+	}
+
+	fs::create_directories(build_state_json.parent_path());
+	auto output_file = std::ofstream(build_state_json);
+	output_file << object.dump();
+}
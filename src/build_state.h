@@ -0,0 +1,53 @@
+#ifndef BUILD_STATE_H
+#define BUILD_STATE_H
+
+#include "core.h"
+#include "process.h"
+#include <unordered_map>
+
+struct output_state
+{
+	std::string  source_file;
+	std::int64_t last_access_time = 0; // seconds since epoch
+	std::int64_t build_duration   = 0; // milliseconds, 0 if it's unknown
+	resource_usage usage;
+};
+
+struct source_state
+{
+	fs::file_time_type last_write_time{};
+	std::string        token_fingerprint;
+};
+
+// how often a source file is edited, only recorded for projects with 'unity_build'
+struct source_edit_state
+{
+	fs::file_time_type last_write_time{};
+	std::uint32_t      edit_count     = 0; // the number of builds that saw a new write time
+	std::int64_t       last_edit_time = 0; // seconds since epoch
+};
+
+struct build_state
+{
+	std::uint64_t cache_hits   = 0;
+	std::uint64_t cache_misses = 0;
+	std::unordered_map<std::string, output_state> outputs;
+	// keyed by the absolute path of the source file
+	std::unordered_map<std::string, source_state> sources;
+	// link time in milliseconds, keyed by the executable; these are not part of 'outputs', so they're not cache entries
+	std::unordered_map<std::string, std::int64_t> link_durations;
+	// keyed by the executable like 'link_durations'
+	std::unordered_map<std::string, resource_usage> link_usages;
+	// the usage of the last run of each rule, summed over its commands, keyed by the rule name
+	std::unordered_map<std::string, resource_usage> rule_usages;
+	// keyed by the absolute path of the source file
+	std::unordered_map<std::string, source_edit_state> source_edits;
+};
+
+std::int64_t get_current_time(void);
+std::string get_build_state_key(fs::path const &output_file);
+
+build_state read_build_state_json(fs::path const &build_state_json);
+void write_build_state_json(fs::path const &build_state_json, build_state const &state);
+
+#endif // BUILD_STATE_H
@@ -0,0 +1,278 @@
+#include "cache.h"
+#include <chrono>
+#include <limits>
+#include <unordered_set>
+
+fs::path get_output_file_info_json(fs::path const &cache_dir, fs::path const &output_file)
+{
+	fs::path result = cache_dir / fs::relative(output_file);
+	result += ".json";
+	return result;
+}
+
+static std::int64_t to_seconds_since_epoch(fs::file_time_type time)
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::file_clock::to_sys(time).time_since_epoch()
+	).count();
+}
+
+static std::uintmax_t get_file_size_or_zero(fs::path const &file)
+{
+	std::error_code ec;
+	auto const size = fs::file_size(file, ec);
+	return ec ? 0 : size;
+}
+
+static cache_entry make_cache_entry(fs::path const &output_file, fs::path const &cache_dir, build_state const &state)
+{
+	auto const key = get_build_state_key(output_file);
+	auto const state_it = state.outputs.find(key);
+	auto info_file = get_output_file_info_json(cache_dir, output_file);
+	auto const size = get_file_size_or_zero(output_file) + get_file_size_or_zero(info_file);
+
+	if (state_it == state.outputs.end())
+	{
+		// we have never seen this file being used, so the best guess is its last write time
+		return {
+			.output_file = output_file,
+			.info_file = std::move(info_file),
+			.size = size,
+			.last_access_time = to_seconds_since_epoch(fs::last_write_time(output_file)),
+			.is_orphan = false,
+		};
+	}
+	else
+	{
+		auto const &source_file = state_it->second.source_file;
+		return {
+			.output_file = output_file,
+			.info_file = std::move(info_file),
+			.size = size,
+			.last_access_time = state_it->second.last_access_time,
+			.is_orphan = !source_file.empty() && !fs::exists(source_file),
+		};
+	}
+}
+
+cppb::vector<cache_entry> collect_cache_entries(fs::path const &bin_dir, fs::path const &cache_dir, build_state const &state)
+{
+	cppb::vector<cache_entry> result;
+	std::unordered_set<std::string> seen_keys;
+
+	// object files and pre-compiled headers in bin/<config>/int-<project>
+	if (fs::is_directory(bin_dir))
+	{
+		for (auto const &config_dir : fs::directory_iterator(bin_dir))
+		{
+			if (!config_dir.is_directory())
+			{
+				continue;
+			}
+			for (auto const &intermediate_dir : fs::directory_iterator(config_dir.path()))
+			{
+				if (!intermediate_dir.is_directory() || !intermediate_dir.path().filename().generic_string().starts_with("int-"))
+				{
+					continue;
+				}
+				for (auto const &file : fs::recursive_directory_iterator(intermediate_dir.path()))
+				{
+					if (!file.is_regular_file())
+					{
+						continue;
+					}
+					seen_keys.insert(get_build_state_key(file.path()));
+					result.push_back(make_cache_entry(file.path(), cache_dir, state));
+				}
+			}
+		}
+	}
+
+	// outputs that live outside of the bin directory, e.g. gcc's .gch files
+	for (auto const &[key, output] : state.outputs)
+	{
+		if (!seen_keys.contains(key) && fs::exists(key))
+		{
+			seen_keys.insert(key);
+			result.push_back(make_cache_entry(key, cache_dir, state));
+		}
+	}
+
+	// output file infos whose output file no longer exists
+	if (fs::is_directory(cache_dir))
+	{
+		for (auto const &file : fs::recursive_directory_iterator(cache_dir))
+		{
+			if (!file.is_regular_file() || file.path().extension() != ".json")
+			{
+				continue;
+			}
+			auto output_file = fs::relative(file.path(), cache_dir);
+			output_file.replace_extension();
+			if (seen_keys.contains(get_build_state_key(output_file)) || fs::exists(output_file))
+			{
+				continue;
+			}
+			result.push_back({
+				.output_file = std::move(output_file),
+				.info_file = file.path(),
+				.size = get_file_size_or_zero(file.path()),
+				.last_access_time = 0,
+				.is_orphan = true,
+			});
+		}
+	}
+
+	return result;
+}
+
+std::uintmax_t get_reclaimable_size(cppb::vector<cache_entry> const &entries, std::optional<std::uintmax_t> max_cache_size)
+{
+	auto const orphan_size = entries
+		.filter([](auto const &entry) { return entry.is_orphan; })
+		.transform([](auto const &entry) { return entry.size; })
+		.sum();
+	auto const used_size = entries
+		.filter([](auto const &entry) { return !entry.is_orphan; })
+		.transform([](auto const &entry) { return entry.size; })
+		.sum();
+	if (max_cache_size.has_value() && used_size > *max_cache_size)
+	{
+		return orphan_size + (used_size - *max_cache_size);
+	}
+	else
+	{
+		return orphan_size;
+	}
+}
+
+static void remove_cache_entry(cache_entry const &entry, build_state &state)
+{
+	std::error_code ec;
+	fs::remove(entry.output_file, ec);
+	fs::remove(entry.info_file, ec);
+	state.outputs.erase(get_build_state_key(entry.output_file));
+}
+
+cache_gc_result collect_cache_garbage(
+	cppb::vector<cache_entry> entries,
+	build_state &state,
+	std::optional<std::uintmax_t> max_cache_size,
+	std::int64_t protected_since
+)
+{
+	auto result = cache_gc_result{};
+
+	for (auto const &entry : entries)
+	{
+		if (entry.is_orphan)
+		{
+			remove_cache_entry(entry, state);
+			result.removed_count += 1;
+			result.removed_size += entry.size;
+		}
+	}
+
+	auto live_entries = entries
+		.filter([](auto const &entry) { return !entry.is_orphan; })
+		.collect<cppb::vector>();
+	result.remaining_size = live_entries
+		.transform([](auto const &entry) { return entry.size; })
+		.sum();
+
+	if (!max_cache_size.has_value() || result.remaining_size <= *max_cache_size)
+	{
+		return result;
+	}
+
+	// least recently used entries are evicted first
+	live_entries.sort([](auto const &lhs, auto const &rhs) {
+		return lhs.last_access_time < rhs.last_access_time;
+	});
+	for (auto const &entry : live_entries)
+	{
+		if (result.remaining_size <= *max_cache_size || entry.last_access_time >= protected_since)
+		{
+			break;
+		}
+		remove_cache_entry(entry, state);
+		result.removed_count += 1;
+		result.removed_size += entry.size;
+		result.remaining_size -= entry.size;
+	}
+
+	return result;
+}
+
+std::optional<std::uintmax_t> parse_cache_size(std::string_view size)
+{
+	std::uintmax_t result = 0;
+	auto it = size.begin();
+	auto const end = size.end();
+	if (it == end || !(*it >= '0' && *it <= '9'))
+	{
+		return std::nullopt;
+	}
+	for (; it != end && *it >= '0' && *it <= '9'; ++it)
+	{
+		auto const digit = static_cast<std::uintmax_t>(*it - '0');
+		if (result > (std::numeric_limits<std::uintmax_t>::max() - digit) / 10)
+		{
+			return std::nullopt;
+		}
+		result = result * 10 + digit;
+	}
+
+	auto const suffix = std::string_view(it, end);
+	auto const shift = [&]() -> std::optional<int> {
+		if (suffix == "" || suffix == "B")
+		{
+			return 0;
+		}
+		else if (suffix == "K" || suffix == "KB" || suffix == "KiB")
+		{
+			return 10;
+		}
+		else if (suffix == "M" || suffix == "MB" || suffix == "MiB")
+		{
+			return 20;
+		}
+		else if (suffix == "G" || suffix == "GB" || suffix == "GiB")
+		{
+			return 30;
+		}
+		else if (suffix == "T" || suffix == "TB" || suffix == "TiB")
+		{
+			return 40;
+		}
+		else
+		{
+			return std::nullopt;
+		}
+	}();
+	if (!shift.has_value() || result > (std::numeric_limits<std::uintmax_t>::max() >> *shift))
+	{
+		return std::nullopt;
+	}
+	return result << *shift;
+}
+
+std::string format_cache_size(std::uintmax_t size)
+{
+	constexpr cppb::array<std::string_view, 5> units = {{ "B", "KiB", "MiB", "GiB", "TiB" }};
+	auto value = static_cast<double>(size);
+	std::size_t unit_index = 0;
+	while (value >= 1024.0 && unit_index + 1 < units.size())
+	{
+		value /= 1024.0;
+		unit_index += 1;
+	}
+	if (unit_index == 0)
+	{
+		return fmt::format("{} {}", size, units[unit_index]);
+	}
+	else
+	{
+		return fmt::format("{:.1f} {}", value, units[unit_index]);
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "core.h"
+#include "build_state.h"
+
+struct cache_entry
+{
+	fs::path       output_file;
+	fs::path       info_file;
+	std::uintmax_t size;
+	std::int64_t   last_access_time;
+	bool           is_orphan;
+};
+
+struct cache_gc_result
+{
+	std::size_t    removed_count  = 0;
+	std::uintmax_t removed_size   = 0;
+	std::uintmax_t remaining_size = 0;
+};
+
+fs::path get_output_file_info_json(fs::path const &cache_dir, fs::path const &output_file);
+
+cppb::vector<cache_entry> collect_cache_entries(fs::path const &bin_dir, fs::path const &cache_dir, build_state const &state);
+std::uintmax_t get_reclaimable_size(cppb::vector<cache_entry> const &entries, std::optional<std::uintmax_t> max_cache_size);
+
+// removes orphaned entries and, if 'max_cache_size' is set, evicts the least recently used entries
+// until the cache fits in the budget; entries accessed at or after 'protected_since' are never evicted
+cache_gc_result collect_cache_garbage(
+	cppb::vector<cache_entry> entries,
+	build_state &state,
+	std::optional<std::uintmax_t> max_cache_size,
+	std::int64_t protected_since
+);
+
+std::optional<std::uintmax_t> parse_cache_size(std::string_view size);
+std::string format_cache_size(std::uintmax_t size);
+
+#endif // CACHE_H
@@ -8,6 +8,9 @@ constexpr auto build_options    = ctcli::options_id_t::_1;
 constexpr auto run_options      = build_options;
 constexpr auto new_options      = ctcli::options_id_t::_2;
 constexpr auto run_rule_options = ctcli::options_id_t::_3;
+constexpr auto cache_options    = ctcli::options_id_t::_4;
+constexpr auto cache_server_options = ctcli::options_id_t::_5;
+constexpr auto worker_options   = ctcli::options_id_t::_6;
 
 template<>
 inline constexpr bool ctcli::add_verbose_option<build_options> = true;
@@ -17,13 +20,29 @@ inline constexpr std::array ctcli::command_line_options<build_options> = {
 	ctcli::create_option("--config-file <path>",         "Set configuration file path (default=.cppb/config.json)", ctcli::arg_type::string),
 	ctcli::create_option("--cppb-dir <dir>",             "Set directory used for caching (default=.cppb)",          ctcli::arg_type::string),
 	ctcli::create_option("--bin-dir <dir>",              "Set binary output directory to dir> (default=bin)",       ctcli::arg_type::string),
-	ctcli::create_option("--build-config <config>",      "Set which build configuration to use (default=default)",  ctcli::arg_type::string),
+	ctcli::create_option("--build-config <config>",      "Set which build configuration to use, or with 'build' a comma separated list of them (default=default)", ctcli::arg_type::string),
+	ctcli::create_option("--all",                        "Build every configuration in the configuration file; not supported by 'run'"),
 	ctcli::create_option("--build-mode {debug|release}", "Set build mode (default=debug)"),
 	ctcli::create_option("-r, --rebuild",                "Rebuild the whole project"),
 	ctcli::create_option("--link",                       "Force linking to happen"),
 	ctcli::create_option("-j, --jobs <count>",           "Set the number of compiler jobs to run concurrently; default is the number of cores on the machine", ctcli::arg_type::uint64),
+	ctcli::create_option("--cpu-jobs <count>",           "Set the number of threads for up-to-date checks and token fingerprints; default is the job count", ctcli::arg_type::uint64),
+	ctcli::create_option("--io-jobs <count>",            "Set the number of threads for dependency scanning, file hashing and remote cache uploads; default is the job count", ctcli::arg_type::uint64),
 	ctcli::create_option("-s, --sequential",             "Don't run compilation processes concurrently"),
+	ctcli::create_option("--ordered-output",             "Print compiler output in the order of the source files instead of the order the compilations finish in"),
+	ctcli::create_option("--structured-diagnostics",     "Read compiler diagnostics as JSON (gcc) or SARIF (clang), and print each distinct diagnostic only once per build"),
+	ctcli::create_option("-k, --keep-going",             "Keep building after a job fails; by default the build stops at the first error if it's run from a terminal"),
+	ctcli::create_option("--max-failures <count>",       "Keep building until <count> jobs fail, 0 means no limit", ctcli::arg_type::uint64),
 	ctcli::create_option("--emit-compile-commands",      "Emit a compile_commands.json file"),
+	ctcli::create_option("--max-cache-size <size>",      "Evict least recently used objects after the build until the cache fits in <size>, e.g. 10G", ctcli::arg_type::string),
+	ctcli::create_option("--remote-cache <url>",         "Share object files through the HTTP cache at <url>, e.g. http://localhost:8080/cache", ctcli::arg_type::string),
+	ctcli::create_option("--bypass-driver",              "Run the compiler frontend, e.g. cc1plus, directly with the command line printed by the driver for -###, which is computed once for every set of flags"),
+	ctcli::create_option("--workers <list>",             "Send compilations to 'cppb worker' processes when every local job is busy; <list> is a comma separated list of <host>:<port>", ctcli::arg_type::string),
+	ctcli::create_option("--explain",                    "Print why each out of date file needs to be compiled"),
+	ctcli::create_option("--explain-json <path>",        "Write the rebuild reason of every file as JSON to <path>", ctcli::arg_type::string),
+	ctcli::create_option("--memory-budget <size>",       "Hold back compilations whose recorded peak memory use doesn't fit in <size>, e.g. 64G; 0 means no limit (default=physical memory)", ctcli::arg_type::string),
+	ctcli::create_option("--schedule {edited-first|critical-path}", "Set which out of date files are compiled first; edited-first starts the files whose own source changed before the ones only affected by a header, critical-path starts the longest ones first (default=edited-first)"),
+	ctcli::create_option("--jobserver-style {fifo|pipe}", "Set the kind of make jobserver exported to rules when cppb isn't run by make; fifo needs GNU make 4.4 (default=pipe)"),
 };
 
 template<>
@@ -38,6 +57,29 @@ inline constexpr std::array ctcli::command_line_options<run_rule_options> = {
 	ctcli::create_option("--config-file <path>", "Set configuration file path (default=.cppb/config.json)", ctcli::arg_type::string),
 };
 
+template<>
+inline constexpr std::array ctcli::command_line_options<cache_options> = {
+	ctcli::create_option("--config-file <path>",    "Set configuration file path (default=.cppb/config.json)", ctcli::arg_type::string),
+	ctcli::create_option("--cppb-dir <dir>",        "Set directory used for caching (default=.cppb)",          ctcli::arg_type::string),
+	ctcli::create_option("--bin-dir <dir>",         "Set binary output directory to dir> (default=bin)",       ctcli::arg_type::string),
+	ctcli::create_option("--max-cache-size <size>", "Set the cache size budget used by 'gc' and 'stats', e.g. 10G", ctcli::arg_type::string),
+};
+
+template<>
+inline constexpr std::array ctcli::command_line_options<cache_server_options> = {
+	ctcli::create_option("--dir <dir>",       "Set the directory where cache entries are stored (default=.cppb/remote-cache)", ctcli::arg_type::string),
+	ctcli::create_option("--host <address>",  "Set the address to listen on (default=127.0.0.1)", ctcli::arg_type::string),
+	ctcli::create_option("--port <port>",     "Set the port to listen on (default=8080)",         ctcli::arg_type::uint16),
+};
+
+template<>
+inline constexpr std::array ctcli::command_line_options<worker_options> = {
+	ctcli::create_option("--host <address>",   "Set the address to listen on (default=127.0.0.1)", ctcli::arg_type::string),
+	ctcli::create_option("--port <port>",      "Set the port to listen on (default=8081)", ctcli::arg_type::uint16),
+	ctcli::create_option("-j, --jobs <count>", "Set the number of compilations to run concurrently; default is the number of cores on the machine", ctcli::arg_type::uint64),
+	ctcli::create_option("--compilers <list>", "Set the compilers that builds can run, a comma separated list of names or paths (default=gcc,g++,clang,clang++)", ctcli::arg_type::string),
+};
+
 template<>
 inline constexpr std::array ctcli::command_line_commands<ctcli::commands_id_t::def> = {
 	ctcli::create_command("build", "Build project",         "compiler-flags", build_options),
@@ -45,6 +87,9 @@ inline constexpr std::array ctcli::command_line_commands<ctcli::commands_id_t::d
 
 	ctcli::create_command("run-rule <rule>",    "Run <rule>",                                           "", run_rule_options, ctcli::arg_type::string),
 	ctcli::create_command("new <project-name>", "Create a new project in the directory <project-name>", "", new_options,      ctcli::arg_type::string),
+	ctcli::create_command("cache <action>",     "Manage the object cache; <action> is one of gc, stats or clear", "", cache_options, ctcli::arg_type::string),
+	ctcli::create_command("cache-server",       "Serve a remote object cache over HTTP from a local directory",  "", cache_server_options),
+	ctcli::create_command("worker",             "Run compilations sent by builds with --workers",               "", worker_options),
 };
 
 enum class build_mode
@@ -68,9 +113,55 @@ inline std::optional<build_mode> parse_build_mode(std::string_view arg)
 	}
 }
 
+enum class jobserver_style
+{
+	fifo, pipe,
+};
+
+inline std::optional<jobserver_style> parse_jobserver_style(std::string_view arg)
+{
+	if (arg == "fifo")
+	{
+		return jobserver_style::fifo;
+	}
+	else if (arg == "pipe")
+	{
+		return jobserver_style::pipe;
+	}
+	else
+	{
+		return {};
+	}
+}
+
+enum class schedule_policy
+{
+	edited_first, critical_path,
+};
+
+inline std::optional<schedule_policy> parse_schedule_policy(std::string_view arg)
+{
+	if (arg == "edited-first")
+	{
+		return schedule_policy::edited_first;
+	}
+	else if (arg == "critical-path")
+	{
+		return schedule_policy::critical_path;
+	}
+	else
+	{
+		return {};
+	}
+}
+
 // template<>
 // inline constexpr auto ctcli::argument_parse_function<ctcli::option("analyze --build-mode")> = &parse_build_mode;
 template<>
 inline constexpr auto ctcli::argument_parse_function<ctcli::option("build --build-mode")> = &parse_build_mode;
+template<>
+inline constexpr auto ctcli::argument_parse_function<ctcli::option("build --jobserver-style")> = &parse_jobserver_style;
+template<>
+inline constexpr auto ctcli::argument_parse_function<ctcli::option("build --schedule")> = &parse_schedule_policy;
 
 #endif // CL_OPTIONS_H
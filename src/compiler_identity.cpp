@@ -0,0 +1,52 @@
+#include "compiler_identity.h"
+#include "process.h"
+#include <mutex>
+#include <unordered_map>
+
+static std::string_view get_first_line(std::string_view output)
+{
+	auto const line_end = output.find('\n');
+	auto line = output.substr(0, line_end);
+	if (line.ends_with('\r'))
+	{
+		line.remove_suffix(1);
+	}
+	return line;
+}
+
+static std::string compute_compiler_identity(std::string_view compiler)
+{
+	auto const version = run_command(compiler, {{ "--version" }}, true);
+	auto const machine = run_command(compiler, {{ "-dumpmachine" }}, true);
+	if (version.exit_code != 0 || machine.exit_code != 0)
+	{
+		return "";
+	}
+	auto const version_line = get_first_line(version.stdout_string);
+	auto const machine_line = get_first_line(machine.stdout_string);
+	if (version_line.empty() || machine_line.empty())
+	{
+		return "";
+	}
+	return fmt::format("{}\n{}", version_line, machine_line);
+}
+
+std::string get_compiler_identity(std::string_view compiler)
+{
+	static std::mutex identities_mutex;
+	static std::unordered_map<std::string, std::string> identities;
+
+	{
+		auto const guard = std::lock_guard(identities_mutex);
+		if (auto const it = identities.find(std::string(compiler)); it != identities.end())
+		{
+			return it->second;
+		}
+	}
+
+	// computed without holding the lock, so different compilers don't wait for each other;
+	// a compiler may be run more than once if it's first used by several threads at the same time
+	auto identity = compute_compiler_identity(compiler);
+	auto const guard = std::lock_guard(identities_mutex);
+	return identities.insert({ std::string(compiler), std::move(identity) }).first->second;
+}
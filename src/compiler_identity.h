@@ -0,0 +1,12 @@
+#ifndef COMPILER_IDENTITY_H
+#define COMPILER_IDENTITY_H
+
+#include "core.h"
+
+// the first line of '<compiler> --version' and the target of '<compiler> -dumpmachine', e.g.
+// 'g++ (Debian 12.2.0-14) 12.2.0\nx86_64-linux-gnu'; two compilers with the same identity produce
+// the same object files from the same preprocessed source and flags.
+// empty if the compiler can't be run; the result is computed once for every compiler name
+std::string get_compiler_identity(std::string_view compiler);
+
+#endif // COMPILER_IDENTITY_H
@@ -0,0 +1,109 @@
+#include "compiler_launcher.h"
+#include "process.h"
+#include "http.h"
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// 'ccache --print-stats' prints one '<name>\t<value>' pair per line
+static std::optional<compiler_launcher_stats> get_ccache_stats(fs::path const &launcher)
+{
+	auto const [output, is_good] = capture_command_output(launcher.string(), {{ "--print-stats" }});
+	if (!is_good)
+	{
+		return std::nullopt;
+	}
+
+	auto result = compiler_launcher_stats();
+	bool is_any_found = false;
+	std::string_view lines = output;
+	while (!lines.empty())
+	{
+		auto const line_end = lines.find('\n');
+		auto const line = lines.substr(0, line_end);
+		lines.remove_prefix(line_end == std::string_view::npos ? lines.size() : line_end + 1);
+
+		auto const tab = line.find('\t');
+		if (tab == std::string_view::npos)
+		{
+			continue;
+		}
+		auto const name = line.substr(0, tab);
+		auto const value = parse_decimal(line.substr(tab + 1));
+		if (!value.has_value())
+		{
+			continue;
+		}
+		if (name == "direct_cache_hit" || name == "preprocessed_cache_hit")
+		{
+			result.hits += *value;
+			is_any_found = true;
+		}
+		else if (name == "cache_miss")
+		{
+			result.misses += *value;
+			is_any_found = true;
+		}
+	}
+	if (!is_any_found)
+	{
+		return std::nullopt;
+	}
+	return result;
+}
+
+// the counts of sccache are per language, e.g. '"cache_hits": { "counts": { "C/C++": 12 } }'
+static std::uint64_t get_sccache_count(json const &stats, char const *name)
+{
+	std::uint64_t result = 0;
+	if (
+		auto const it = stats.find(name);
+		it != stats.end() && it.value().is_object() && it.value().contains("counts") && it.value()["counts"].is_object()
+	)
+	{
+		for (auto const &[language, count] : it.value()["counts"].items())
+		{
+			if (count.is_number_unsigned())
+			{
+				result += count.get<std::uint64_t>();
+			}
+		}
+	}
+	return result;
+}
+
+static std::optional<compiler_launcher_stats> get_sccache_stats(fs::path const &launcher)
+{
+	auto const [output, is_good] = capture_command_output(launcher.string(), {{ "--show-stats", "--stats-format=json" }});
+	if (!is_good)
+	{
+		return std::nullopt;
+	}
+	auto const object = json::parse(output, nullptr, false);
+	if (!object.is_object() || !object.contains("stats") || !object["stats"].is_object())
+	{
+		return std::nullopt;
+	}
+	return compiler_launcher_stats{
+		.hits = get_sccache_count(object["stats"], "cache_hits"),
+		.misses = get_sccache_count(object["stats"], "cache_misses"),
+	};
+}
+
+std::optional<compiler_launcher_stats> get_compiler_launcher_stats(fs::path const &launcher)
+{
+	auto const name = launcher.stem().generic_string();
+	// checked first, because 'sccache' also contains 'ccache'
+	if (name.find("sccache") != std::string::npos)
+	{
+		return get_sccache_stats(launcher);
+	}
+	else if (name.find("ccache") != std::string::npos)
+	{
+		return get_ccache_stats(launcher);
+	}
+	else
+	{
+		return std::nullopt;
+	}
+}
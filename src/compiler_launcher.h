@@ -0,0 +1,17 @@
+#ifndef COMPILER_LAUNCHER_H
+#define COMPILER_LAUNCHER_H
+
+#include "core.h"
+
+// cache statistics of a compiler launcher; these are global for the launcher's cache,
+// so compilations run by other builds at the same time are counted too
+struct compiler_launcher_stats
+{
+	std::uint64_t hits   = 0;
+	std::uint64_t misses = 0;
+};
+
+// only ccache and sccache are known, std::nullopt for other launchers or if the statistics can't be read
+std::optional<compiler_launcher_stats> get_compiler_launcher_stats(fs::path const &launcher);
+
+#endif // COMPILER_LAUNCHER_H
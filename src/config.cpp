@@ -1,5 +1,7 @@
 #include "config.h"
 #include "process.h"
+#include "cache.h"
+#include "remote_cache.h"
 #include <filesystem>
 #include <fstream>
 #include <nlohmann/json.hpp>
@@ -292,6 +294,10 @@ fill_config_member<&config::member, &config_is_set::member>(object, #member, con
 	if (!error.empty()) { return; }
 	fill_regular_config_member(cpp_compiler_path);
 	if (!error.empty()) { return; }
+	fill_regular_config_member(c_compiler_launcher);
+	if (!error.empty()) { return; }
+	fill_regular_config_member(cpp_compiler_launcher);
+	if (!error.empty()) { return; }
 	fill_regular_config_member(c_standard);
 	if (!error.empty()) { return; }
 	fill_regular_config_member(cpp_standard);
@@ -347,6 +353,17 @@ fill_config_member<&config::member, &config_is_set::member>(object, #member, con
 	if (!error.empty()) { return; }
 	fill_regular_config_member(emit_compile_commands);
 	if (!error.empty()) { return; }
+	fill_regular_config_member(token_fingerprints);
+	if (!error.empty()) { return; }
+	fill_regular_config_member(unity_build);
+	if (!error.empty()) { return; }
+	fill_regular_config_member(unity_batch_size);
+	if (!error.empty()) { return; }
+	if (config_is_set.unity_batch_size && !parse_cache_size(config.unity_batch_size).has_value())
+	{
+		error = fmt::format("invalid value '{}' for member 'unity_batch_size' in configuration file", config.unity_batch_size);
+		return;
+	}
 
 #undef fill_regular_config_member
 #undef fill_array_config_member
@@ -374,6 +391,8 @@ do { if (!values_is_set.member) { values.member = source_values.member; } } whil
 	if (!values_is_set.compiler) { values.compiler_version = source_values.compiler_version; }
 	fill_default_value(c_compiler_path);
 	fill_default_value(cpp_compiler_path);
+	fill_default_value(c_compiler_launcher);
+	fill_default_value(cpp_compiler_launcher);
 	fill_default_value(c_standard);
 	fill_default_value(cpp_standard);
 
@@ -407,6 +426,9 @@ do { if (!values_is_set.member) { values.member = source_values.member; } } whil
 
 	fill_default_value(optimization);
 	fill_default_value(emit_compile_commands);
+	fill_default_value(token_fingerprints);
+	fill_default_value(unity_build);
+	fill_default_value(unity_batch_size);
 
 #undef fill_default_value
 }
@@ -935,6 +957,37 @@ config_file read_config_json(fs::path const &dep_file_path, std::string &error)
 		return {};
 	}
 
+	if (auto const max_cache_size_it = object.find("max_cache_size"); max_cache_size_it != object.end())
+	{
+		if (!max_cache_size_it.value().is_string())
+		{
+			error = "value of member 'max_cache_size' in configuration file must be a 'String'";
+			return {};
+		}
+		auto const max_cache_size = max_cache_size_it.value().get<std::string_view>();
+		result.max_cache_size = parse_cache_size(max_cache_size);
+		if (!result.max_cache_size.has_value())
+		{
+			error = fmt::format("invalid value '{}' for member 'max_cache_size' in configuration file", max_cache_size);
+			return {};
+		}
+	}
+
+	if (auto const remote_cache_it = object.find("remote_cache"); remote_cache_it != object.end())
+	{
+		if (!remote_cache_it.value().is_string())
+		{
+			error = "value of member 'remote_cache' in configuration file must be a 'String'";
+			return {};
+		}
+		result.remote_cache = remote_cache_it.value().get<std::string>();
+		if (!parse_remote_cache_url(result.remote_cache).has_value())
+		{
+			error = fmt::format("invalid value '{}' for member 'remote_cache' in configuration file, expected 'http://<host>[:<port>][/<path>]'", result.remote_cache);
+			return {};
+		}
+	}
+
 	auto const rules_object_it = object.find("rules");
 	if (rules_object_it == object.end())
 	{
@@ -1019,6 +1072,21 @@ std::optional<output_file_info> read_output_file_info_json(fs::path const &file_
 
 	result.hash = hash_it.value().get<std::string>();
 
+	// 'logical_write_time' is optional, because older versions didn't write it
+	auto const logical_write_time_it = object.find("logical_write_time");
+	if (logical_write_time_it != object.end() && logical_write_time_it.value().is_number_integer())
+	{
+		result.logical_write_time = fs::file_time_type(
+			fs::file_time_type::duration(logical_write_time_it.value().get<fs::file_time_type::rep>())
+		);
+	}
+
+	auto const token_fingerprint_it = object.find("token_fingerprint");
+	if (token_fingerprint_it != object.end() && token_fingerprint_it.value().is_string())
+	{
+		result.token_fingerprint = token_fingerprint_it.value().get<std::string>();
+	}
+
 	return std::move(result);
 }
 
@@ -1026,7 +1094,9 @@ void write_output_file_info_json(
 	fs::path const &file_info_json,
 	std::string_view compiler,
 	cppb::span<std::string const> args,
-	std::string_view hash
+	std::string_view hash,
+	fs::file_time_type logical_write_time,
+	std::string_view token_fingerprint
 )
 {
 	auto object = json::object();
@@ -1041,6 +1111,11 @@ void write_output_file_info_json(
 	object["args"] = std::move(args_json);
 
 	object["hash"] = hash;
+	object["logical_write_time"] = logical_write_time.time_since_epoch().count();
+	if (!token_fingerprint.empty())
+	{
+		object["token_fingerprint"] = token_fingerprint;
+	}
 
 	fs::create_directories(file_info_json.parent_path());
 	auto output_file = std::ofstream(file_info_json);
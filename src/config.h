@@ -14,6 +14,9 @@ struct config
 	int compiler_version = -1;
 	fs::path c_compiler_path;
 	fs::path cpp_compiler_path;
+	// e.g. ccache or sccache, which is run with the compiler and its arguments; empty if there's none
+	fs::path c_compiler_launcher;
+	fs::path cpp_compiler_launcher;
 	std::string c_standard;
 	std::string cpp_standard;
 
@@ -47,6 +50,10 @@ struct config
 
 	std::string optimization;
 	bool emit_compile_commands = false;
+	bool token_fingerprints    = false;
+	bool unity_build           = false;
+	// the maximum total size of the sources in a unity batch, e.g. 256K; empty for the default
+	std::string unity_batch_size;
 };
 
 struct config_is_set
@@ -54,6 +61,8 @@ struct config_is_set
 	bool compiler          = false;
 	bool c_compiler_path   = false;
 	bool cpp_compiler_path = false;
+	bool c_compiler_launcher   = false;
+	bool cpp_compiler_launcher = false;
 	bool c_standard        = false;
 	bool cpp_standard      = false;
 
@@ -87,6 +96,9 @@ struct config_is_set
 
 	bool optimization          = false;
 	bool emit_compile_commands = false;
+	bool token_fingerprints    = false;
+	bool unity_build           = false;
+	bool unity_batch_size      = false;
 };
 
 struct project_config
@@ -122,8 +134,10 @@ struct rule
 
 struct config_file
 {
-	cppb::vector<project_config> projects{};
-	cppb::vector<rule>           rules{};
+	cppb::vector<project_config>  projects{};
+	cppb::vector<rule>            rules{};
+	std::optional<std::uintmax_t> max_cache_size{};
+	std::string                   remote_cache{};
 };
 
 struct output_file_info
@@ -131,11 +145,22 @@ struct output_file_info
 	std::string compiler;
 	cppb::vector<std::string> args;
 	std::string hash;
+	// the last time the contents of the output file actually changed
+	std::optional<fs::file_time_type> logical_write_time;
+	// hash of the token fingerprints of the dependency closure, empty if 'token_fingerprints' is disabled
+	std::string token_fingerprint;
 };
 
 config_file read_config_json(fs::path const &config_file_path, std::string &error);
 std::optional<output_file_info> read_output_file_info_json(fs::path const &file_info_json);
-void write_output_file_info_json(fs::path const &file_info_json, std::string_view compiler, cppb::span<std::string const> args, std::string_view hash);
+void write_output_file_info_json(
+	fs::path const &file_info_json,
+	std::string_view compiler,
+	cppb::span<std::string const> args,
+	std::string_view hash,
+	fs::file_time_type logical_write_time,
+	std::string_view token_fingerprint
+);
 void add_c_compiler_flags(cppb::vector<std::string> &args, config const &config);
 void add_cpp_compiler_flags(cppb::vector<std::string> &args, config const &config);
 void add_link_flags(cppb::vector<std::string> &args, config const &config);
@@ -0,0 +1,286 @@
+#include "diagnostics.h"
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+cppb::vector<std::string> get_structured_diagnostics_flags(compiler_kind compiler, int compiler_version)
+{
+	cppb::vector<std::string> result;
+	switch (compiler)
+	{
+	case compiler_kind::gcc:
+		// added in gcc 9
+		if (compiler_version == -1 || compiler_version >= 9)
+		{
+			result.emplace_back("-fdiagnostics-format=json");
+		}
+		break;
+	case compiler_kind::clang:
+		// added in clang 15, which warns that the format may still change
+		if (compiler_version == -1 || compiler_version >= 15)
+		{
+			result.emplace_back("-fdiagnostics-format=sarif");
+			result.emplace_back("-Wno-sarif-format-unstable");
+		}
+		break;
+	}
+	return result;
+}
+
+static std::string get_string(json const &object, char const *key)
+{
+	if (auto const it = object.find(key); it != object.end() && it.value().is_string())
+	{
+		return it.value().get<std::string>();
+	}
+	return "";
+}
+
+static std::uint32_t get_uint(json const &object, char const *key)
+{
+	if (auto const it = object.find(key); it != object.end() && it.value().is_number_unsigned())
+	{
+		return it.value().get<std::uint32_t>();
+	}
+	return 0;
+}
+
+static bool is_error_kind(std::string_view kind)
+{
+	// gcc also has 'fatal error', 'internal compiler error' and 'sorry, unimplemented'
+	return kind.find("error") != std::string_view::npos || kind.starts_with("sorry");
+}
+
+// gcc: an array of diagnostics, each with a 'kind', a 'message', 'locations' and 'children'
+static std::optional<diagnostic> parse_gcc_diagnostic(json const &value)
+{
+	if (!value.is_object() || !value.contains("kind") || !value.contains("message"))
+	{
+		return std::nullopt;
+	}
+
+	auto result = diagnostic{
+		.kind = get_string(value, "kind"),
+		.file = "",
+		.line = 0,
+		.column = 0,
+		.message = get_string(value, "message"),
+		.option = get_string(value, "option"),
+		.children = {},
+	};
+	if (auto const locations_it = value.find("locations"); locations_it != value.end() && locations_it.value().is_array())
+	{
+		auto const &locations = locations_it.value();
+		if (!locations.empty() && locations[0].is_object() && locations[0].contains("caret") && locations[0]["caret"].is_object())
+		{
+			auto const &caret = locations[0]["caret"];
+			result.file = get_string(caret, "file");
+			result.line = get_uint(caret, "line");
+			result.column = get_uint(caret, "column");
+		}
+	}
+	if (auto const children_it = value.find("children"); children_it != value.end() && children_it.value().is_array())
+	{
+		for (auto const &child_value : children_it.value())
+		{
+			if (auto child = parse_gcc_diagnostic(child_value))
+			{
+				result.children.push_back(std::move(*child));
+			}
+		}
+	}
+	return result;
+}
+
+static std::optional<cppb::vector<diagnostic>> parse_gcc_diagnostics(json const &document)
+{
+	if (!document.is_array())
+	{
+		return std::nullopt;
+	}
+	cppb::vector<diagnostic> result;
+	for (auto const &value : document)
+	{
+		auto diag = parse_gcc_diagnostic(value);
+		if (!diag.has_value())
+		{
+			return std::nullopt;
+		}
+		result.push_back(std::move(*diag));
+	}
+	return result;
+}
+
+static int get_hex_digit_value(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	else if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	else if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// 'file:///path/to/file' -> '/path/to/file'
+static std::string get_file_path_from_uri(std::string_view uri)
+{
+	if (uri.starts_with("file://"))
+	{
+		uri.remove_prefix(std::string_view("file://").size());
+	}
+	std::string result;
+	result.reserve(uri.size());
+	for (std::size_t i = 0; i < uri.size(); ++i)
+	{
+		if (uri[i] == '%' && i + 2 < uri.size())
+		{
+			auto const high = get_hex_digit_value(uri[i + 1]);
+			auto const low = get_hex_digit_value(uri[i + 2]);
+			if (high != -1 && low != -1)
+			{
+				result += static_cast<char>(high * 16 + low);
+				i += 2;
+				continue;
+			}
+		}
+		result += uri[i];
+	}
+	return result;
+}
+
+// clang: a SARIF log with one run, every diagnostic including notes is a separate result
+static std::optional<cppb::vector<diagnostic>> parse_sarif_diagnostics(json const &document)
+{
+	if (!document.is_object() || !document.contains("runs") || !document["runs"].is_array())
+	{
+		return std::nullopt;
+	}
+	cppb::vector<diagnostic> result;
+	for (auto const &run : document["runs"])
+	{
+		if (!run.is_object() || !run.contains("results") || !run["results"].is_array())
+		{
+			continue;
+		}
+		for (auto const &value : run["results"])
+		{
+			if (!value.is_object())
+			{
+				return std::nullopt;
+			}
+
+			auto diag = diagnostic{
+				.kind = get_string(value, "level"),
+				.file = "",
+				.line = 0,
+				.column = 0,
+				.message = value.contains("message") && value["message"].is_object() ? get_string(value["message"], "text") : "",
+				.option = "",
+				.children = {},
+			};
+			if (auto const locations_it = value.find("locations"); locations_it != value.end() && locations_it.value().is_array())
+			{
+				auto const &locations = locations_it.value();
+				if (!locations.empty() && locations[0].is_object() && locations[0].contains("physicalLocation"))
+				{
+					auto const &physical_location = locations[0]["physicalLocation"];
+					if (physical_location.is_object() && physical_location.contains("artifactLocation") && physical_location["artifactLocation"].is_object())
+					{
+						diag.file = get_file_path_from_uri(get_string(physical_location["artifactLocation"], "uri"));
+					}
+					if (physical_location.is_object() && physical_location.contains("region") && physical_location["region"].is_object())
+					{
+						diag.line = get_uint(physical_location["region"], "startLine");
+						diag.column = get_uint(physical_location["region"], "startColumn");
+					}
+				}
+			}
+			result.push_back(std::move(diag));
+		}
+	}
+	return result;
+}
+
+std::optional<structured_diagnostics> parse_structured_diagnostics(compiler_kind compiler, std::string_view output)
+{
+	auto const document = json::parse(output, nullptr, false);
+	if (document.is_discarded())
+	{
+		return std::nullopt;
+	}
+
+	auto diagnostics = [&]() {
+		switch (compiler)
+		{
+		case compiler_kind::gcc:
+			return parse_gcc_diagnostics(document);
+		case compiler_kind::clang:
+			return parse_sarif_diagnostics(document);
+		}
+		return std::optional<cppb::vector<diagnostic>>();
+	}();
+	if (!diagnostics.has_value())
+	{
+		return std::nullopt;
+	}
+
+	auto result = structured_diagnostics{
+		.diagnostics = std::move(*diagnostics),
+		.error_count = 0,
+		.warning_count = 0,
+	};
+	for (auto const &diag : result.diagnostics)
+	{
+		if (is_error_kind(diag.kind))
+		{
+			result.error_count += 1;
+		}
+		else if (diag.kind == "warning")
+		{
+			result.warning_count += 1;
+		}
+	}
+	return result;
+}
+
+static void format_diagnostic(std::string &buffer, diagnostic const &diag)
+{
+	if (!diag.file.empty())
+	{
+		buffer += diag.file;
+		if (diag.line != 0)
+		{
+			buffer += fmt::format(":{}", diag.line);
+			if (diag.column != 0)
+			{
+				buffer += fmt::format(":{}", diag.column);
+			}
+		}
+		buffer += ": ";
+	}
+	buffer += fmt::format("{}: {}", diag.kind, diag.message);
+	if (!diag.option.empty())
+	{
+		buffer += fmt::format(" [{}]", diag.option);
+	}
+	buffer += '\n';
+
+	for (auto const &child : diag.children)
+	{
+		format_diagnostic(buffer, child);
+	}
+}
+
+std::string format_diagnostic(diagnostic const &diag)
+{
+	std::string result;
+	format_diagnostic(result, diag);
+	return result;
+}
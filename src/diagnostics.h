@@ -0,0 +1,37 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "core.h"
+#include "config.h"
+
+// a compiler message read from the JSON output of gcc or the SARIF output of clang
+struct diagnostic
+{
+	std::string kind; // error, fatal error, warning, note, ...
+	std::string file; // empty if the message has no location
+	std::uint32_t line = 0;
+	std::uint32_t column = 0;
+	std::string message;
+	std::string option; // e.g. -Wunused-variable, empty if it's unknown
+	cppb::vector<diagnostic> children;
+};
+
+struct structured_diagnostics
+{
+	cppb::vector<diagnostic> diagnostics;
+	int error_count = 0;
+	int warning_count = 0;
+};
+
+// the compiler flags that make the compiler write its diagnostics in a machine readable format to stderr;
+// empty if the compiler version is known to be too old for it
+cppb::vector<std::string> get_structured_diagnostics_flags(compiler_kind compiler, int compiler_version);
+
+// std::nullopt if 'output' isn't in the format requested by get_structured_diagnostics_flags,
+// e.g. because the compiler crashed
+std::optional<structured_diagnostics> parse_structured_diagnostics(compiler_kind compiler, std::string_view output);
+
+// formats the diagnostic and its children like gcc and clang do, without the source lines
+std::string format_diagnostic(diagnostic const &diag);
+
+#endif // DIAGNOSTICS_H
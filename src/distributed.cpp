@@ -0,0 +1,549 @@
+#include "distributed.h"
+#include "compiler_identity.h"
+#include "http.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <semaphore>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// a compilation can take much longer than a cache request
+static constexpr int compile_timeout_seconds = 600;
+
+std::optional<worker_address> parse_worker_address(std::string_view address)
+{
+	auto const port_begin = address.rfind(':');
+	if (port_begin == std::string_view::npos)
+	{
+		return std::nullopt;
+	}
+	auto const host = address.substr(0, port_begin);
+	auto const port = address.substr(port_begin + 1);
+	if (host.empty() || !parse_decimal(port).has_value())
+	{
+		return std::nullopt;
+	}
+	return worker_address{
+		.host = std::string(host),
+		.port = std::string(port),
+	};
+}
+
+static std::optional<std::string> read_file(fs::path const &file)
+{
+	std::ifstream input(file, std::ios::binary);
+	if (!input.is_open())
+	{
+		return std::nullopt;
+	}
+	return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+static bool write_file(fs::path const &file, std::string_view data)
+{
+	std::ofstream output(file, std::ios::binary | std::ios::trunc);
+	output.write(data.data(), static_cast<std::streamsize>(data.size()));
+	return output.good();
+}
+
+// the flags of a compiler command line without the input and output files;
+// the preprocessed source has to contain the declarations of the pre-compiled header, so '-include-pch' is
+// replaced with '-include <pch_header>'; std::nullopt if there's a pre-compiled header, but 'pch_header' is empty
+static std::optional<cppb::vector<std::string>> get_compiler_flags(
+	cppb::vector<std::string> const &args,
+	fs::path const &input_file,
+	fs::path const &pch_header
+)
+{
+	auto const input_file_name = input_file.generic_string();
+	cppb::vector<std::string> result;
+	for (std::size_t i = 0; i < args.size(); ++i)
+	{
+		if (args[i] == "-o")
+		{
+			i += 1;
+		}
+		else if (args[i] == "-include-pch")
+		{
+			if (pch_header.empty())
+			{
+				return std::nullopt;
+			}
+			result.push_back("-include");
+			result.push_back(pch_header.generic_string());
+			i += 1;
+		}
+		else if (args[i] != input_file_name)
+		{
+			result.push_back(args[i]);
+		}
+	}
+	return result;
+}
+
+// options that only affect the preprocessor, and that take their value in the next argument if it's not joined
+static constexpr std::array preprocessor_options = {
+	std::string_view("-I"), std::string_view("-D"), std::string_view("-U"),
+	std::string_view("-isystem"), std::string_view("-iquote"), std::string_view("-idirafter"),
+	std::string_view("-include"), std::string_view("-imacros"),
+};
+
+// the flags sent to a worker, which compiles the source after it was preprocessed locally
+static cppb::vector<std::string> get_worker_flags(cppb::vector<std::string> const &flags)
+{
+	cppb::vector<std::string> result;
+	for (std::size_t i = 0; i < flags.size(); ++i)
+	{
+		auto const &flag = flags[i];
+		auto const option_it = std::find_if(
+			preprocessor_options.begin(), preprocessor_options.end(),
+			[&](auto const option) { return flag.starts_with(option); }
+		);
+		if (option_it == preprocessor_options.end())
+		{
+			result.push_back(flag);
+		}
+		else if (flag == *option_it)
+		{
+			i += 1;
+		}
+	}
+	return result;
+}
+
+bool is_allowed_worker_arg(std::string_view arg)
+{
+	// an allow list, because gcc and clang have too many options that run other programs or access files to
+	// list them all; '-W' and '-f' options are allowed, except for these
+	static constexpr std::array denied_prefixes = {
+		// pass options to the assembler, the linker or the preprocessor, e.g. '-Wa,-o,<file>'
+		std::string_view("-Wa,"), std::string_view("-Wl,"), std::string_view("-Wp,"),
+		// load plugins
+		std::string_view("-fplugin"), std::string_view("-fpass-plugin"),
+		// read or write files at a given path
+		std::string_view("-fdump-"), std::string_view("-fprofile-"), std::string_view("-fauto-profile"),
+		std::string_view("-fsanitize-blacklist"), std::string_view("-fsanitize-ignorelist"),
+		std::string_view("-fcoverage-"), std::string_view("-fmodule"), std::string_view("-fcallgraph-info"),
+		std::string_view("-fsave-optimization-record"), std::string_view("-fstack-usage"),
+	};
+	static constexpr std::array allowed_prefixes = {
+		std::string_view("-std="), std::string_view("-O"), std::string_view("-W"), std::string_view("-w"),
+		std::string_view("-f"), std::string_view("-m"), std::string_view("-pedantic"),
+	};
+	static constexpr std::array allowed_args = {
+		std::string_view("-c"), std::string_view("-g"), std::string_view("-g0"), std::string_view("-g1"),
+		std::string_view("-g2"), std::string_view("-g3"), std::string_view("-ggdb"), std::string_view("-ansi"),
+		std::string_view("-pipe"),
+	};
+
+	auto const has_prefix = [arg](std::string_view prefix) { return arg.starts_with(prefix); };
+	if (std::any_of(denied_prefixes.begin(), denied_prefixes.end(), has_prefix))
+	{
+		return false;
+	}
+	return std::any_of(allowed_prefixes.begin(), allowed_prefixes.end(), has_prefix)
+		|| std::find(allowed_args.begin(), allowed_args.end(), arg) != allowed_args.end();
+}
+
+distributed_compiler::distributed_compiler(cppb::vector<worker_address> const &workers, std::size_t local_slot_count)
+	: _mutex(),
+	  _slot_released(),
+	  _workers(),
+	  _local_slot_count(local_slot_count),
+	  _used_local_slot_count(0),
+	  _remote_compile_count(0),
+	  _local_retry_count(0)
+{
+	for (auto const &address : workers)
+	{
+		// '{ "slots": <count>, "compilers": { "<name>": "<identity>", ... } }'
+		auto const response = send_http_request(address.host, address.port, "GET", "/info", "");
+		auto const info = response.has_value() && response->status == 200
+			? json::parse(response->body, nullptr, false)
+			: json();
+		if (
+			!info.is_object()
+			|| !info.contains("slots") || !info["slots"].is_number_unsigned() || info["slots"].get<std::size_t>() == 0
+			|| !info.contains("compilers") || !info["compilers"].is_object()
+		)
+		{
+			fmt::print(stderr, "cppb: warning: worker '{}:{}' isn't available\n", address.host, address.port);
+			continue;
+		}
+
+		auto compilers = std::unordered_map<std::string, std::string>();
+		for (auto const &[name, identity] : info["compilers"].items())
+		{
+			if (identity.is_string() && !identity.get<std::string>().empty())
+			{
+				compilers.insert({ identity.get<std::string>(), name });
+			}
+		}
+		this->_workers.push_back(worker_t{
+			.address = address,
+			.slot_count = info["slots"].get<std::size_t>(),
+			.used_slot_count = 0,
+			.compilers = std::move(compilers),
+			.is_available = true,
+		});
+	}
+}
+
+std::size_t distributed_compiler::remote_slot_count(void) const
+{
+	auto const guard = std::lock_guard(this->_mutex);
+	return this->_workers
+		.filter([](auto const &worker) { return worker.is_available; })
+		.transform([](auto const &worker) { return worker.slot_count; })
+		.sum();
+}
+
+std::size_t distributed_compiler::remote_compile_count(void) const
+{
+	auto const guard = std::lock_guard(this->_mutex);
+	return this->_remote_compile_count;
+}
+
+std::size_t distributed_compiler::local_retry_count(void) const
+{
+	auto const guard = std::lock_guard(this->_mutex);
+	return this->_local_retry_count;
+}
+
+std::optional<std::size_t> distributed_compiler::acquire_slot(std::string_view compiler_identity)
+{
+	auto lock = std::unique_lock(this->_mutex);
+	std::optional<std::size_t> result;
+	this->_slot_released.wait(lock, [&]() {
+		// local slots are preferred, because a remote compilation also needs the local preprocessor
+		if (this->_used_local_slot_count < this->_local_slot_count)
+		{
+			this->_used_local_slot_count += 1;
+			result = std::nullopt;
+			return true;
+		}
+
+		auto best_worker = this->_workers.size();
+		for (std::size_t i = 0; i < this->_workers.size(); ++i)
+		{
+			auto const &worker = this->_workers[i];
+			if (
+				!worker.is_available || worker.used_slot_count == worker.slot_count
+				|| compiler_identity.empty() || !worker.compilers.contains(std::string(compiler_identity))
+			)
+			{
+				continue;
+			}
+			auto const free_slot_count = worker.slot_count - worker.used_slot_count;
+			if (
+				best_worker == this->_workers.size()
+				|| free_slot_count > this->_workers[best_worker].slot_count - this->_workers[best_worker].used_slot_count
+			)
+			{
+				best_worker = i;
+			}
+		}
+		if (best_worker == this->_workers.size())
+		{
+			return false;
+		}
+		this->_workers[best_worker].used_slot_count += 1;
+		result = best_worker;
+		return true;
+	});
+	return result;
+}
+
+void distributed_compiler::release_slot(std::optional<std::size_t> worker_index)
+{
+	{
+		auto const guard = std::lock_guard(this->_mutex);
+		if (worker_index.has_value())
+		{
+			this->_workers[*worker_index].used_slot_count -= 1;
+		}
+		else
+		{
+			this->_used_local_slot_count -= 1;
+		}
+	}
+	this->_slot_released.notify_all();
+}
+
+static void acquire_job_token(jobserver *shared_jobserver)
+{
+	if (shared_jobserver != nullptr)
+	{
+		shared_jobserver->acquire();
+	}
+}
+
+static void release_job_token(jobserver *shared_jobserver)
+{
+	if (shared_jobserver != nullptr)
+	{
+		shared_jobserver->release();
+	}
+}
+
+process_result distributed_compiler::compile(
+	std::string_view compiler,
+	cppb::vector<std::string> const &args,
+	fs::path const &input_file,
+	fs::path const &output_file,
+	fs::path const &pch_header,
+	bool capture,
+	jobserver *shared_jobserver
+)
+{
+	// objects from a different compiler version or target can't be mixed with local ones,
+	// and options that a worker rejects are only used locally
+	auto const flags = get_compiler_flags(args, input_file, pch_header);
+	auto const is_remote_allowed = flags.has_value() && get_worker_flags(*flags)
+		.is_all([](auto const &flag) { return is_allowed_worker_arg(flag); });
+	auto const compiler_identity = is_remote_allowed ? get_compiler_identity(compiler) : std::string();
+
+	// the caller's job token is given back while it waits for a slot, otherwise the nodes that hold the tokens
+	// would take every local slot and the workers would never be used; the caller holds a token again on return
+	release_job_token(shared_jobserver);
+	auto const worker_index = this->acquire_slot(compiler_identity);
+	if (worker_index.has_value())
+	{
+		auto result = this->compile_on_worker(*worker_index, compiler, compiler_identity, *flags, input_file, output_file, shared_jobserver);
+		this->release_slot(worker_index);
+		if (result.has_value())
+		{
+			acquire_job_token(shared_jobserver);
+			return std::move(*result);
+		}
+
+		// retried with a local slot
+		auto lock = std::unique_lock(this->_mutex);
+		this->_local_retry_count += 1;
+		this->_slot_released.wait(lock, [&]() { return this->_used_local_slot_count < this->_local_slot_count; });
+		this->_used_local_slot_count += 1;
+	}
+
+	acquire_job_token(shared_jobserver);
+	auto result = run_command(compiler, args, capture);
+	this->release_slot(std::nullopt);
+	return result;
+}
+
+std::optional<process_result> distributed_compiler::compile_on_worker(
+	std::size_t worker_index,
+	std::string_view compiler,
+	std::string_view compiler_identity,
+	cppb::vector<std::string> const &flags,
+	fs::path const &input_file,
+	fs::path const &output_file,
+	jobserver *shared_jobserver
+)
+{
+	auto preprocess_args = flags;
+	preprocess_args.emplace_back("-E");
+	preprocess_args.push_back(input_file.generic_string());
+	// preprocessing is the only part that runs locally
+	acquire_job_token(shared_jobserver);
+	auto preprocessed = run_command(compiler, preprocess_args, true);
+	release_job_token(shared_jobserver);
+	if (preprocessed.exit_code != 0 || preprocessed.was_terminated)
+	{
+		return std::nullopt;
+	}
+
+	auto const [address, worker_compiler] = [&]() {
+		auto const guard = std::lock_guard(this->_mutex);
+		auto const &worker = this->_workers[worker_index];
+		return std::make_pair(worker.address, worker.compilers.at(std::string(compiler_identity)));
+	}();
+
+	auto request_head = json::object();
+	request_head["compiler"] = worker_compiler;
+	request_head["args"] = get_worker_flags(flags);
+	request_head["language"] = input_file.extension() == ".c" ? "c" : "c++";
+	auto request_body = request_head.dump();
+	request_body += '\n';
+	request_body += preprocessed.stdout_string;
+	// the preprocessed source can be large, so it's freed before waiting for the worker
+	preprocessed.stdout_string = std::string();
+
+	auto const response = send_http_request(
+		address.host, address.port, "POST", "/compile", request_body, compile_timeout_seconds
+	);
+	if (!response.has_value() || response->status != 200)
+	{
+		auto const guard = std::lock_guard(this->_mutex);
+		if (this->_workers[worker_index].is_available)
+		{
+			this->_workers[worker_index].is_available = false;
+			fmt::print(stderr, "cppb: warning: worker '{}:{}' failed, it won't be used for the rest of the build\n", address.host, address.port);
+		}
+		return std::nullopt;
+	}
+
+	auto const head_end = response->body.find('\n');
+	if (head_end == std::string::npos)
+	{
+		return std::nullopt;
+	}
+	auto const response_head = json::parse(std::string_view(response->body).substr(0, head_end), nullptr, false);
+	if (
+		!response_head.is_object()
+		|| !response_head.contains("exit_code") || !response_head["exit_code"].is_number_integer()
+		|| response_head["exit_code"].get<int>() != 0
+	)
+	{
+		return std::nullopt;
+	}
+
+	if (!write_file(output_file, std::string_view(response->body).substr(head_end + 1)))
+	{
+		return std::nullopt;
+	}
+
+	auto result = process_result{};
+	result.error_count = response_head.value("error_count", 0);
+	result.warning_count = response_head.value("warning_count", 0);
+	result.stdout_string = response_head.value("stdout", "");
+	result.stderr_string = response_head.value("stderr", "");
+
+	auto const guard = std::lock_guard(this->_mutex);
+	this->_remote_compile_count += 1;
+	return result;
+}
+
+static http_response handle_compile_request(
+	http_request const &request,
+	fs::path const &directory,
+	std::unordered_map<std::string, std::string> const &compilers,
+	std::counting_semaphore<> &slots
+)
+{
+	auto const head_end = request.body.find('\n');
+	if (head_end == std::string::npos)
+	{
+		return { 400, "" };
+	}
+	auto const head = json::parse(std::string_view(request.body).substr(0, head_end), nullptr, false);
+	if (
+		!head.is_object()
+		|| !head.contains("compiler") || !head["compiler"].is_string()
+		|| !head.contains("args") || !head["args"].is_array()
+		|| !head.contains("language") || !head["language"].is_string()
+	)
+	{
+		return { 400, "" };
+	}
+	// anyone who can connect to the worker can send a request, so only the configured compilers can be run,
+	// and only with options that don't run other programs or access other files
+	if (!compilers.contains(head["compiler"].get<std::string>()))
+	{
+		return { 403, "" };
+	}
+	auto args = cppb::vector<std::string>();
+	for (auto const &arg : head["args"])
+	{
+		if (!arg.is_string())
+		{
+			return { 400, "" };
+		}
+		if (!is_allowed_worker_arg(arg.get<std::string>()))
+		{
+			return { 403, "" };
+		}
+		args.push_back(arg.get<std::string>());
+	}
+
+	static std::atomic<std::uint64_t> job_counter = 0;
+	auto const job_id = job_counter.fetch_add(1);
+	// the extension tells the compiler that the source is already preprocessed
+	auto const source_file = directory / fmt::format("job{}.{}", job_id, head["language"] == "c" ? "i" : "ii");
+	auto const object_file = directory / fmt::format("job{}.o", job_id);
+	if (!write_file(source_file, std::string_view(request.body).substr(head_end + 1)))
+	{
+		return { 500, "" };
+	}
+	args.emplace_back("-o");
+	args.push_back(object_file.generic_string());
+	args.push_back(source_file.generic_string());
+
+	slots.acquire();
+	auto const result = run_command(head["compiler"].get<std::string>(), args, true);
+	slots.release();
+
+	auto object = result.exit_code == 0 ? read_file(object_file) : std::nullopt;
+	std::error_code ec;
+	fs::remove(source_file, ec);
+	fs::remove(object_file, ec);
+
+	auto response_head = json::object();
+	response_head["exit_code"] = result.exit_code == 0 && !object.has_value() ? -1 : result.exit_code;
+	response_head["error_count"] = result.error_count;
+	response_head["warning_count"] = result.warning_count;
+	response_head["stdout"] = result.stdout_string;
+	response_head["stderr"] = result.stderr_string;
+	auto body = response_head.dump();
+	body += '\n';
+	if (object.has_value())
+	{
+		body += *object;
+	}
+	return { 200, std::move(body) };
+}
+
+int run_worker(std::string_view host, std::uint16_t port, std::size_t slot_count, cppb::vector<std::string> const &compilers)
+{
+	// compilers that can't be run aren't offered to clients
+	auto compiler_identities = std::unordered_map<std::string, std::string>();
+	for (auto const &compiler : compilers)
+	{
+		if (auto identity = get_compiler_identity(compiler); !identity.empty())
+		{
+			compiler_identities.insert({ compiler, std::move(identity) });
+		}
+	}
+	if (compiler_identities.empty())
+	{
+		fmt::print(stderr, "none of the compilers can be run\n");
+		return 1;
+	}
+	auto info = json::object();
+	info["slots"] = slot_count;
+	info["compilers"] = compiler_identities;
+	auto const info_string = info.dump();
+
+	auto const directory = fs::temp_directory_path() / fmt::format("cppb-worker-{}", port);
+	std::error_code ec;
+	fs::create_directories(directory, ec);
+	if (ec)
+	{
+		fmt::print(stderr, "unable to create directory '{}'\n", directory.generic_string());
+		return 1;
+	}
+
+	auto slots = std::counting_semaphore<>(static_cast<std::ptrdiff_t>(slot_count));
+	// a few more threads than slots, so slot count requests are answered while every slot is busy
+	return run_http_server(
+		host, port, slot_count + 4,
+		fmt::format("serving {} compilation slots", slot_count),
+		[&](http_request const &request) -> http_response {
+			if (request.method == "GET" && request.target == "/info")
+			{
+				return { 200, info_string };
+			}
+			else if (request.method == "POST" && request.target == "/compile")
+			{
+				return handle_compile_request(request, directory, compiler_identities, slots);
+			}
+			else
+			{
+				return { 404, "" };
+			}
+		}
+	);
+}
@@ -0,0 +1,97 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "core.h"
+#include "process.h"
+#include "jobserver.h"
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+
+struct worker_address
+{
+	std::string host;
+	std::string port;
+};
+
+// parses a 'host:port' pair
+std::optional<worker_address> parse_worker_address(std::string_view address);
+
+// whether a worker accepts 'arg' in the flags of a compilation; options that load plugins, run other
+// programs or read or write files outside of the worker's job directory are rejected
+bool is_allowed_worker_arg(std::string_view arg);
+
+// Compilations are sent to 'cppb worker' processes when every local slot is in use.  The source is
+// preprocessed locally, so the worker only needs the same compiler, not the headers of the project.
+// Only workers that have a compiler with the same identity as the local one are used for a compilation.
+// A compilation that fails on a worker for any reason, including compiler errors, is retried locally,
+// so the reported diagnostics always come from the local compiler.
+struct distributed_compiler
+{
+	// asks every worker for its slot count and compilers; workers that can't be reached are left out
+	distributed_compiler(cppb::vector<worker_address> const &workers, std::size_t local_slot_count);
+
+	distributed_compiler(distributed_compiler const &other) = delete;
+	distributed_compiler(distributed_compiler &&other) = delete;
+	distributed_compiler &operator = (distributed_compiler const &rhs) = delete;
+	distributed_compiler &operator = (distributed_compiler &&rhs) = delete;
+
+	std::size_t remote_slot_count(void) const;
+	std::size_t remote_compile_count(void) const;
+	std::size_t local_retry_count(void) const;
+
+	// 'args' is a regular compiler command line that contains '-o <output_file> <input_file>';
+	// 'pch_header' is the header that was compiled into the pre-compiled header in 'args', if there's one;
+	// blocks until a local or remote slot is free.  'shared_jobserver' only counts local processes, so the
+	// job token of the caller is only held while a compiler runs on this machine; it may be nullptr
+	process_result compile(
+		std::string_view compiler,
+		cppb::vector<std::string> const &args,
+		fs::path const &input_file,
+		fs::path const &output_file,
+		fs::path const &pch_header,
+		bool capture,
+		jobserver *shared_jobserver
+	);
+
+private:
+	struct worker_t
+	{
+		worker_address address;
+		std::size_t slot_count;
+		std::size_t used_slot_count;
+		// the name of every compiler of the worker by its identity
+		std::unordered_map<std::string, std::string> compilers;
+		// false after a request to the worker failed, it isn't used for the rest of the build
+		bool is_available;
+	};
+
+	// returns the index of the worker, or std::nullopt for a local slot; only workers that have a compiler
+	// with 'compiler_identity' are used, an empty identity means that only a local slot can be used
+	std::optional<std::size_t> acquire_slot(std::string_view compiler_identity);
+	void release_slot(std::optional<std::size_t> worker_index);
+	// 'flags' are the result of 'get_compiler_flags'; std::nullopt if the compilation has to be done locally
+	std::optional<process_result> compile_on_worker(
+		std::size_t worker_index,
+		std::string_view compiler,
+		std::string_view compiler_identity,
+		cppb::vector<std::string> const &flags,
+		fs::path const &input_file,
+		fs::path const &output_file,
+		jobserver *shared_jobserver
+	);
+
+	mutable std::mutex _mutex;
+	std::condition_variable _slot_released;
+	cppb::vector<worker_t> _workers;
+	std::size_t _local_slot_count;
+	std::size_t _used_local_slot_count;
+	std::size_t _remote_compile_count;
+	std::size_t _local_retry_count;
+};
+
+// serves compilation requests of 'distributed_compiler', running at most 'slot_count' compilers at a time;
+// only the compilers in 'compilers' can be run by clients
+int run_worker(std::string_view host, std::uint16_t port, std::size_t slot_count, cppb::vector<std::string> const &compilers);
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,286 @@
+#include "driver_bypass.h"
+#include <algorithm>
+
+// longer command lines are passed in a response file by the build, which is left to the driver
+static constexpr std::size_t max_command_line_length = 8 * 1024;
+
+// the file names used for '-###'; they're replaced by placeholders in the templates
+static constexpr std::string_view probe_input_directory = "cppb-probe-in/";
+static constexpr std::string_view probe_input_stem = "cppb-input";
+static constexpr std::string_view probe_output_directory = "cppb-probe-out/";
+static constexpr std::string_view probe_output_stem = "cppb-output";
+
+// placeholders can't appear in a command line, because they start with a control character
+static constexpr std::string_view input_file_placeholder = "\x01" "I";
+static constexpr std::string_view input_stem_placeholder = "\x01" "i";
+static constexpr std::string_view output_file_placeholder = "\x01" "O";
+static constexpr std::string_view output_directory_placeholder = "\x01" "D";
+static constexpr std::string_view output_stem_placeholder = "\x01" "o";
+static constexpr std::string_view assembly_file_placeholder = "\x01" "S";
+
+static void replace_all(std::string &str, std::string_view from, std::string_view to)
+{
+	for (auto it = str.find(from); it != std::string::npos; it = str.find(from, it + to.size()))
+	{
+		str.replace(it, from.size(), to);
+	}
+}
+
+// splits a command printed by '-###'; gcc only quotes arguments with special characters,
+// clang quotes every argument, and both escape '"' and '\' inside quotes with a backslash
+static cppb::vector<std::string> split_command_line(std::string_view line)
+{
+	cppb::vector<std::string> result;
+	std::size_t i = 0;
+	while (true)
+	{
+		while (i < line.size() && line[i] == ' ')
+		{
+			++i;
+		}
+		if (i == line.size())
+		{
+			break;
+		}
+
+		std::string arg;
+		bool is_quoted = false;
+		for (; i < line.size() && (is_quoted || line[i] != ' '); ++i)
+		{
+			if (line[i] == '"')
+			{
+				is_quoted = !is_quoted;
+			}
+			else if (is_quoted && line[i] == '\\' && i + 1 < line.size())
+			{
+				++i;
+				arg += line[i];
+			}
+			else
+			{
+				arg += line[i];
+			}
+		}
+		result.push_back(std::move(arg));
+	}
+	return result;
+}
+
+std::optional<cppb::vector<driver_bypass::command_template_t>> driver_bypass::get_command_templates(
+	std::string_view compiler,
+	cppb::span<std::string const> flags,
+	std::string_view input_extension
+)
+{
+	auto const probe_input_file = fmt::format("{}{}{}", probe_input_directory, probe_input_stem, input_extension);
+	auto const probe_output_file = fmt::format("{}{}.o", probe_output_directory, probe_output_stem);
+
+	cppb::vector<std::string> probe_args;
+	probe_args.append(flags);
+	probe_args.emplace_back("-###");
+	probe_args.emplace_back("-o");
+	probe_args.push_back(probe_output_file);
+	probe_args.push_back(probe_input_file);
+	auto const probe = run_command(compiler, probe_args, true);
+	if (probe.exit_code != 0)
+	{
+		return std::nullopt;
+	}
+
+	// the commands are the lines that start with a space, other lines are e.g. the version;
+	// clang prints ' (in-process)' before a command that it runs without starting a new process
+	cppb::vector<command_template_t> result;
+	std::string_view output = probe.stderr_string;
+	while (!output.empty())
+	{
+		auto const line_end = output.find('\n');
+		auto const line = output.substr(0, line_end);
+		output.remove_prefix(line_end == std::string_view::npos ? output.size() : line_end + 1);
+		if (!line.starts_with(' ') || line.starts_with(" ("))
+		{
+			continue;
+		}
+
+		auto args = split_command_line(line);
+		if (args.empty())
+		{
+			continue;
+		}
+		auto executable = std::move(args[0]);
+		args.erase(args.begin());
+		result.push_back(command_template_t{
+			.executable = std::move(executable),
+			.args = std::move(args),
+		});
+	}
+
+	auto const is_clang_frontend = result.size() == 1 && !result[0].args.empty() && result[0].args[0] == "-cc1";
+	// gcc compiles to a temporary assembly file, which is assembled by the second command
+	auto const is_gcc_frontend = result.size() == 2
+		&& fs::path(result[0].executable).filename().generic_string().starts_with("cc1")
+		&& fs::path(result[1].executable).filename().generic_string() == "as";
+	if (is_gcc_frontend)
+	{
+		auto &frontend_args = result[0].args;
+		auto const output_it = std::find(frontend_args.begin(), frontend_args.end(), "-o");
+		if (
+			output_it == frontend_args.end() || output_it + 1 == frontend_args.end()
+			|| result[1].args.empty() || result[1].args.back() != *(output_it + 1)
+		)
+		{
+			return std::nullopt;
+		}
+		*(output_it + 1) = assembly_file_placeholder;
+		result[1].args.back() = assembly_file_placeholder;
+	}
+	else if (!is_clang_frontend)
+	{
+		return std::nullopt;
+	}
+
+	bool is_input_used = false;
+	bool is_output_used = false;
+	for (auto &command : result)
+	{
+		for (auto &arg : command.args)
+		{
+			// the longest names first, so their parts aren't replaced separately
+			replace_all(arg, probe_input_file, input_file_placeholder);
+			replace_all(arg, probe_output_file, output_file_placeholder);
+			replace_all(arg, probe_output_directory, output_directory_placeholder);
+			replace_all(arg, probe_input_stem, input_stem_placeholder);
+			replace_all(arg, probe_output_stem, output_stem_placeholder);
+			// any other use of the file names, e.g. an absolute path, is unknown
+			if (arg.find("cppb-probe-") != std::string::npos)
+			{
+				return std::nullopt;
+			}
+			is_input_used |= arg == input_file_placeholder;
+			is_output_used |= arg.find(output_file_placeholder) != std::string::npos;
+		}
+	}
+	if (!is_input_used || !is_output_used)
+	{
+		return std::nullopt;
+	}
+	return result;
+}
+
+std::optional<process_result> driver_bypass::compile(
+	std::string_view compiler,
+	cppb::vector<std::string> const &args,
+	fs::path const &input_file,
+	fs::path const &output_file,
+	bool capture
+)
+{
+	if (args.size() < 3)
+	{
+		return std::nullopt;
+	}
+	auto const flags = cppb::span<std::string const>(args.data(), args.size() - 3);
+	auto const input_extension = input_file.extension().generic_string();
+
+	auto commands = [&]() -> std::optional<cppb::vector<command_template_t>> {
+		auto key = std::string(compiler);
+		for (auto const &flag : flags)
+		{
+			key += '\0';
+			key += flag;
+		}
+		key += '\0';
+		key += input_extension;
+
+		auto probe = std::optional<std::promise<std::optional<cppb::vector<command_template_t>>>>();
+		auto templates = [&]() {
+			auto const guard = std::lock_guard(this->_mutex);
+			auto const it = this->_templates.find(key);
+			if (it != this->_templates.end())
+			{
+				return it->second;
+			}
+			probe.emplace();
+			return this->_templates.insert({ std::move(key), probe->get_future().share() }).first->second;
+		}();
+		if (probe.has_value())
+		{
+			probe->set_value(get_command_templates(compiler, flags, input_extension));
+		}
+
+		auto result = templates.get();
+		if (!result.has_value())
+		{
+			auto const guard = std::lock_guard(this->_mutex);
+			this->_driver_count += 1;
+		}
+		return result;
+	}();
+	if (!commands.has_value())
+	{
+		return std::nullopt;
+	}
+
+	auto assembly_file = output_file;
+	assembly_file += ".s";
+	auto const input_file_name = input_file.generic_string();
+	auto const output_file_name = output_file.generic_string();
+	auto const output_directory = output_file.parent_path().empty() ? std::string() : output_file.parent_path().generic_string() + '/';
+	auto const assembly_file_name = assembly_file.generic_string();
+	std::size_t max_length = 0;
+	for (auto &command : *commands)
+	{
+		auto command_line_length = command.executable.size();
+		for (auto &arg : command.args)
+		{
+			replace_all(arg, input_file_placeholder, input_file_name);
+			replace_all(arg, input_stem_placeholder, input_file.stem().generic_string());
+			replace_all(arg, output_file_placeholder, output_file_name);
+			replace_all(arg, output_directory_placeholder, output_directory);
+			replace_all(arg, output_stem_placeholder, output_file.stem().generic_string());
+			replace_all(arg, assembly_file_placeholder, assembly_file_name);
+			command_line_length += arg.size() + 1;
+		}
+		max_length = std::max(max_length, command_line_length);
+	}
+	if (max_length > max_command_line_length)
+	{
+		auto const guard = std::lock_guard(this->_mutex);
+		this->_driver_count += 1;
+		return std::nullopt;
+	}
+
+	auto result = process_result();
+	for (auto const &command : *commands)
+	{
+		auto command_result = run_command(command.executable, command.args, capture);
+		result.error_count += command_result.error_count;
+		result.warning_count += command_result.warning_count;
+		result.exit_code = command_result.exit_code;
+		result.was_terminated = command_result.was_terminated;
+		add_resource_usage(result.usage, command_result.usage);
+		result.stdout_string += command_result.stdout_string;
+		result.stderr_string += command_result.stderr_string;
+		if (result.exit_code != 0)
+		{
+			break;
+		}
+	}
+	std::error_code ec;
+	fs::remove(assembly_file, ec);
+
+	auto const guard = std::lock_guard(this->_mutex);
+	this->_bypass_count += 1;
+	return result;
+}
+
+std::size_t driver_bypass::bypass_count(void) const
+{
+	auto const guard = std::lock_guard(this->_mutex);
+	return this->_bypass_count;
+}
+
+std::size_t driver_bypass::driver_count(void) const
+{
+	auto const guard = std::lock_guard(this->_mutex);
+	return this->_driver_count;
+}
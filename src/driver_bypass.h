@@ -0,0 +1,60 @@
+#ifndef DRIVER_BYPASS_H
+#define DRIVER_BYPASS_H
+
+#include "core.h"
+#include "process.h"
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+// The compiler driver, e.g. g++, only starts other programs: cc1plus and as for gcc, and clang -cc1 for clang,
+// which clang usually runs in its own process, so it still saves the work of the driver.
+// The commands it would run are printed with '-###', which is done once for every set of flags with
+// placeholder file names; each translation unit then runs the same commands with its own file names.
+// If the printed commands don't have a known form, the driver is used for that set of flags.
+struct driver_bypass
+{
+	driver_bypass(void) = default;
+
+	driver_bypass(driver_bypass const &other) = delete;
+	driver_bypass(driver_bypass &&other) = delete;
+	driver_bypass &operator = (driver_bypass const &rhs) = delete;
+	driver_bypass &operator = (driver_bypass &&rhs) = delete;
+
+	// 'args' is a regular compiler command line that ends with '-o <output_file> <input_file>';
+	// std::nullopt if the driver has to be used
+	std::optional<process_result> compile(
+		std::string_view compiler,
+		cppb::vector<std::string> const &args,
+		fs::path const &input_file,
+		fs::path const &output_file,
+		bool capture
+	);
+
+	std::size_t bypass_count(void) const;
+	std::size_t driver_count(void) const;
+
+private:
+	// an argument template; placeholders are replaced with the file names of a translation unit
+	struct command_template_t
+	{
+		std::string executable;
+		cppb::vector<std::string> args;
+	};
+
+	// std::nullopt if the output of '-###' doesn't have a known form
+	static std::optional<cppb::vector<command_template_t>> get_command_templates(
+		std::string_view compiler,
+		cppb::span<std::string const> flags,
+		std::string_view input_extension
+	);
+
+	mutable std::mutex _mutex;
+	// keyed by the compiler, the flags and the extension of the input file; the first translation unit
+	// with a key runs '-###' without holding the lock, the others with the same key wait for its result
+	std::unordered_map<std::string, std::shared_future<std::optional<cppb::vector<command_template_t>>>> _templates;
+	std::size_t _bypass_count = 0;
+	std::size_t _driver_count = 0;
+};
+
+#endif // DRIVER_BYPASS_H
@@ -0,0 +1,21 @@
+#include "executor.h"
+
+executor::executor(std::size_t cpu_thread_count, std::size_t io_thread_count, std::size_t process_slot_count)
+	: _cpu_pool(cpu_thread_count),
+	  _io_pool(io_thread_count),
+	  _process_pool(process_slot_count)
+{}
+
+thread_pool &executor::get_pool(task_class kind)
+{
+	switch (kind)
+	{
+	case task_class::cpu:
+		return this->_cpu_pool;
+	case task_class::io:
+		return this->_io_pool;
+	case task_class::process:
+		break;
+	}
+	return this->_process_pool;
+}
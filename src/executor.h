@@ -0,0 +1,44 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include "core.h"
+#include "thread_pool.h"
+
+// the kinds of work that run on separate pools, so e.g. hashing files can't hold up starting compilers
+enum class task_class
+{
+	// up-to-date checks and token fingerprints
+	cpu,
+	// dependency scanning, file hashing and remote cache uploads, which mostly wait on the file system or the network
+	io,
+	// build graph nodes, most of which wait for a compiler or linker process
+	process,
+};
+
+// The thread pools used during a build.  There's one executor per cppb process, and every parallel
+// step of the build runs on it, so the number of threads is set once by the command line instead of
+// every step starting its own pool.  Threads are only started when a class is first used.
+// A task must not wait for another task of the same class, because that could take the last thread.
+struct executor
+{
+	executor(std::size_t cpu_thread_count, std::size_t io_thread_count, std::size_t process_slot_count);
+
+	executor(executor const &other) = delete;
+	executor(executor &&other) = delete;
+	executor &operator = (executor const &rhs) = delete;
+	executor &operator = (executor &&rhs) = delete;
+
+	thread_pool &get_pool(task_class kind);
+
+	auto push_task(task_class kind, auto callable)
+	{
+		return this->get_pool(kind).push_task(std::move(callable));
+	}
+
+private:
+	thread_pool _cpu_pool;
+	thread_pool _io_pool;
+	thread_pool _process_pool;
+};
+
+#endif // EXECUTOR_H
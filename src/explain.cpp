@@ -0,0 +1,193 @@
+#include "explain.h"
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+std::string_view to_string(rebuild_reason_kind kind)
+{
+	switch (kind)
+	{
+	case rebuild_reason_kind::up_to_date:
+		return "up_to_date";
+	case rebuild_reason_kind::touch_only:
+		return "touch_only";
+	case rebuild_reason_kind::forced:
+		return "forced";
+	case rebuild_reason_kind::missing_output:
+		return "missing_output";
+	case rebuild_reason_kind::pch_newer:
+		return "pch_newer";
+	case rebuild_reason_kind::input_newer:
+		return "input_newer";
+	case rebuild_reason_kind::missing_output_info:
+		return "missing_output_info";
+	case rebuild_reason_kind::hash_mismatch:
+		return "hash_mismatch";
+	case rebuild_reason_kind::compiler_changed:
+		return "compiler_changed";
+	case rebuild_reason_kind::args_changed:
+		return "args_changed";
+	}
+	return "";
+}
+
+std::string get_args_diff(cppb::span<std::string const> old_args, cppb::span<std::string const> new_args)
+{
+	std::unordered_map<std::string_view, int> arg_counts;
+	for (auto const &arg : old_args)
+	{
+		arg_counts[arg] -= 1;
+	}
+	for (auto const &arg : new_args)
+	{
+		arg_counts[arg] += 1;
+	}
+
+	// keep the order of the command lines in the output
+	std::string removed;
+	for (auto const &arg : old_args)
+	{
+		if (auto &count = arg_counts[arg]; count < 0)
+		{
+			removed += removed.empty() ? fmt::format("'{}'", arg) : fmt::format(", '{}'", arg);
+			count += 1;
+		}
+	}
+	std::string added;
+	for (auto const &arg : new_args)
+	{
+		if (auto &count = arg_counts[arg]; count > 0)
+		{
+			added += added.empty() ? fmt::format("'{}'", arg) : fmt::format(", '{}'", arg);
+			count -= 1;
+		}
+	}
+
+	if (removed.empty() && added.empty())
+	{
+		return "argument order changed";
+	}
+	else if (removed.empty())
+	{
+		return fmt::format("added {}", added);
+	}
+	else if (added.empty())
+	{
+		return fmt::format("removed {}", removed);
+	}
+	else
+	{
+		return fmt::format("removed {}, added {}", removed, added);
+	}
+}
+
+static std::string get_reason_message(explained_output const &output)
+{
+	auto const &[kind, detail] = output.reason;
+	switch (kind)
+	{
+	case rebuild_reason_kind::up_to_date:
+		return "up to date";
+	case rebuild_reason_kind::touch_only:
+		return "up to date, only comments or whitespace changed";
+	case rebuild_reason_kind::forced:
+		return "rebuild was requested with --rebuild";
+	case rebuild_reason_kind::missing_output:
+		return fmt::format("output file {} doesn't exist", output.output_file);
+	case rebuild_reason_kind::pch_newer:
+		return fmt::format("pre-compiled header {} is newer than the output", detail);
+	case rebuild_reason_kind::input_newer:
+		if (output.newer_inputs.size() > 1)
+		{
+			auto const other_count = output.newer_inputs.size() - 1;
+			return fmt::format(
+				"{} and {} other file{} are newer than the output",
+				output.newer_inputs[0], other_count, other_count == 1 ? "" : "s"
+			);
+		}
+		else if (output.newer_inputs.size() == 1)
+		{
+			return fmt::format("{} is newer than the output", output.newer_inputs[0]);
+		}
+		else
+		{
+			return detail.empty() ? "input is newer than the output" : detail;
+		}
+	case rebuild_reason_kind::missing_output_info:
+		return "no build information was recorded for the output";
+	case rebuild_reason_kind::hash_mismatch:
+		return "output file was modified outside of cppb";
+	case rebuild_reason_kind::compiler_changed:
+		return fmt::format("compiler changed: {}", detail);
+	case rebuild_reason_kind::args_changed:
+		return fmt::format("arguments changed: {}", detail);
+	}
+	return "";
+}
+
+void print_build_explanation(build_explanation const &explanation)
+{
+	auto const out_of_date_count = std::count_if(
+		explanation.outputs.begin(), explanation.outputs.end(),
+		[](auto const &output) { return is_out_of_date(output.reason); }
+	);
+	fmt::print(
+		"checked {} output file{} of {} ({}) in {:.2f} ms, {} out of date\n",
+		explanation.outputs.size(), explanation.outputs.size() == 1 ? "" : "s",
+		explanation.project_name, explanation.config_name,
+		explanation.check_time_ms,
+		out_of_date_count
+	);
+	for (auto const &output : explanation.outputs)
+	{
+		if (is_out_of_date(output.reason))
+		{
+			fmt::print("  {}: {}\n", output.input_file, get_reason_message(output));
+		}
+	}
+	std::fflush(stdout);
+}
+
+void write_build_explanation_json(fs::path const &explanation_json, build_explanation const &explanation)
+{
+	auto object = json::object();
+
+	object["project"] = explanation.project_name;
+	object["config"] = explanation.config_name;
+	object["check_time_ms"] = explanation.check_time_ms;
+
+	auto outputs = json::array();
+	for (auto const &output : explanation.outputs)
+	{
+		auto value = json::object();
+		value["input"] = output.input_file;
+		value["output"] = output.output_file;
+		value["reason"] = to_string(output.reason.kind);
+		value["message"] = get_reason_message(output);
+		if (!output.reason.detail.empty())
+		{
+			value["detail"] = output.reason.detail;
+		}
+		if (!output.newer_inputs.empty())
+		{
+			auto newer_inputs = json::array();
+			for (auto const &file : output.newer_inputs)
+			{
+				newer_inputs.push_back(file);
+			}
+			value["newer_inputs"] = std::move(newer_inputs);
+		}
+		outputs.push_back(std::move(value));
+	}
+	object["outputs"] = std::move(outputs);
+
+	if (explanation_json.has_parent_path())
+	{
+		fs::create_directories(explanation_json.parent_path());
+	}
+	auto output_file = std::ofstream(explanation_json);
+	output_file << object.dump(1, '\t');
+}
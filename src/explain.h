@@ -0,0 +1,57 @@
+#ifndef EXPLAIN_H
+#define EXPLAIN_H
+
+#include "core.h"
+
+enum class rebuild_reason_kind
+{
+	up_to_date,
+	// only comments or whitespace changed, the output is up to date once it's touched
+	touch_only,
+	forced,
+	missing_output,
+	pch_newer,
+	input_newer,
+	missing_output_info,
+	hash_mismatch,
+	compiler_changed,
+	args_changed,
+};
+
+struct rebuild_reason
+{
+	rebuild_reason_kind kind = rebuild_reason_kind::up_to_date;
+	std::string detail{};
+};
+
+inline bool is_out_of_date(rebuild_reason const &reason)
+{
+	return reason.kind != rebuild_reason_kind::up_to_date && reason.kind != rebuild_reason_kind::touch_only;
+}
+
+std::string_view to_string(rebuild_reason_kind kind);
+
+// e.g. "removed '-O0', added '-O2'"
+std::string get_args_diff(cppb::span<std::string const> old_args, cppb::span<std::string const> new_args);
+
+struct explained_output
+{
+	std::string    input_file;
+	std::string    output_file;
+	rebuild_reason reason;
+	// only filled for rebuild_reason_kind::input_newer, newest first
+	cppb::vector<std::string> newer_inputs{};
+};
+
+struct build_explanation
+{
+	std::string project_name;
+	std::string config_name;
+	double      check_time_ms = 0.0;
+	cppb::vector<explained_output> outputs;
+};
+
+void print_build_explanation(build_explanation const &explanation);
+void write_build_explanation_json(fs::path const &explanation_json, build_explanation const &explanation);
+
+#endif // EXPLAIN_H
@@ -62,3 +62,21 @@ std::string hash_file(fs::path const &filename)
 
 	return "";
 }
+
+std::string hash_string(std::string_view data)
+{
+	std::array<std::byte, SHA256_DIGEST_LENGTH> hash;
+	SHA256(
+		reinterpret_cast<unsigned char const *>(data.data()),
+		data.size(),
+		reinterpret_cast<unsigned char *>(hash.data())
+	);
+
+	auto result = std::string();
+	result.reserve(hash.size() * 2);
+	for (auto const &byte : hash)
+	{
+		result += fmt::format("{:02x}", static_cast<std::uint8_t>(byte));
+	}
+	return result;
+}
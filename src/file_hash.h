@@ -4,5 +4,6 @@
 #include "core.h"
 
 std::string hash_file(fs::path const &filename);
+std::string hash_string(std::string_view data); // SHA-256, used for content-addressed cache keys
 
 #endif // FILE_HASH_H
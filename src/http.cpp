@@ -0,0 +1,513 @@
+#include "http.h"
+#include "thread_pool.h"
+#include <cctype>
+#include <cstdio>
+#include <limits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#endif // windows
+
+#ifdef _WIN32
+
+using socket_t = SOCKET;
+static constexpr socket_t invalid_socket = INVALID_SOCKET;
+static constexpr int send_flags = 0;
+
+static void close_socket(socket_t socket)
+{
+	closesocket(socket);
+}
+
+static bool initialize_sockets(void)
+{
+	static bool const is_initialized = []() {
+		WSADATA wsa_data;
+		return WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0;
+	}();
+	return is_initialized;
+}
+
+static void set_socket_timeout(socket_t socket, int seconds)
+{
+	DWORD const timeout = static_cast<DWORD>(seconds) * 1000;
+	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<char const *>(&timeout), sizeof timeout);
+	setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<char const *>(&timeout), sizeof timeout);
+}
+
+#else
+
+using socket_t = int;
+static constexpr socket_t invalid_socket = -1;
+#ifdef MSG_NOSIGNAL
+static constexpr int send_flags = MSG_NOSIGNAL;
+#else
+static constexpr int send_flags = 0;
+#endif
+
+static void close_socket(socket_t socket)
+{
+	close(socket);
+}
+
+static bool initialize_sockets(void)
+{
+	return true;
+}
+
+static void set_socket_timeout(socket_t socket, int seconds)
+{
+	timeval timeout = {};
+	timeout.tv_sec = seconds;
+	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+	setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+}
+
+#endif // windows
+
+struct socket_closer
+{
+	socket_closer(socket_t socket)
+		: _socket(socket)
+	{}
+
+	~socket_closer(void)
+	{
+		if (this->_socket != invalid_socket)
+		{
+			close_socket(this->_socket);
+		}
+	}
+
+	socket_closer(socket_closer const &other) = delete;
+	socket_closer(socket_closer &&other) = delete;
+	socket_closer &operator = (socket_closer const &rhs) = delete;
+	socket_closer &operator = (socket_closer &&rhs) = delete;
+
+private:
+	socket_t _socket;
+};
+
+static bool send_all(socket_t socket, std::string_view data)
+{
+	while (!data.empty())
+	{
+		auto const chunk_size = std::min(data.size(), std::size_t(1) << 20);
+		auto const sent = send(socket, data.data(), static_cast<int>(chunk_size), send_flags);
+		if (sent <= 0)
+		{
+			return false;
+		}
+		data.remove_prefix(static_cast<std::size_t>(sent));
+	}
+	return true;
+}
+
+static bool receive_some(socket_t socket, std::string &buffer)
+{
+	std::array<char, 65536> chunk;
+	auto const received = recv(socket, chunk.data(), static_cast<int>(chunk.size()), 0);
+	if (received <= 0)
+	{
+		return false;
+	}
+	buffer.append(chunk.data(), static_cast<std::size_t>(received));
+	return true;
+}
+
+std::optional<std::size_t> parse_decimal(std::string_view str)
+{
+	if (str.empty())
+	{
+		return std::nullopt;
+	}
+	std::size_t result = 0;
+	for (auto const c : str)
+	{
+		if (c < '0' || c > '9')
+		{
+			return std::nullopt;
+		}
+		auto const digit = static_cast<std::size_t>(c - '0');
+		if (result > (std::numeric_limits<std::size_t>::max() - digit) / 10)
+		{
+			return std::nullopt;
+		}
+		result = result * 10 + digit;
+	}
+	return result;
+}
+
+static std::string_view trim(std::string_view str)
+{
+	while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+	{
+		str.remove_prefix(1);
+	}
+	while (!str.empty() && (str.back() == ' ' || str.back() == '\t' || str.back() == '\r'))
+	{
+		str.remove_suffix(1);
+	}
+	return str;
+}
+
+static bool equals_ignore_case(std::string_view lhs, std::string_view rhs)
+{
+	return lhs.size() == rhs.size()
+		&& std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char const l, char const r) {
+			return std::tolower(static_cast<unsigned char>(l)) == std::tolower(static_cast<unsigned char>(r));
+		});
+}
+
+// returns the value of the header 'name' in a block of header lines
+static std::optional<std::string_view> find_header(std::string_view headers, std::string_view name)
+{
+	while (!headers.empty())
+	{
+		auto const line_end = headers.find("\r\n");
+		auto const line = headers.substr(0, line_end);
+		auto const colon_pos = line.find(':');
+		if (colon_pos != std::string_view::npos && equals_ignore_case(trim(line.substr(0, colon_pos)), name))
+		{
+			return trim(line.substr(colon_pos + 1));
+		}
+		if (line_end == std::string_view::npos)
+		{
+			break;
+		}
+		headers.remove_prefix(line_end + 2);
+	}
+	return std::nullopt;
+}
+
+static std::optional<std::string> decode_chunked_body(std::string_view body)
+{
+	std::string result;
+	while (true)
+	{
+		auto const size_end = body.find("\r\n");
+		if (size_end == std::string_view::npos)
+		{
+			return std::nullopt;
+		}
+		auto const size_str = trim(body.substr(0, std::min(size_end, body.find(';'))));
+		if (size_str.empty())
+		{
+			return std::nullopt;
+		}
+		std::size_t chunk_size = 0;
+		for (auto const c : size_str)
+		{
+			auto const digit = (c >= '0' && c <= '9') ? c - '0'
+				: (c >= 'a' && c <= 'f') ? c - 'a' + 10
+				: (c >= 'A' && c <= 'F') ? c - 'A' + 10
+				: -1;
+			if (digit < 0)
+			{
+				return std::nullopt;
+			}
+			chunk_size = chunk_size * 16 + static_cast<std::size_t>(digit);
+			if (chunk_size > max_http_body_size)
+			{
+				return std::nullopt;
+			}
+		}
+		body.remove_prefix(size_end + 2);
+		if (chunk_size == 0)
+		{
+			return result;
+		}
+		// 'chunk_size' is at most 'max_http_body_size', so these can't overflow
+		if (
+			result.size() + chunk_size > max_http_body_size
+			|| body.size() < chunk_size + 2
+			|| body.substr(chunk_size, 2) != "\r\n"
+		)
+		{
+			return std::nullopt;
+		}
+		result += body.substr(0, chunk_size);
+		body.remove_prefix(chunk_size + 2);
+	}
+}
+
+static socket_t connect_to(std::string const &host, std::string const &port, int timeout_seconds)
+{
+	if (!initialize_sockets())
+	{
+		return invalid_socket;
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *addresses = nullptr;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+	{
+		return invalid_socket;
+	}
+
+	auto result = invalid_socket;
+	for (auto address = addresses; address != nullptr; address = address->ai_next)
+	{
+		auto const s = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (s == invalid_socket)
+		{
+			continue;
+		}
+		set_socket_timeout(s, timeout_seconds);
+		if (connect(s, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0)
+		{
+			result = s;
+			break;
+		}
+		close_socket(s);
+	}
+	freeaddrinfo(addresses);
+	return result;
+}
+
+std::optional<http_response> send_http_request(
+	std::string const &host,
+	std::string const &port,
+	std::string_view method,
+	std::string_view target,
+	std::string_view body,
+	int timeout_seconds
+)
+{
+	auto const s = connect_to(host, port, timeout_seconds);
+	if (s == invalid_socket)
+	{
+		return std::nullopt;
+	}
+	auto const closer = socket_closer(s);
+
+	auto const request_head = fmt::format(
+		"{} {} HTTP/1.1\r\nHost: {}:{}\r\nContent-Length: {}\r\nConnection: close\r\n\r\n",
+		method, target, host, port, body.size()
+	);
+	if (!send_all(s, request_head) || !send_all(s, body))
+	{
+		return std::nullopt;
+	}
+
+	std::string response;
+	while (receive_some(s, response))
+	{
+		// keep reading until the server closes the connection
+		if (response.size() > max_http_head_size + max_http_body_size)
+		{
+			return std::nullopt;
+		}
+	}
+
+	auto const head_end = response.find("\r\n\r\n");
+	if (head_end == std::string::npos || head_end > max_http_head_size || !response.starts_with("HTTP/1."))
+	{
+		return std::nullopt;
+	}
+	auto const head = std::string_view(response).substr(0, head_end);
+	auto const status_begin = head.find(' ');
+	if (status_begin == std::string_view::npos)
+	{
+		return std::nullopt;
+	}
+	auto const status = parse_decimal(head.substr(status_begin + 1, 3));
+	if (!status.has_value())
+	{
+		return std::nullopt;
+	}
+
+	auto result = http_response{ static_cast<int>(*status), response.substr(head_end + 4) };
+	auto const transfer_encoding = find_header(head, "Transfer-Encoding");
+	if (transfer_encoding.has_value() && equals_ignore_case(*transfer_encoding, "chunked"))
+	{
+		auto body_ = decode_chunked_body(result.body);
+		if (!body_.has_value())
+		{
+			return std::nullopt;
+		}
+		result.body = std::move(*body_);
+	}
+	else if (auto const content_length = find_header(head, "Content-Length"))
+	{
+		auto const length = parse_decimal(*content_length);
+		if (!length.has_value() || *length > result.body.size())
+		{
+			// truncated response
+			return std::nullopt;
+		}
+		result.body.resize(*length);
+	}
+	return result;
+}
+
+static std::string_view get_reason_phrase(int status)
+{
+	switch (status)
+	{
+	case 200: return "OK";
+	case 400: return "Bad Request";
+	case 403: return "Forbidden";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 411: return "Length Required";
+	case 413: return "Payload Too Large";
+	case 431: return "Request Header Fields Too Large";
+	case 500: return "Internal Server Error";
+	case 503: return "Service Unavailable";
+	default:  return "Unknown";
+	}
+}
+
+static void send_http_response(socket_t s, http_response const &response)
+{
+	auto const response_head = fmt::format(
+		"HTTP/1.1 {} {}\r\nContent-Length: {}\r\nContent-Type: application/octet-stream\r\nConnection: close\r\n\r\n",
+		response.status, get_reason_phrase(response.status), response.body.size()
+	);
+	send_all(s, response_head) && send_all(s, response.body);
+}
+
+static void handle_http_connection(socket_t s, http_request_handler const &handler)
+{
+	auto const closer = socket_closer(s);
+	set_socket_timeout(s, default_http_timeout_seconds);
+
+	std::string request;
+	auto head_end = std::string::npos;
+	while ((head_end = request.find("\r\n\r\n")) == std::string::npos)
+	{
+		if (request.size() > max_http_head_size)
+		{
+			send_http_response(s, { 431, "" });
+			return;
+		}
+		if (!receive_some(s, request))
+		{
+			return;
+		}
+	}
+	if (head_end > max_http_head_size)
+	{
+		send_http_response(s, { 431, "" });
+		return;
+	}
+
+	auto const head = std::string_view(request).substr(0, head_end);
+	auto const request_line = head.substr(0, head.find("\r\n"));
+	auto const method_end = request_line.find(' ');
+	auto const target_end = request_line.find(' ', method_end + 1);
+	if (method_end == std::string_view::npos || target_end == std::string_view::npos)
+	{
+		send_http_response(s, { 400, "" });
+		return;
+	}
+	auto const method = request_line.substr(0, method_end);
+	auto const target = request_line.substr(method_end + 1, target_end - method_end - 1);
+
+	auto body = request.substr(head_end + 4);
+	auto const content_length_header = find_header(head, "Content-Length");
+	if (content_length_header.has_value())
+	{
+		auto const content_length = parse_decimal(*content_length_header);
+		if (!content_length.has_value())
+		{
+			send_http_response(s, { 400, "" });
+			return;
+		}
+		if (*content_length > max_http_body_size)
+		{
+			send_http_response(s, { 413, "" });
+			return;
+		}
+		while (body.size() < *content_length)
+		{
+			if (!receive_some(s, body))
+			{
+				return;
+			}
+		}
+		body.resize(*content_length);
+	}
+	else if (method == "PUT" || method == "POST")
+	{
+		send_http_response(s, { 411, "" });
+		return;
+	}
+
+	send_http_response(s, handler(http_request{
+		.method = std::string(method),
+		.target = std::string(target),
+		.body = std::move(body),
+	}));
+}
+
+int run_http_server(
+	std::string_view host,
+	std::uint16_t port,
+	std::size_t thread_count,
+	std::string_view description,
+	http_request_handler handler
+)
+{
+	if (!initialize_sockets())
+	{
+		fmt::print(stderr, "unable to initialize sockets\n");
+		return 1;
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	addrinfo *addresses = nullptr;
+	auto const host_str = std::string(host);
+	auto const port_str = fmt::format("{}", port);
+	if (getaddrinfo(host_str.c_str(), port_str.c_str(), &hints, &addresses) != 0 || addresses == nullptr)
+	{
+		fmt::print(stderr, "unable to resolve address '{}:{}'\n", host, port);
+		return 1;
+	}
+
+	auto const listen_socket = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+	auto const closer = socket_closer(listen_socket);
+	int const reuse_address = 1;
+	if (
+		listen_socket == invalid_socket
+		|| setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char const *>(&reuse_address), sizeof reuse_address) != 0
+		|| bind(listen_socket, addresses->ai_addr, static_cast<int>(addresses->ai_addrlen)) != 0
+		|| listen(listen_socket, SOMAXCONN) != 0
+	)
+	{
+		freeaddrinfo(addresses);
+		fmt::print(stderr, "unable to listen on '{}:{}'\n", host, port);
+		return 1;
+	}
+	freeaddrinfo(addresses);
+
+	fmt::print("{} on http://{}:{}\n", description, host, port);
+	std::fflush(stdout);
+
+	auto pool = thread_pool(thread_count);
+	while (true)
+	{
+		auto const s = accept(listen_socket, nullptr, nullptr);
+		if (s == invalid_socket)
+		{
+			continue;
+		}
+		pool.push_task([s, &handler]() {
+			handle_http_connection(s, handler);
+			return 0;
+		});
+	}
+}
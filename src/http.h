@@ -0,0 +1,54 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include "core.h"
+#include <functional>
+
+// a minimal HTTP/1.1 client and server with one request per connection,
+// used by the remote cache and by distributed compilation
+
+inline constexpr int default_http_timeout_seconds = 30;
+// requests and responses with a larger head or body are rejected, so a bad peer can't make us
+// allocate an unbounded amount of memory
+inline constexpr std::size_t max_http_head_size = std::size_t(64) << 10;
+inline constexpr std::size_t max_http_body_size = std::size_t(1) << 30;
+
+struct http_request
+{
+	std::string method;
+	std::string target;
+	std::string body;
+};
+
+struct http_response
+{
+	int status;
+	std::string body;
+};
+
+using http_request_handler = std::function<http_response(http_request const &)>;
+
+// std::nullopt if 'str' isn't a decimal number or it doesn't fit in std::size_t
+std::optional<std::size_t> parse_decimal(std::string_view str);
+
+// std::nullopt if the server can't be reached or the response is malformed;
+// 'timeout_seconds' applies to every send and receive, not to the whole request
+std::optional<http_response> send_http_request(
+	std::string const &host,
+	std::string const &port,
+	std::string_view method,
+	std::string_view target,
+	std::string_view body,
+	int timeout_seconds = default_http_timeout_seconds
+);
+
+// serves requests on 'thread_count' threads; only returns if the server can't be started
+int run_http_server(
+	std::string_view host,
+	std::uint16_t port,
+	std::size_t thread_count,
+	std::string_view description,
+	http_request_handler handler
+);
+
+#endif // HTTP_H
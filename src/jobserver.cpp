@@ -0,0 +1,393 @@
+#include "jobserver.h"
+#include "process.h"
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <charconv>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif // !windows
+
+template<typename Fn>
+static void for_each_makeflag(std::string_view makeflags, Fn &&fn)
+{
+	while (!makeflags.empty())
+	{
+		auto const begin = makeflags.find_first_not_of(" \t");
+		if (begin == std::string_view::npos)
+		{
+			break;
+		}
+		makeflags.remove_prefix(begin);
+		auto const end = std::min(makeflags.find_first_of(" \t"), makeflags.size());
+		fn(makeflags.substr(0, end));
+		makeflags.remove_prefix(end);
+	}
+}
+
+// the value of the last '--jobserver-auth=' or the older '--jobserver-fds=' flag
+static std::string_view get_jobserver_auth(std::string_view makeflags)
+{
+	std::string_view result;
+	for_each_makeflag(makeflags, [&](std::string_view flag) {
+		for (std::string_view const prefix : { "--jobserver-auth=", "--jobserver-fds=" })
+		{
+			if (flag.starts_with(prefix))
+			{
+				result = flag.substr(prefix.size());
+			}
+		}
+	});
+	return result;
+}
+
+#ifdef _WIN32
+
+// make uses a named semaphore on windows, which isn't supported yet
+
+jobserver::jobserver(int read_fd, int write_fd, fs::path fifo_path)
+	: _read_fd(read_fd),
+	  _write_fd(write_fd),
+	  _fifo_path(std::move(fifo_path)),
+	  _is_makeflags_exported(false),
+	  _previous_makeflags(),
+	  _tokens_mutex(),
+	  _is_implicit_token_taken(false),
+	  _tokens(),
+	  _wake_read_fd(-1),
+	  _wake_write_fd(-1),
+	  _waiting_count(0)
+{}
+
+jobserver::~jobserver(void)
+{}
+
+void jobserver::acquire(void)
+{}
+
+void jobserver::release(void)
+{}
+
+void jobserver::export_makeflags(std::size_t)
+{}
+
+std::unique_ptr<jobserver> connect_to_jobserver(std::string_view makeflags, std::string &error)
+{
+	if (!get_jobserver_auth(makeflags).empty())
+	{
+		error = "joining a make jobserver is not supported on windows";
+	}
+	return nullptr;
+}
+
+std::unique_ptr<jobserver> create_jobserver(std::size_t, jobserver_style, std::string &)
+{
+	return nullptr;
+}
+
+#else
+
+// the destructor doesn't run if cppb is terminated by a signal, so the fifo is removed by a signal handler;
+// only a fifo created by cppb is set here, and it's reset by the destructor.  MAKEFLAGS isn't restored,
+// because the environment of the process goes away with it
+static std::atomic<char const *> signal_fifo_path{ nullptr };
+
+static void clean_up_jobserver_on_signal(void)
+{
+	if (auto const fifo_path = signal_fifo_path.load(); fifo_path != nullptr)
+	{
+		unlink(fifo_path);
+	}
+}
+
+jobserver::jobserver(int read_fd, int write_fd, fs::path fifo_path)
+	: _read_fd(read_fd),
+	  _write_fd(write_fd),
+	  _fifo_path(std::move(fifo_path)),
+	  _is_makeflags_exported(false),
+	  _previous_makeflags(),
+	  _tokens_mutex(),
+	  _is_implicit_token_taken(false),
+	  _tokens(),
+	  _wake_read_fd(-1),
+	  _wake_write_fd(-1),
+	  _waiting_count(0)
+{
+	if (!this->_fifo_path.empty())
+	{
+		signal_fifo_path.store(this->_fifo_path.c_str());
+	}
+	int wake_fds[2] = { -1, -1 };
+	if (pipe(wake_fds) == 0)
+	{
+		for (auto const fd : wake_fds)
+		{
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		}
+		this->_wake_read_fd = wake_fds[0];
+		this->_wake_write_fd = wake_fds[1];
+	}
+}
+
+jobserver::~jobserver(void)
+{
+	if (!this->_fifo_path.empty())
+	{
+		signal_fifo_path.store(nullptr);
+	}
+	if (this->_is_makeflags_exported)
+	{
+		if (this->_previous_makeflags.has_value())
+		{
+			setenv("MAKEFLAGS", this->_previous_makeflags->c_str(), 1);
+		}
+		else
+		{
+			unsetenv("MAKEFLAGS");
+		}
+	}
+	if (!this->_fifo_path.empty())
+	{
+		// a fifo jobserver is opened once for both reading and writing
+		close(this->_read_fd);
+		std::error_code ec;
+		fs::remove(this->_fifo_path, ec);
+	}
+	if (this->_wake_read_fd >= 0)
+	{
+		close(this->_wake_read_fd);
+		close(this->_wake_write_fd);
+	}
+}
+
+void jobserver::acquire(void)
+{
+	char token = 0;
+	while (true)
+	{
+		{
+			auto const guard = std::lock_guard(this->_tokens_mutex);
+			if (!this->_is_implicit_token_taken)
+			{
+				this->_is_implicit_token_taken = true;
+				return;
+			}
+			this->_waiting_count += 1;
+		}
+
+		// the jobserver may be empty while the implicit token is released by another thread,
+		// so we also wait for the wake pipe; poll also handles a non-blocking fd set by the parent make
+		auto poll_fds = std::array<pollfd, 2>{{
+			{ .fd = this->_read_fd, .events = POLLIN, .revents = 0 },
+			{ .fd = this->_wake_read_fd, .events = POLLIN, .revents = 0 },
+		}};
+		auto const poll_result = poll(poll_fds.data(), this->_wake_read_fd >= 0 ? 2 : 1, -1);
+		{
+			auto const guard = std::lock_guard(this->_tokens_mutex);
+			this->_waiting_count -= 1;
+		}
+		if (poll_result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			// the jobserver is unusable, so there's nothing to limit the number of jobs anymore
+			token = 0;
+			break;
+		}
+		if (poll_fds[1].revents != 0)
+		{
+			char wake_byte = 0;
+			while (read(this->_wake_read_fd, &wake_byte, 1) == 1)
+			{}
+			continue;
+		}
+		if (poll_fds[0].revents == 0)
+		{
+			continue;
+		}
+
+		auto const read_size = read(this->_read_fd, &token, 1);
+		if (read_size == 1)
+		{
+			break;
+		}
+		else if (read_size < 0 && (errno == EAGAIN || errno == EINTR))
+		{
+			// the token was taken by another process first
+			continue;
+		}
+		else
+		{
+			// the jobserver is gone, so there's nothing to limit the number of jobs anymore
+			token = 0;
+			break;
+		}
+	}
+
+	auto const guard = std::lock_guard(this->_tokens_mutex);
+	this->_tokens += token;
+}
+
+void jobserver::release(void)
+{
+	auto const guard = std::lock_guard(this->_tokens_mutex);
+	if (this->_tokens.empty())
+	{
+		this->_is_implicit_token_taken = false;
+		if (this->_waiting_count != 0 && this->_wake_write_fd >= 0)
+		{
+			char const wake_byte = 0;
+			while (write(this->_wake_write_fd, &wake_byte, 1) < 0 && errno == EINTR)
+			{}
+		}
+		return;
+	}
+
+	auto const token = this->_tokens.back();
+	this->_tokens.pop_back();
+	if (token != 0)
+	{
+		while (write(this->_write_fd, &token, 1) < 0 && errno == EINTR)
+		{}
+	}
+}
+
+void jobserver::export_makeflags(std::size_t job_count)
+{
+	auto const auth = this->_fifo_path.empty()
+		? fmt::format("{},{}", this->_read_fd, this->_write_fd)
+		: fmt::format("fifo:{}", this->_fifo_path.native());
+
+	if (!this->_is_makeflags_exported)
+	{
+		if (auto const makeflags = std::getenv("MAKEFLAGS"); makeflags != nullptr)
+		{
+			this->_previous_makeflags = makeflags;
+		}
+		this->_is_makeflags_exported = true;
+	}
+	// the job count and jobserver of a parent make are replaced
+	std::string makeflags;
+	for_each_makeflag(this->_previous_makeflags.value_or(""), [&](std::string_view flag) {
+		if (!flag.starts_with("-j") && !flag.starts_with("--jobserver-"))
+		{
+			makeflags += makeflags.empty() ? "" : " ";
+			makeflags += flag;
+		}
+	});
+	makeflags += fmt::format(" -j{} --jobserver-auth={}", job_count, auth);
+	setenv("MAKEFLAGS", makeflags.c_str(), 1);
+}
+
+static bool is_valid_fd(int fd)
+{
+	return fd >= 0 && fcntl(fd, F_GETFD) != -1;
+}
+
+std::unique_ptr<jobserver> connect_to_jobserver(std::string_view makeflags, std::string &error)
+{
+	auto const auth = get_jobserver_auth(makeflags);
+	if (auth.empty())
+	{
+		return nullptr;
+	}
+
+	if (auth.starts_with("fifo:"))
+	{
+		auto const fifo_path = std::string(auth.substr(std::string_view("fifo:").size()));
+		auto const fd = open(fifo_path.c_str(), O_RDWR | O_CLOEXEC);
+		if (fd < 0)
+		{
+			error = fmt::format("unable to open jobserver fifo '{}'", fifo_path);
+			return nullptr;
+		}
+		// the fifo belongs to the parent make, so it's not removed in the destructor; the file descriptor is leaked
+		return std::make_unique<jobserver>(fd, fd, fs::path());
+	}
+
+	auto const comma = auth.find(',');
+	int read_fd = -1;
+	int write_fd = -1;
+	if (
+		comma == std::string_view::npos
+		|| std::from_chars(auth.data(), auth.data() + comma, read_fd).ec != std::errc()
+		|| std::from_chars(auth.data() + comma + 1, auth.data() + auth.size(), write_fd).ec != std::errc()
+	)
+	{
+		error = fmt::format("invalid jobserver '{}' in MAKEFLAGS", auth);
+		return nullptr;
+	}
+	if (!is_valid_fd(read_fd) || !is_valid_fd(write_fd))
+	{
+		// make only passes the file descriptors to recursive invocations, i.e. commands that start with '+' or use $(MAKE)
+		error = "the jobserver in MAKEFLAGS is not available, the rule that runs cppb should be marked with '+'";
+		return nullptr;
+	}
+	return std::make_unique<jobserver>(read_fd, write_fd, fs::path());
+}
+
+std::unique_ptr<jobserver> create_jobserver(std::size_t job_count, jobserver_style style, std::string &error)
+{
+	int read_fd = -1;
+	int write_fd = -1;
+	auto fifo_path = fs::path();
+
+	if (style == jobserver_style::fifo)
+	{
+		fifo_path = fs::temp_directory_path() / fmt::format("cppb-jobserver-{}", getpid());
+		std::error_code ec;
+		fs::remove(fifo_path, ec);
+		if (mkfifo(fifo_path.c_str(), 0600) != 0)
+		{
+			error = fmt::format("unable to create jobserver fifo '{}'", fifo_path.generic_string());
+			return nullptr;
+		}
+		read_fd = open(fifo_path.c_str(), O_RDWR | O_CLOEXEC);
+		if (read_fd < 0)
+		{
+			error = fmt::format("unable to open jobserver fifo '{}'", fifo_path.generic_string());
+			fs::remove(fifo_path, ec);
+			return nullptr;
+		}
+		write_fd = read_fd;
+	}
+	else
+	{
+		// the file descriptors are inherited by every child process, so they're never closed
+		int fds[2];
+		if (pipe(fds) != 0)
+		{
+			error = "unable to create jobserver pipe";
+			return nullptr;
+		}
+		read_fd = fds[0];
+		write_fd = fds[1];
+	}
+
+	auto const tokens = std::string(job_count > 1 ? job_count - 1 : 0, '+');
+	for (std::size_t written_size = 0; written_size < tokens.size();)
+	{
+		auto const result = write(write_fd, tokens.data() + written_size, tokens.size() - written_size);
+		if (result < 0 && errno != EINTR)
+		{
+			error = "unable to write to the jobserver";
+			break;
+		}
+		written_size += static_cast<std::size_t>(std::max(result, ssize_t(0)));
+	}
+
+	auto result = std::make_unique<jobserver>(read_fd, write_fd, std::move(fifo_path));
+	result->export_makeflags(job_count);
+	[[maybe_unused]] static bool const is_signal_cleanup_added = (add_signal_cleanup(&clean_up_jobserver_on_signal), true);
+	return result;
+}
+
+#endif // windows
@@ -0,0 +1,55 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include "core.h"
+#include "cl_options.h"
+#include <memory>
+#include <mutex>
+
+// a GNU make compatible jobserver: a pipe or a named fifo that holds one byte for every job that can run
+// in addition to the one every process is allowed to run implicitly.  cppb either joins the jobserver of
+// a parent make through MAKEFLAGS, or creates its own and exports it in MAKEFLAGS, so nested make
+// invocations in rules share the same job limit
+struct jobserver
+{
+	jobserver(int read_fd, int write_fd, fs::path fifo_path);
+	~jobserver(void);
+
+	jobserver(jobserver const &other) = delete;
+	jobserver(jobserver &&other) = delete;
+	jobserver &operator = (jobserver const &rhs) = delete;
+	jobserver &operator = (jobserver &&rhs) = delete;
+
+	// blocks until a job can be started
+	void acquire(void);
+	// must be called once for every 'acquire' after the job has finished
+	void release(void);
+
+	// adds the jobserver to MAKEFLAGS in the environment, the previous value is restored in the destructor
+	void export_makeflags(std::size_t job_count);
+
+private:
+	int _read_fd;
+	int _write_fd;
+	// only set if the fifo was created by this jobserver, it's removed in the destructor
+	fs::path _fifo_path;
+	bool _is_makeflags_exported;
+	std::optional<std::string> _previous_makeflags;
+
+	std::mutex _tokens_mutex;
+	bool _is_implicit_token_taken;
+	// the bytes read from the jobserver are written back unchanged
+	std::string _tokens;
+	// there can be more threads than jobs, e.g. with remote workers, so a byte is written to this pipe when the
+	// implicit token is released while a thread is waiting for the jobserver; -1 if it couldn't be created
+	int _wake_read_fd;
+	int _wake_write_fd;
+	std::size_t _waiting_count;
+};
+
+// returns nullptr if 'makeflags' doesn't contain '--jobserver-auth', and sets 'error' if it's not usable
+std::unique_ptr<jobserver> connect_to_jobserver(std::string_view makeflags, std::string &error);
+// creates a jobserver that allows 'job_count' concurrent jobs and adds it to MAKEFLAGS in the environment
+std::unique_ptr<jobserver> create_jobserver(std::size_t job_count, jobserver_style style, std::string &error);
+
+#endif // JOBSERVER_H
@@ -6,6 +6,10 @@
 #include <mutex>
 #include <utility>
 #include <span>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <fmt/color.h>
 #include "core.h"
 #include "analyze.h"
@@ -14,10 +18,25 @@
 #include "cl_options.h"
 #include "thread_pool.h"
 #include "file_hash.h"
+#include "build_state.h"
+#include "cache.h"
+#include "remote_cache.h"
+#include "distributed.h"
+#include "diagnostics.h"
+#include "driver_bypass.h"
+#include "compiler_launcher.h"
+#include "compiler_identity.h"
+#include "explain.h"
+#include "build_graph.h"
+#include "jobserver.h"
+#include "output_queue.h"
+#include "executor.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#else
+#include <unistd.h>
 #endif // windows
 
 #ifdef _WIN32
@@ -126,6 +145,20 @@ static config const &get_build_config(project_config const &project_config)
 	}
 }
 
+static std::uint64_t get_physical_memory_size(void)
+{
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof status;
+	return GlobalMemoryStatusEx(&status) ? status.ullTotalPhys : 0;
+}
+
+// whether errors are printed to a console
+static bool is_interactive(void)
+{
+	DWORD mode = 0;
+	return GetConsoleMode(GetStdHandle(STD_ERROR_HANDLE), &mode) != 0;
+}
+
 #else
 
 constexpr std::string_view executable_extension = "";
@@ -155,6 +188,21 @@ static config const &get_build_config(project_config const &project_config)
 	}
 }
 
+static std::uint64_t get_physical_memory_size(void)
+{
+	auto const page_count = sysconf(_SC_PHYS_PAGES);
+	auto const page_size = sysconf(_SC_PAGE_SIZE);
+	return page_count > 0 && page_size > 0
+		? static_cast<std::uint64_t>(page_count) * static_cast<std::uint64_t>(page_size)
+		: 0;
+}
+
+// whether errors are printed to a terminal
+static bool is_interactive(void)
+{
+	return isatty(STDERR_FILENO) != 0;
+}
+
 #endif // windows
 
 } // namespace os
@@ -182,6 +230,12 @@ static std::string get_executable_name(std::string_view default_name, config con
 	}
 }
 
+static fs::path get_executable_file(fs::path const &bin_directory, config const &build_config, std::string_view project_name)
+{
+	auto const project_directory_name = fs::current_path().filename().generic_string();
+	return fs::absolute(bin_directory / get_executable_name(project_directory_name, build_config, project_name));
+}
+
 static uint64_t get_job_count(void)
 {
 	auto const result = ctcli::is_option_set<"build --jobs">()
@@ -190,6 +244,34 @@ static uint64_t get_job_count(void)
 	return std::max(result, uint64_t(1));
 }
 
+// the number of compiler and linker processes that run on this machine at the same time
+static uint64_t get_local_slot_count(void)
+{
+	return ctcli::option_value<"build -s"> ? 1 : get_job_count();
+}
+
+// the thread counts of the cpu and io classes default to the job count, so -j limits every part of the build;
+// the compilations sent to workers need a process slot each, on top of the local ones
+static executor create_executor(std::size_t remote_slot_count)
+{
+	auto const job_count = get_job_count();
+	auto const cpu_thread_count = ctcli::is_option_set<"build --cpu-jobs">()
+		? std::max(ctcli::option_value<"build --cpu-jobs">, uint64_t(1))
+		: job_count;
+	auto const io_thread_count = ctcli::is_option_set<"build --io-jobs">()
+		? std::max(ctcli::option_value<"build --io-jobs">, uint64_t(1))
+		: job_count;
+	auto const process_slot_count = ctcli::option_value<"build -s"> ? 1 : job_count + remote_slot_count;
+	return executor(cpu_thread_count, io_thread_count, process_slot_count);
+}
+
+static std::int64_t get_elapsed_milliseconds(std::chrono::steady_clock::time_point begin)
+{
+	auto const elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+	// 0 means that no duration was recorded
+	return std::max(elapsed.count(), std::int64_t(1));
+}
+
 struct run_rule_result_t
 {
 	int exit_code;
@@ -203,7 +285,9 @@ static run_rule_result_t run_rule(
 	cppb::vector<rule> const &rules,
 	fs::file_time_type config_last_update,
 	std::string &error,
-	bool error_on_unknown_rule = true
+	bool error_on_unknown_rule = true,
+	// if it's not nullptr, the resource usage of every rule that runs its commands is recorded here
+	std::unordered_map<std::string, resource_usage> *rule_usages = nullptr
 )
 {
 	auto const it = std::find_if(rules.begin(), rules.end(), [rule_to_run](auto const &rule) {
@@ -230,7 +314,7 @@ static run_rule_result_t run_rule(
 	};
 	for (auto const &dependency : it_os_rule.dependencies)
 	{
-		auto const [exit_code, any_run, last_update_time] = run_rule("", dependency, rules, config_last_update, error, error_on_unknown_rule);
+		auto const [exit_code, any_run, last_update_time] = run_rule("", dependency, rules, config_last_update, error, error_on_unknown_rule, rule_usages);
 		if (!error.empty())
 		{
 			return {};
@@ -251,6 +335,7 @@ static run_rule_result_t run_rule(
 	)
 	{
 		result.any_run = true;
+		auto usage = resource_usage();
 		for (auto const &command : it_os_rule.commands)
 		{
 			if (point_name.empty())
@@ -262,13 +347,22 @@ static run_rule_result_t run_rule(
 				fmt::print("running {} rule '{}': {}\n", point_name, rule_to_run, command);
 			}
 			std::fflush(stdout);
-			auto const &[_0, _1, exit_code, _2, _3] = run_command(command, false);
-			if (exit_code != 0)
+			auto const command_result = run_command(command, false);
+			add_resource_usage(usage, command_result.usage);
+			if (command_result.exit_code != 0)
 			{
-				result.exit_code = exit_code;
-				return result;
+				result.exit_code = command_result.exit_code;
+				break;
 			}
 		}
+		if (rule_usages != nullptr)
+		{
+			rule_usages->insert_or_assign(it->rule_name, usage);
+		}
+		if (result.exit_code != 0)
+		{
+			return result;
+		}
 		if (it_os_rule.is_file && fs::exists(rule_path))
 		{
 			result.last_update_time = fs::last_write_time(rule_path);
@@ -283,14 +377,15 @@ static run_rule_result_t run_rules(
 	cppb::vector<rule> const &rules,
 	fs::file_time_type config_last_update,
 	std::string &error,
-	bool error_on_unknown_rule = true
+	bool error_on_unknown_rule = true,
+	std::unordered_map<std::string, resource_usage> *rule_usages = nullptr
 )
 {
 	bool any_rules_run = false;
 	fs::file_time_type last_update_time = config_last_update;
 	for (auto const &rule_to_run : rules_to_run)
 	{
-		auto const [exit_code, any_run, last_update] = run_rule(point_name, rule_to_run, rules, config_last_update, error, error_on_unknown_rule);
+		auto const [exit_code, any_run, last_update] = run_rule(point_name, rule_to_run, rules, config_last_update, error, error_on_unknown_rule, rule_usages);
 		any_rules_run |= any_run;
 		last_update_time = std::max(last_update_time, last_update);
 		if (exit_code != 0 || !error.empty())
@@ -307,14 +402,15 @@ static run_rule_result_t run_rules(
 	cppb::vector<rule> const &rules,
 	fs::file_time_type config_last_update,
 	std::string &error,
-	bool error_on_unknown_rule = true
+	bool error_on_unknown_rule = true,
+	std::unordered_map<std::string, resource_usage> *rule_usages = nullptr
 )
 {
 	bool any_rules_run = false;
 	fs::file_time_type last_update_time = config_last_update;
 	for (auto const &rule_to_run : rules_to_run)
 	{
-		auto const [exit_code, any_run, last_update] = run_rule(point_name, rule_to_run.generic_string(), rules, config_last_update, error, error_on_unknown_rule);
+		auto const [exit_code, any_run, last_update] = run_rule(point_name, rule_to_run.generic_string(), rules, config_last_update, error, error_on_unknown_rule, rule_usages);
 		any_rules_run |= any_run;
 		last_update_time = std::max(last_update_time, last_update);
 		if (exit_code != 0 || !error.empty())
@@ -431,38 +527,156 @@ static std::string get_cpp_compiler(config const &build_config)
 	}
 }
 
-struct build_result_t
+// returns the last time the contents of 'output_file' actually changed,
+// which can be older than its last write time if it was rebuilt with identical contents
+static fs::file_time_type get_logical_write_time(fs::path const &cache_dir, fs::path const &output_file)
 {
-	int exit_code;
-	bool any_run;
-	bool any_cpp;
-	cppb::vector<fs::path> object_files;
-};
+	auto const write_time = fs::last_write_time(output_file);
+	auto const output_file_info_json = get_output_file_info_json(cache_dir, output_file);
+	if (!fs::exists(output_file_info_json) || fs::last_write_time(output_file_info_json) < write_time)
+	{
+		return write_time;
+	}
+
+	auto const info = read_output_file_info_json(output_file_info_json);
+	if (!info.has_value() || !info->logical_write_time.has_value())
+	{
+		return write_time;
+	}
+	return std::min(*info->logical_write_time, write_time);
+}
+
+// command lines longer than this are passed in a response file, so e.g. linking thousands of object files
+// doesn't hit the argument length limit of the system
+static constexpr std::size_t response_file_threshold = 8 * 1024;
+
+// gcc and clang split response files at whitespace, and a backslash escapes any character
+static std::string get_response_file_content(cppb::span<std::string const> args)
+{
+	std::string result;
+	for (auto const &arg : args)
+	{
+		for (auto const c : arg)
+		{
+			if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\'' || c == '\"' || c == '\\')
+			{
+				result += '\\';
+			}
+			result += c;
+		}
+		result += '\n';
+	}
+	return result;
+}
+
+// the response files are only used while a command runs, the directory is removed after every build
+// and by 'cache gc' and 'cache clear', in case a build was interrupted
+static fs::path get_response_file_directory(fs::path const &cppb_dir)
+{
+	return cppb_dir / "response_files";
+}
+
+// response files are content-addressed, so translation units with the same flags share one;
+// returns an empty path if the file can't be written
+static fs::path write_response_file(cppb::span<std::string const> args)
+{
+	auto const content = get_response_file_content(args);
+	auto const directory = get_response_file_directory(fs::path(ctcli::option_value<"build --cppb-dir">));
+	auto const file = directory / fmt::format("{}.rsp", hash_string(content));
+	if (fs::exists(file))
+	{
+		return file;
+	}
+
+	// the same file may be written by more than one thread, so it's renamed into place
+	static std::atomic<std::uint64_t> temp_file_counter = 0;
+	std::error_code ec;
+	fs::create_directories(directory, ec);
+	auto temp_file = file;
+	temp_file += fmt::format(".tmp{}", temp_file_counter.fetch_add(1));
+	{
+		std::ofstream output(temp_file, std::ios::binary);
+		output.write(content.data(), static_cast<std::streamsize>(content.size()));
+		if (!output)
+		{
+			fs::remove(temp_file, ec);
+			return {};
+		}
+	}
+	fs::rename(temp_file, file, ec);
+	if (ec)
+	{
+		fs::remove(temp_file, ec);
+		return {};
+	}
+	return file;
+}
+
+// the arguments that are passed to the process; above the threshold every argument except the last
+// 'kept_argument_count' ones is moved to a response file.  The expanded arguments are still the ones
+// recorded for up-to-date checks and cache keys.
+static cppb::vector<std::string> get_process_arguments(
+	std::string_view executable,
+	cppb::vector<std::string> const &args,
+	std::size_t kept_argument_count
+)
+{
+	auto const command_line_length = args
+		.transform([](auto const &arg) { return arg.size() + 1; })
+		.sum() + executable.size();
+	if (command_line_length <= response_file_threshold || args.size() <= kept_argument_count)
+	{
+		return args;
+	}
+
+	auto const response_file_arg_count = args.size() - kept_argument_count;
+	auto const response_file = write_response_file(cppb::span<std::string const>(args.data(), response_file_arg_count));
+	if (response_file.empty())
+	{
+		return args;
+	}
+
+	cppb::vector<std::string> result;
+	result.reserve(kept_argument_count + 1);
+	result.push_back(fmt::format("@{}", response_file.generic_string()));
+	for (std::size_t i = response_file_arg_count; i < args.size(); ++i)
+	{
+		result.push_back(args[i]);
+	}
+	return result;
+}
 
 static int link_project(
 	std::string_view project_name,
 	config const &build_config,
 	fs::path const &bin_directory,
+	fs::path const &cache_dir,
 	cppb::vector<fs::path> const &object_files,
 	fs::file_time_type dependency_last_update,
-	bool is_any_cpp
+	bool is_any_cpp,
+	build_state &state,
+	std::mutex &state_mutex
 )
 {
 	auto const c_compiler   = get_c_compiler(build_config);
 	auto const cpp_compiler = get_cpp_compiler(build_config);
 
-	auto const project_directory_name = fs::current_path().filename().generic_string();
-	auto const executable_file_name = get_executable_name(project_directory_name, build_config, project_name);
-
-	auto const executable_file = fs::absolute(bin_directory / executable_file_name);
+	auto const executable_file = get_executable_file(bin_directory, build_config, project_name);
+	auto const executable_last_update = fs::exists(executable_file)
+		? fs::last_write_time(executable_file)
+		: fs::file_time_type::min();
 	auto const last_object_write_time = object_files
-		.transform([](auto const &object_file) { return fs::last_write_time(object_file); })
+		.transform([&](auto const &object_file) {
+			// only object files that were written after the executable need to be checked for actual changes
+			auto const write_time = fs::last_write_time(object_file);
+			return write_time <= executable_last_update ? write_time : get_logical_write_time(cache_dir, object_file);
+		})
 		.max(dependency_last_update);
 
 	if (
 		ctcli::option_value<"build --link">
 		|| !fs::exists(executable_file)
-		|| fs::last_write_time(executable_file) < last_object_write_time
+		|| executable_last_update < last_object_write_time
 	)
 	{
 		auto const relative_executable_file_name = fs::relative(executable_file).generic_string();
@@ -485,11 +699,17 @@ static int link_project(
 		{
 			print_command(is_any_cpp ? cpp_compiler : c_compiler, link_args);
 		}
-		auto const result = run_command(is_any_cpp ? cpp_compiler : c_compiler, link_args, false);
+		auto const link_begin = std::chrono::steady_clock::now();
+		auto const &linker = is_any_cpp ? cpp_compiler : c_compiler;
+		auto const result = run_command(linker, get_process_arguments(linker, link_args, 0), false);
 		if (result.exit_code != 0)
 		{
 			return result.exit_code;
 		}
+		auto const link_duration = get_elapsed_milliseconds(link_begin);
+		auto const state_guard = std::lock_guard(state_mutex);
+		state.link_durations[get_build_state_key(executable_file)] = link_duration;
+		state.link_usages[get_build_state_key(executable_file)] = result.usage;
 	}
 
 	return 0;
@@ -498,192 +718,316 @@ static int link_project(
 struct compiler_invocation_t
 {
 	std::string compiler;
+	// runs the compiler, e.g. ccache; it isn't part of the cache key, so adding one doesn't rebuild everything
+	std::string launcher;
 	cppb::vector<std::string> args;
 	fs::path input_file;
 	fs::file_time_type input_file_last_modified;
 	fs::path output_file;
+	std::string remote_cache_key;
+	std::string token_fingerprint;
 };
 
-static fs::path get_output_file_info_json(fs::path const &cache_dir, fs::path const &output_file)
-{
-	fs::path result = cache_dir / fs::relative(output_file);
-	result += ".json";
-	return result;
-}
-
-static bool should_compile(
+static rebuild_reason get_rebuild_reason(
 	compiler_invocation_t const &invocation,
 	fs::path const &cache_dir,
-	fs::file_time_type pch_last_update = fs::file_time_type::min()
+	fs::file_time_type pch_last_update = fs::file_time_type::min(),
+	fs::path const &pch_file = {}
 )
 {
-	if (ctcli::option_value<"build --rebuild"> || !fs::exists(invocation.output_file))
+	if (ctcli::option_value<"build --rebuild">)
 	{
-		return true;
+		return { rebuild_reason_kind::forced };
+	}
+	if (!fs::exists(invocation.output_file))
+	{
+		return { rebuild_reason_kind::missing_output };
 	}
 
 	auto const output_last_update = fs::last_write_time(invocation.output_file);
 	if (output_last_update < pch_last_update)
 	{
-		return true;
+		return { rebuild_reason_kind::pch_newer, fs::relative(pch_file).generic_string() };
 	}
 
-	auto const input_last_update = invocation.input_file_last_modified;
-	if (output_last_update < input_last_update)
+	auto const is_input_newer = output_last_update < invocation.input_file_last_modified;
+	if (is_input_newer && invocation.token_fingerprint.empty())
 	{
-		return true;
+		return { rebuild_reason_kind::input_newer };
 	}
 
 	auto const output_file_info_json = get_output_file_info_json(cache_dir, invocation.output_file);
 	if (!fs::exists(output_file_info_json) || fs::last_write_time(output_file_info_json) < output_last_update)
 	{
-		return true;
+		return { rebuild_reason_kind::missing_output_info };
 	}
 
 	auto const maybe_info = read_output_file_info_json(output_file_info_json);
 	if (!maybe_info)
 	{
-		return true;
+		return { rebuild_reason_kind::missing_output_info };
 	}
 
 	auto const &info = *maybe_info;
 	auto const hash = hash_file(invocation.output_file);
-	return hash == ""
-		|| hash != info.hash
-		|| invocation.compiler != info.compiler
-		|| invocation.args != info.args;
+	if (hash == "" || hash != info.hash)
+	{
+		return { rebuild_reason_kind::hash_mismatch };
+	}
+	if (invocation.compiler != info.compiler)
+	{
+		return { rebuild_reason_kind::compiler_changed, fmt::format("'{}' -> '{}'", info.compiler, invocation.compiler) };
+	}
+	if (invocation.args != info.args)
+	{
+		return { rebuild_reason_kind::args_changed, get_args_diff(info.args, invocation.args) };
+	}
+
+	if (is_input_newer)
+	{
+		if (info.token_fingerprint != invocation.token_fingerprint)
+		{
+			return { rebuild_reason_kind::input_newer, "token fingerprint changed" };
+		}
+		return { rebuild_reason_kind::touch_only };
+	}
+
+	return { rebuild_reason_kind::up_to_date };
 }
 
-static process_result compile(compiler_invocation_t const &invocation, fs::path const &cache_dir, bool capture)
+// the output of a 'touch_only' reason is touched, so the next build doesn't need to look at the fingerprints
+// again, but its logical write time is kept; the output is compiled if that fails.  the build directory
+// isn't changed by --explain, so the outputs are left alone and checked again by the next build
+static void touch_up_to_date_output(rebuild_reason &reason, compiler_invocation_t const &invocation, fs::path const &cache_dir)
 {
-	auto const output_file_info_json = get_output_file_info_json(cache_dir, invocation.output_file);
-	if (fs::exists(output_file_info_json))
+	if (
+		reason.kind != rebuild_reason_kind::touch_only
+		|| ctcli::option_value<"build --explain">
+		|| ctcli::is_option_set<"build --explain-json">()
+	)
 	{
-		fs::remove(output_file_info_json);
+		return;
 	}
 
-	auto const result = run_command(invocation.compiler, invocation.args, capture);
-
-	if (result.exit_code == 0)
+	auto const now = fs::file_time_type::clock::now();
+	std::error_code ec;
+	fs::last_write_time(invocation.output_file, now, ec);
+	if (!ec)
 	{
-		auto const hash = hash_file(invocation.output_file);
-		write_output_file_info_json(output_file_info_json, invocation.compiler, invocation.args, hash);
+		fs::last_write_time(get_output_file_info_json(cache_dir, invocation.output_file), now, ec);
+	}
+	if (ec)
+	{
+		reason = { rebuild_reason_kind::input_newer };
 	}
+}
 
-	return result;
+static std::optional<std::string> read_binary_file(fs::path const &file)
+{
+	std::ifstream input(file, std::ios::binary);
+	if (!input.is_open())
+	{
+		return std::nullopt;
+	}
+	return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
 }
 
-struct compilation_info_t
+static std::optional<output_file_info> read_previous_output_file_info(
+	fs::path const &output_file,
+	fs::path const &output_file_info_json
+)
 {
-	std::size_t index;
-	std::string filename;
-};
+	if (
+		!fs::exists(output_file)
+		|| !fs::exists(output_file_info_json)
+		|| fs::last_write_time(output_file_info_json) < fs::last_write_time(output_file)
+	)
+	{
+		return std::nullopt;
+	}
+	return read_output_file_info_json(output_file_info_json);
+}
 
-static cppb::vector<process_result> run_commands_async(
-	cppb::span<compiler_invocation_t const> compiler_invocations,
-	fs::path const &cache_dir
+// if the new output file is byte-identical to the previous one, its logical write time is kept,
+// so linking and the rules that depend on the executable can be skipped
+static fs::file_time_type get_new_logical_write_time(
+	std::optional<output_file_info> const &previous_info,
+	std::string_view hash,
+	fs::path const &output_file
 )
 {
-	auto const invocation_count = compiler_invocations.size();
+	if (
+		previous_info.has_value()
+		&& previous_info->logical_write_time.has_value()
+		&& hash != ""
+		&& previous_info->hash == hash
+	)
+	{
+		return *previous_info->logical_write_time;
+	}
+	return fs::last_write_time(output_file);
+}
 
-	auto const job_count = std::min(get_job_count(), invocation_count);
-	assert(job_count > 1);
+// 'diagnostics_flags' are only added to the command line that is run, they aren't part of the cache key
+static process_result compile(
+	compiler_invocation_t const &invocation,
+	fs::path const &cache_dir,
+	remote_cache *remote,
+	distributed_compiler *distributed,
+	jobserver *shared_jobserver,
+	driver_bypass *bypass,
+	fs::path const &pch_header,
+	cppb::vector<std::string> const &diagnostics_flags,
+	bool capture
+)
+{
+	auto const output_file_info_json = get_output_file_info_json(cache_dir, invocation.output_file);
+	auto const previous_info = read_previous_output_file_info(invocation.output_file, output_file_info_json);
+	if (fs::exists(output_file_info_json))
+	{
+		fs::remove(output_file_info_json);
+	}
 
-	auto pool = thread_pool(job_count);
-	auto compilation_result_futures = compiler_invocations.transform([&](auto const &invocation) {
-		return pool.push_task([&invocation, &cache_dir]() { return compile(invocation, cache_dir, true); });
-	}).collect<cppb::vector>();
+	auto args = invocation.args;
+	if (!diagnostics_flags.empty())
+	{
+		// before '-o <output> <input>', which stay at the end
+		args.insert(args.end() - 3, diagnostics_flags.begin(), diagnostics_flags.end());
+	}
 
-	int const index_width = [&]() {
-		auto i = compiler_invocations.size();
-		int result = 0;
-		do
+	// the last three arguments are '-o <output> <input>', the flags before them are the same for most files;
+	// workers get the expanded arguments, because they can't read local response files
+	auto const result = [&]() {
+		// workers and the driver bypass would skip the launcher
+		if (!invocation.launcher.empty())
 		{
-			++result;
-			i /= 10;
-		} while (i != 0);
-		return result;
-	}();
-
-	auto compilation_results = cppb::vector<process_result>();
-	compilation_results.reserve(compilation_result_futures.size());
-	for (std::size_t i = 0; i < invocation_count; ++i)
-	{
-		auto const filename = fs::relative(compiler_invocations[i].input_file).generic_string();
-		fmt::print("({:{}}/{}) {}\n", i + 1, index_width, compiler_invocations.size(), filename);
-		std::fflush(stdout);
-		if (ctcli::option_value<"build --verbose">)
+			auto launcher_args = cppb::vector<std::string>();
+			launcher_args.push_back(invocation.compiler);
+			launcher_args.append(get_process_arguments(invocation.compiler, args, 3));
+			return run_command(invocation.launcher, launcher_args, capture);
+		}
+		if (distributed != nullptr)
 		{
-			print_command(compiler_invocations[i].compiler, compiler_invocations[i].args);
+			return distributed->compile(
+				invocation.compiler, args, invocation.input_file, invocation.output_file, pch_header, capture, shared_jobserver
+			);
 		}
-
-		// block until the process has finished running
-		compilation_results.push_back(compilation_result_futures[i].get());
-		auto const &compilation_result = compilation_results.back();
-
-		// print the output of the compiler, if there is any
-		auto const output = compilation_result.stdout_string + compilation_result.stderr_string;
-		if (output != "")
+		if (bypass != nullptr)
 		{
-			if (output.ends_with('\n'))
+			if (auto bypass_result = bypass->compile(invocation.compiler, args, invocation.input_file, invocation.output_file, capture))
 			{
-				fmt::print("{}", output);
+				return std::move(*bypass_result);
 			}
-			else
+		}
+		return run_command(invocation.compiler, get_process_arguments(invocation.compiler, args, 3), capture);
+	}();
+
+	if (result.exit_code == 0)
+	{
+		auto const hash = hash_file(invocation.output_file);
+		auto const logical_write_time = get_new_logical_write_time(previous_info, hash, invocation.output_file);
+		write_output_file_info_json(
+			output_file_info_json,
+			invocation.compiler, invocation.args, hash, logical_write_time, invocation.token_fingerprint
+		);
+
+		if (remote != nullptr && !invocation.remote_cache_key.empty())
+		{
+			if (auto object = read_binary_file(invocation.output_file))
 			{
-				fmt::print("{}\n", output);
+				remote->put_async(invocation.remote_cache_key, std::move(*object));
 			}
 		}
 	}
 
-	return compilation_results;
+	return result;
+}
+
+struct project_compiler_invocations_t
+{
+	std::optional<compiler_invocation_t> c_pch;
+	std::optional<compiler_invocation_t> cpp_pch;
+	cppb::vector<compiler_invocation_t> translation_units;
+	// the generated files of unity builds, with the batched sources as dependencies
+	cppb::vector<source_file> unity_sources;
+	// the entries of compile_commands.json, sorted by source file
+	cppb::vector<compile_command> compile_commands;
+	bool is_any_c;
+	bool is_any_cpp;
+};
+
+// the header of the pre-compiled header that is used by 'invocation', or an empty path if there's none
+static fs::path get_pch_header(project_compiler_invocations_t const &invocations, compiler_invocation_t const &invocation)
+{
+	auto const &pch = invocation.input_file.extension() == ".c" ? invocations.c_pch : invocations.cpp_pch;
+	return pch.has_value() ? pch->input_file : fs::path();
 }
 
-static int run_commands_sequential(
-	cppb::span<compiler_invocation_t const> compiler_invocations,
-	fs::path const &cache_dir
+static constexpr std::uintmax_t default_unity_batch_size = 256 * 1024;
+// a source that was edited in this many builds within the time window is compiled on its own
+static constexpr std::uint32_t frequent_edit_count = 2;
+static constexpr std::int64_t frequent_edit_window = 7 * 24 * 60 * 60; // one week in seconds
+
+// updates the edit history of the sources, and returns the ones that are edited frequently
+static std::unordered_set<std::string> get_frequently_edited_sources(
+	cppb::vector<source_file> const &source_files,
+	build_state &state
 )
 {
-	int const index_width = [&]() {
-		auto i = compiler_invocations.size();
-		int result = 0;
-		do
-		{
-			++result;
-			i /= 10;
-		} while (i != 0);
-		return result;
-	}();
+	std::erase_if(state.source_edits, [](auto const &source) { return !fs::exists(source.first); });
 
-	for (std::size_t i = 0; i < compiler_invocations.size(); ++i)
+	auto const current_time = get_current_time();
+	std::unordered_set<std::string> result;
+	for (auto const &source : source_files)
 	{
-		auto const &invocation = compiler_invocations[i];
-		auto const filename = fs::relative(invocation.input_file).generic_string();
-		fmt::print("({:{}}/{}) {}\n", i + 1, index_width, compiler_invocations.size(), filename);
-		std::fflush(stdout);
-		if (ctcli::option_value<"build --verbose">)
+		auto const is_source = source_extensions.is_any([&source](auto const extension) {
+			return source.file_path.extension().generic_string() == extension;
+		});
+		if (!is_source)
 		{
-			print_command(invocation.compiler, invocation.args);
+			continue;
 		}
 
-		auto const result = compile(invocation, cache_dir, false);
-		if (result.exit_code != 0)
+		std::error_code ec;
+		auto const last_write_time = fs::last_write_time(source.file_path, ec);
+		if (ec)
 		{
-			return result.exit_code;
+			continue;
 		}
-	}
 
-	return 0;
+		auto const key = source.file_path.generic_string();
+		auto const [it, is_new] = state.source_edits.insert({ key, source_edit_state{ .last_write_time = last_write_time } });
+		auto &edit_state = it->second;
+		if (!is_new && edit_state.last_write_time != last_write_time)
+		{
+			edit_state.last_write_time = last_write_time;
+			edit_state.edit_count += 1;
+			edit_state.last_edit_time = current_time;
+		}
+
+		if (
+			edit_state.edit_count >= frequent_edit_count
+			&& current_time - edit_state.last_edit_time <= frequent_edit_window
+		)
+		{
+			result.insert(key);
+		}
+	}
+	return result;
 }
 
-struct project_compiler_invocations_t
+// writes the file only if its content changed, so the batch isn't recompiled needlessly
+static bool write_unity_file(fs::path const &file, std::string const &content)
 {
-	std::optional<compiler_invocation_t> c_pch;
-	std::optional<compiler_invocation_t> cpp_pch;
-	cppb::vector<compiler_invocation_t> translation_units;
-	bool is_any_c;
-	bool is_any_cpp;
-};
+	if (auto const previous_content = read_binary_file(file); previous_content == content)
+	{
+		return true;
+	}
+
+	std::ofstream output(file, std::ios::binary | std::ios::trunc);
+	output.write(content.data(), static_cast<std::streamsize>(content.size()));
+	return output.good();
+}
 
 static std::optional<compiler_invocation_t> get_pch_compiler_invocation(
 	config const &build_config,
@@ -691,6 +1035,7 @@ static std::optional<compiler_invocation_t> get_pch_compiler_invocation(
 	fs::path const &intermediate_bin_directory,
 	fs::path const &header_file,
 	std::string_view compiler,
+	fs::path const &compiler_launcher,
 	cppb::vector<std::string> &compiler_args,
 	std::string_view header_type // c-header or c++-header
 )
@@ -737,10 +1082,13 @@ static std::optional<compiler_invocation_t> get_pch_compiler_invocation(
 
 	auto result = compiler_invocation_t{
 		.compiler = std::string(compiler),
+		.launcher = compiler_launcher.string(),
 		.args = compiler_args,
 		.input_file = header_it->file_path,
 		.input_file_last_modified = header_it->last_modified_time,
 		.output_file = pch_file,
+		.remote_cache_key = "",
+		.token_fingerprint = "",
 	};
 
 	compiler_args.resize(compiler_args_size);
@@ -758,10 +1106,13 @@ static std::optional<compiler_invocation_t> get_pch_compiler_invocation(
 	return result;
 }
 
+// with 'unity_build', the sources in the same directory are compiled in batches,
+// except for the ones in 'unity_excluded_sources'
 static std::optional<project_compiler_invocations_t> get_compiler_invocations(
 	config const &build_config,
 	cppb::vector<source_file> const &source_files,
-	fs::path const &intermediate_bin_directory
+	fs::path const &intermediate_bin_directory,
+	std::unordered_set<std::string> const &unity_excluded_sources = {}
 )
 {
 	project_compiler_invocations_t result;
@@ -780,6 +1131,7 @@ static std::optional<project_compiler_invocations_t> get_compiler_invocations(
 			intermediate_bin_directory,
 			build_config.c_precompiled_header,
 			c_compiler,
+			build_config.c_compiler_launcher,
 			c_compiler_args,
 			"c-header"
 		);
@@ -797,6 +1149,7 @@ static std::optional<project_compiler_invocations_t> get_compiler_invocations(
 			intermediate_bin_directory,
 			build_config.cpp_precompiled_header,
 			cpp_compiler,
+			build_config.cpp_compiler_launcher,
 			cpp_compiler_args,
 			"c++-header"
 		);
@@ -842,6 +1195,62 @@ static std::optional<project_compiler_invocations_t> get_compiler_invocations(
 	cppb::vector<compile_command> compile_commands;
 	compile_commands.reserve(compilation_units.size());
 
+	auto const unity_batch_size = build_config.unity_build
+		? parse_cache_size(build_config.unity_batch_size).value_or(default_unity_batch_size)
+		: 0;
+	// indices into 'compilation_units'
+	cppb::vector<cppb::vector<std::size_t>> unity_batches;
+	auto is_batched = cppb::vector<char>();
+	is_batched.resize(compilation_units.size(), false);
+	if (build_config.unity_build)
+	{
+		// 'compilation_units' is sorted, so the sources of a directory are next to each other
+		auto current_batch_size = std::uintmax_t(0);
+		auto current_batch = [&]() -> cppb::vector<std::size_t> & { return unity_batches.back(); };
+		for (std::size_t i = 0; i < compilation_units.size(); ++i)
+		{
+			auto const &source_file = compilation_units[i].file_path;
+			if (unity_excluded_sources.contains(source_file.generic_string()))
+			{
+				continue;
+			}
+
+			std::error_code ec;
+			auto const file_size = fs::file_size(source_file, ec);
+			if (ec)
+			{
+				continue;
+			}
+
+			auto const is_new_batch = [&]() {
+				if (unity_batches.empty() || current_batch_size + file_size > unity_batch_size)
+				{
+					return true;
+				}
+				auto const &batch_source = compilation_units[current_batch().back()].file_path;
+				return batch_source.parent_path() != source_file.parent_path()
+					|| (batch_source.extension() == ".c") != (source_file.extension() == ".c");
+			}();
+			if (is_new_batch)
+			{
+				unity_batches.emplace_back();
+				current_batch_size = 0;
+			}
+			current_batch().push_back(i);
+			current_batch_size += file_size;
+		}
+
+		// a batch with a single source is just a regular translation unit
+		std::erase_if(unity_batches, [](auto const &batch) { return batch.size() < 2; });
+		for (auto const &batch : unity_batches)
+		{
+			for (auto const i : batch)
+			{
+				is_batched[i] = true;
+			}
+		}
+	}
+
 	// source file compilation
 	for (std::size_t i = 0; i < compilation_units.size(); ++i)
 	{
@@ -862,337 +1271,1872 @@ static std::optional<project_compiler_invocations_t> get_compiler_invocations(
 		args.emplace_back(object_file.generic_string());
 		args.emplace_back(source_file_name);
 
-		result.translation_units.push_back(compiler_invocation_t{
-			.compiler = std::string(is_c_source ? c_compiler : cpp_compiler),
-			.args = args,
-			.input_file = source_file,
-			.input_file_last_modified = source.last_modified_time,
-			.output_file = std::move(object_file),
-		});
+		// batched sources are still listed in compile_commands.json for tools that work on single files
+		if (!is_batched[i])
+		{
+			result.translation_units.push_back(compiler_invocation_t{
+				.compiler = std::string(is_c_source ? c_compiler : cpp_compiler),
+				.launcher = (is_c_source ? build_config.c_compiler_launcher : build_config.cpp_compiler_launcher).string(),
+				.args = args,
+				.input_file = source_file,
+				.input_file_last_modified = source.last_modified_time,
+				.output_file = std::move(object_file),
+				.remote_cache_key = "",
+				.token_fingerprint = "",
+			});
+		}
 
-		compile_commands.push_back({ std::move(source_file_name), args });
+		// without the launcher, tools that read compile_commands.json expect the compiler first
+		compile_commands.push_back({ std::string(is_c_source ? c_compiler : cpp_compiler), std::move(source_file_name), args });
 		args.resize(args_old_size);
 	}
 
-	compile_commands.sort([](auto const &lhs, auto const &rhs) { return lhs.source_file < rhs.source_file; });
-	if (build_config.emit_compile_commands)
-	{
-		write_compile_commands_json(compile_commands);
-	}
+	// unity batches; the batches of a directory are numbered in order, so the file names are stable
+	// as long as the same sources are batched together
+	auto batch_numbers = std::unordered_map<std::string, std::size_t>();
+	for (auto const &batch : unity_batches)
+	{
+		auto const &first_source_file = compilation_units[batch[0]].file_path;
+		auto const is_c_source = first_source_file.extension() == ".c";
+		auto const unity_directory = (
+			intermediate_bin_directory / ".unity"
+			/ fs::relative(first_source_file.parent_path(), build_config.source_directory)
+		).lexically_normal();
+		auto &batch_number = batch_numbers[unity_directory.generic_string()];
+		auto const unity_file = unity_directory / fmt::format("unity_{}{}", batch_number, is_c_source ? ".c" : ".cpp");
+		batch_number += 1;
+
+		auto unity_source = source_file{
+			.file_path = unity_file,
+			.dependencies = {},
+			.last_modified_time = fs::file_time_type::min(),
+			.file_size = 0,
+		};
+		std::string content;
+		// gcc only uses a pre-compiled header if it's included before anything else
+		auto const &precompiled_header = is_c_source ? build_config.c_precompiled_header : build_config.cpp_precompiled_header;
+		if (build_config.compiler == compiler_kind::gcc && !precompiled_header.empty())
+		{
+			auto const header_file = fs::absolute(precompiled_header).lexically_normal();
+			content += fmt::format("#include \"{}\"\n", header_file.generic_string());
+			unity_source.dependencies.push_back(header_file);
+		}
+		for (auto const i : batch)
+		{
+			auto const &source = compilation_units[i];
+			content += fmt::format("#include \"{}\"\n", source.file_path.generic_string());
+			unity_source.dependencies.push_back(source.file_path);
+			unity_source.last_modified_time = std::max(unity_source.last_modified_time, source.last_modified_time);
+		}
 
-	return std::move(result);
-}
+		fs::create_directories(unity_directory);
+		if (!write_unity_file(unity_file, content))
+		{
+			report_error(unity_file.generic_string(), "unable to write unity build file");
+			return std::nullopt;
+		}
+		unity_source.last_modified_time = std::max(unity_source.last_modified_time, fs::last_write_time(unity_file));
+		unity_source.file_size = content.size();
 
-static build_result_t build_project(
-	config const &build_config,
+		auto object_file = unity_file;
+		object_file += ".o";
+		auto &args = is_c_source ? c_compiler_args : cpp_compiler_args;
+		auto const args_old_size = args.size();
+		args.emplace_back("-o");
+		args.emplace_back(object_file.generic_string());
+		args.emplace_back(unity_file.generic_string());
+
+		result.translation_units.push_back(compiler_invocation_t{
+			.compiler = std::string(is_c_source ? c_compiler : cpp_compiler),
+			.launcher = (is_c_source ? build_config.c_compiler_launcher : build_config.cpp_compiler_launcher).string(),
+			.args = args,
+			.input_file = unity_file,
+			.input_file_last_modified = unity_source.last_modified_time,
+			.output_file = std::move(object_file),
+			.remote_cache_key = "",
+			.token_fingerprint = "",
+		});
+		result.unity_sources.push_back(std::move(unity_source));
+		args.resize(args_old_size);
+	}
+
+	compile_commands.sort([](auto const &lhs, auto const &rhs) { return lhs.source_file < rhs.source_file; });
+	result.compile_commands = std::move(compile_commands);
+
+	return std::move(result);
+}
+
+static cppb::vector<fs::path> get_dependency_closure(
+	fs::path const &file,
 	cppb::vector<source_file> const &source_files,
-	fs::path const &intermediate_bin_directory,
-	fs::path const &cache_dir
+	std::unordered_map<std::string, std::size_t> const &source_file_indices
+)
+{
+	cppb::vector<fs::path> result;
+	std::unordered_set<std::string> visited;
+	cppb::vector<fs::path> files_to_visit;
+	files_to_visit.push_back(file);
+	while (!files_to_visit.empty())
+	{
+		auto current = std::move(files_to_visit.back());
+		files_to_visit.pop_back();
+		if (!visited.insert(current.generic_string()).second)
+		{
+			continue;
+		}
+		if (auto const it = source_file_indices.find(current.generic_string()); it != source_file_indices.end())
+		{
+			files_to_visit.append(source_files[it->second].dependencies);
+		}
+		result.push_back(std::move(current));
+	}
+	return result;
+}
+
+// updates the token fingerprints of files that were written since the last build,
+// and fills the combined fingerprint of the dependency closure of every invocation
+static void fill_token_fingerprints(
+	project_compiler_invocations_t &project_invocations,
+	cppb::vector<source_file> const &source_files,
+	build_state &state,
+	thread_pool &pool
+)
+{
+	std::erase_if(state.sources, [](auto const &source) { return !fs::exists(source.first); });
+
+	{
+		// the tasks only read this snapshot, because 'state.sources' is updated after they finish
+		auto const previous_write_times = source_files
+			.transform([&](source_file const &source) -> std::optional<fs::file_time_type> {
+				auto const it = state.sources.find(source.file_path.generic_string());
+				return it != state.sources.end() ? std::optional(it->second.last_write_time) : std::nullopt;
+			})
+			.collect<cppb::vector>();
+		auto futures = cppb::vector<std::future<std::optional<source_state>>>();
+		futures.reserve(source_files.size());
+		for (std::size_t i = 0; i < source_files.size(); ++i)
+		{
+			futures.push_back(pool.push_task([&source = source_files[i], previous_write_time = previous_write_times[i]]() -> std::optional<source_state> {
+				std::error_code ec;
+				auto const last_write_time = fs::last_write_time(source.file_path, ec);
+				if (ec || previous_write_time == last_write_time)
+				{
+					return std::nullopt;
+				}
+				return source_state{
+					.last_write_time = last_write_time,
+					.token_fingerprint = get_token_fingerprint(source.file_path),
+				};
+			}));
+		}
+		// every task has to finish before 'state.sources' is changed
+		auto new_states = cppb::vector<std::optional<source_state>>();
+		new_states.reserve(futures.size());
+		for (auto &future : futures)
+		{
+			new_states.push_back(future.get());
+		}
+		for (std::size_t i = 0; i < source_files.size(); ++i)
+		{
+			if (new_states[i].has_value())
+			{
+				state.sources.insert_or_assign(source_files[i].file_path.generic_string(), std::move(*new_states[i]));
+			}
+		}
+	}
+
+	std::unordered_map<std::string, std::size_t> source_file_indices;
+	for (std::size_t i = 0; i < source_files.size(); ++i)
+	{
+		source_file_indices.insert({ source_files[i].file_path.generic_string(), i });
+	}
+
+	auto const fill_token_fingerprint = [&](compiler_invocation_t &invocation) {
+		auto closure = get_dependency_closure(invocation.input_file, source_files, source_file_indices)
+			.transform([](auto const &file) { return file.generic_string(); })
+			.collect<cppb::vector>();
+		std::sort(closure.begin(), closure.end());
+
+		std::string fingerprint_data = "cppb-token-fingerprint-1\n";
+		for (auto const &file : closure)
+		{
+			auto const it = state.sources.find(file);
+			if (it == state.sources.end())
+			{
+				// a file we couldn't fingerprint; fall back to regular timestamp checks
+				invocation.token_fingerprint.clear();
+				return;
+			}
+			fingerprint_data += file;
+			fingerprint_data += '\0';
+			fingerprint_data += it->second.token_fingerprint;
+			fingerprint_data += '\n';
+		}
+		invocation.token_fingerprint = hash_string(fingerprint_data);
+	};
+
+	if (project_invocations.c_pch.has_value())
+	{
+		fill_token_fingerprint(*project_invocations.c_pch);
+	}
+	if (project_invocations.cpp_pch.has_value())
+	{
+		fill_token_fingerprint(*project_invocations.cpp_pch);
+	}
+	for (auto &invocation : project_invocations.translation_units)
+	{
+		fill_token_fingerprint(invocation);
+	}
+}
+
+// replaces the project directory in absolute paths with '.', so that checkouts
+// of the same project in different directories share the remote cache
+static std::string make_root_relative(std::string_view text, std::string_view root)
+{
+	std::string result;
+	result.reserve(text.size());
+	while (true)
+	{
+		auto const pos = text.find(root);
+		if (pos == std::string_view::npos)
+		{
+			result += text;
+			return result;
+		}
+		result += text.substr(0, pos);
+		result += '.';
+		text.remove_prefix(pos + root.size());
+	}
+}
+
+// only linemarkers are made relative, paths in string literals, e.g. from __FILE__,
+// end up in the object file
+static std::string normalize_preprocessed_output(std::string_view output, std::string_view root)
+{
+	std::string result;
+	result.reserve(output.size());
+	while (!output.empty())
+	{
+		auto const line_end = output.find('\n');
+		auto const line = output.substr(0, line_end == std::string_view::npos ? output.size() : line_end + 1);
+		output.remove_prefix(line.size());
+		if (line.starts_with('#'))
+		{
+			result += make_root_relative(line, root);
+		}
+		else
+		{
+			result += line;
+		}
+	}
+	return result;
+}
+
+static bool has_debug_info_arg(cppb::vector<std::string> const &args)
+{
+	return args.is_any([](std::string_view arg) {
+		return arg.starts_with("-g") && arg != "-g0" && arg != "-ggdb0";
+	});
+}
+
+// the arguments used to preprocess a translation unit for its remote cache key;
+// with clang the pre-compiled header may not exist yet, so the header itself is included instead
+static cppb::vector<std::string> get_preprocess_args(
+	compiler_invocation_t const &invocation,
+	project_compiler_invocations_t const &project_invocations
+)
+{
+	cppb::vector<std::string> result;
+	result.reserve(invocation.args.size() + 1);
+	for (std::size_t i = 0; i < invocation.args.size(); ++i)
+	{
+		auto const &arg = invocation.args[i];
+		if (arg == "-o" && i + 1 < invocation.args.size())
+		{
+			i += 1;
+		}
+		else if (arg == "-include-pch" && i + 1 < invocation.args.size())
+		{
+			if (auto const pch_header = get_pch_header(project_invocations, invocation); !pch_header.empty())
+			{
+				result.push_back("-include");
+				result.push_back(pch_header.generic_string());
+			}
+			i += 1;
+		}
+		else
+		{
+			result.push_back(arg);
+		}
+	}
+	result.push_back("-E");
+	return result;
+}
+
+// the remote cache key of a translation unit is a hash of the compiler identity, the arguments
+// and the preprocessed source, which includes every header, the system headers too.
+// paths inside the project directory are made relative to it, except with debug info,
+// which stores the absolute paths of the sources.
+// the key is empty if the compiler can't be run or the source can't be preprocessed.
+// it's computed by the compile node of the translation unit, so the preprocessor runs in a process slot
+static std::string get_remote_cache_key(
+	compiler_invocation_t const &invocation,
+	project_compiler_invocations_t const &project_invocations
+)
+{
+	auto const compiler_identity = get_compiler_identity(invocation.compiler);
+	if (compiler_identity.empty())
+	{
+		return "";
+	}
+	auto const preprocessed = run_command(invocation.compiler, get_preprocess_args(invocation, project_invocations), true);
+	if (preprocessed.exit_code != 0)
+	{
+		return "";
+	}
+
+	auto const root = fs::current_path().generic_string();
+	std::string key_data = "cppb-remote-cache-2\n";
+	key_data += compiler_identity;
+	key_data += '\n';
+	if (has_debug_info_arg(invocation.args))
+	{
+		key_data += root;
+		key_data += '\n';
+	}
+	for (auto const &arg : invocation.args)
+	{
+		key_data += make_root_relative(arg, root);
+		key_data += '\0';
+	}
+	key_data += '\n';
+	key_data += hash_string(normalize_preprocessed_output(preprocessed.stdout_string, root));
+	return hash_string(key_data);
+}
+
+// returns whether the object file was fetched from the remote cache
+static bool fetch_from_remote_cache(compiler_invocation_t const &invocation, fs::path const &cache_dir, remote_cache &remote)
+{
+	auto const object = remote.get(invocation.remote_cache_key);
+	if (!object.has_value())
+	{
+		return false;
+	}
+
+	auto const output_file_info_json = get_output_file_info_json(cache_dir, invocation.output_file);
+	auto const previous_info = read_previous_output_file_info(invocation.output_file, output_file_info_json);
+	if (fs::exists(output_file_info_json))
+	{
+		fs::remove(output_file_info_json);
+	}
+
+	auto const is_written = [&]() {
+		std::ofstream output(invocation.output_file, std::ios::binary);
+		output.write(object->data(), static_cast<std::streamsize>(object->size()));
+		return output.good();
+	}();
+	if (!is_written)
+	{
+		return false;
+	}
+
+	auto const hash = hash_file(invocation.output_file);
+	auto const logical_write_time = get_new_logical_write_time(previous_info, hash, invocation.output_file);
+	write_output_file_info_json(
+		output_file_info_json,
+		invocation.compiler, invocation.args, hash, logical_write_time, invocation.token_fingerprint
+	);
+	return true;
+}
+
+// lists the files in the dependency closure of the invocation that were written after its output, newest first
+static cppb::vector<std::string> get_newer_inputs(
+	compiler_invocation_t const &invocation,
+	cppb::vector<source_file> const &source_files,
+	std::unordered_map<std::string, std::size_t> const &source_file_indices
+)
+{
+	std::error_code ec;
+	auto const output_last_update = fs::last_write_time(invocation.output_file, ec);
+	if (ec)
+	{
+		return {};
+	}
+
+	auto newer_inputs = get_dependency_closure(invocation.input_file, source_files, source_file_indices)
+		.transform([](auto const &file) {
+			std::error_code ec;
+			return std::make_pair(fs::last_write_time(file, ec), file);
+		})
+		.filter([&](auto const &file) { return file.first > output_last_update; })
+		.collect<cppb::vector>();
+	std::sort(newer_inputs.begin(), newer_inputs.end(), [](auto const &lhs, auto const &rhs) {
+		return lhs.first > rhs.first;
+	});
+	return newer_inputs
+		.transform([](auto const &file) { return fs::relative(file.second).generic_string(); })
+		.collect<cppb::vector>();
+}
+
+static void explain_rebuild_reasons(
+	std::string_view project_name,
+	project_compiler_invocations_t const &invocations,
+	std::optional<rebuild_reason> const &c_pch_reason,
+	std::optional<rebuild_reason> const &cpp_pch_reason,
+	cppb::vector<rebuild_reason> const &reasons,
+	cppb::vector<source_file> const &source_files,
+	std::chrono::steady_clock::duration check_time
+)
+{
+	std::unordered_map<std::string, std::size_t> source_file_indices;
+	for (std::size_t i = 0; i < source_files.size(); ++i)
+	{
+		source_file_indices.insert({ source_files[i].file_path.generic_string(), i });
+	}
+
+	auto explanation = build_explanation{
+		.project_name = std::string(project_name),
+		.config_name = std::string(os::config_name()),
+		.check_time_ms = std::chrono::duration<double, std::milli>(check_time).count(),
+		.outputs = {},
+	};
+	auto const add_output = [&](compiler_invocation_t const &invocation, rebuild_reason const &reason) {
+		explanation.outputs.push_back({
+			.input_file = fs::relative(invocation.input_file).generic_string(),
+			.output_file = fs::relative(invocation.output_file).generic_string(),
+			.reason = reason,
+			.newer_inputs = reason.kind == rebuild_reason_kind::input_newer
+				? get_newer_inputs(invocation, source_files, source_file_indices)
+				: cppb::vector<std::string>(),
+		});
+	};
+
+	if (c_pch_reason.has_value())
+	{
+		add_output(*invocations.c_pch, *c_pch_reason);
+	}
+	if (cpp_pch_reason.has_value())
+	{
+		add_output(*invocations.cpp_pch, *cpp_pch_reason);
+	}
+	for (std::size_t i = 0; i < reasons.size(); ++i)
+	{
+		add_output(invocations.translation_units[i], reasons[i]);
+	}
+
+	if (ctcli::option_value<"build --explain">)
+	{
+		print_build_explanation(explanation);
+	}
+	if (ctcli::is_option_set<"build --explain-json">())
+	{
+		write_build_explanation_json(ctcli::option_value<"build --explain-json">, explanation);
+	}
+}
+
+struct expected_build_durations_t
+{
+	std::int64_t c_pch = 0;
+	std::int64_t cpp_pch = 0;
+	cppb::vector<std::int64_t> translation_units{};
+	std::int64_t link = 0;
+};
+
+// the compile and link times of the previous build in milliseconds, 0 if nothing was recorded
+static expected_build_durations_t get_recorded_build_durations(
+	project_compiler_invocations_t const &project_invocations,
+	build_state const &state,
+	fs::path const &executable_file
+)
+{
+	auto const get_recorded_duration = [&](compiler_invocation_t const &invocation) {
+		auto const it = state.outputs.find(get_build_state_key(invocation.output_file));
+		return it == state.outputs.end() ? std::int64_t(0) : it->second.build_duration;
+	};
+
+	auto result = expected_build_durations_t{};
+	if (project_invocations.c_pch.has_value())
+	{
+		result.c_pch = get_recorded_duration(*project_invocations.c_pch);
+	}
+	if (project_invocations.cpp_pch.has_value())
+	{
+		result.cpp_pch = get_recorded_duration(*project_invocations.cpp_pch);
+	}
+	result.translation_units = project_invocations.translation_units
+		.transform(get_recorded_duration)
+		.collect<cppb::vector>();
+	if (auto const it = state.link_durations.find(get_build_state_key(executable_file)); it != state.link_durations.end())
+	{
+		result.link = it->second;
+	}
+	return result;
+}
+
+// files without a recorded compile time are estimated from the size of the project files they include,
+// using the speed of the files with one.  nothing is done if every file has a recorded time, e.g. on a
+// no-op build; the sizes from the scanner are used, so only files read from the dependency file are stat'ed
+static void estimate_missing_build_durations(
+	expected_build_durations_t &durations,
+	project_compiler_invocations_t const &project_invocations,
+	cppb::vector<source_file> const &source_files
+)
+{
+	// only the relative order of the estimates matters if nothing was recorded yet
+	constexpr std::uintmax_t default_bytes_per_millisecond = 100;
+
+	cppb::vector<std::pair<compiler_invocation_t const *, std::int64_t *>> invocations;
+	if (project_invocations.c_pch.has_value())
+	{
+		invocations.push_back({ &*project_invocations.c_pch, &durations.c_pch });
+	}
+	if (project_invocations.cpp_pch.has_value())
+	{
+		invocations.push_back({ &*project_invocations.cpp_pch, &durations.cpp_pch });
+	}
+	for (std::size_t i = 0; i < project_invocations.translation_units.size(); ++i)
+	{
+		invocations.push_back({ &project_invocations.translation_units[i], &durations.translation_units[i] });
+	}
+	if (invocations.is_all([](auto const &invocation) { return *invocation.second != 0; }))
+	{
+		return;
+	}
+
+	std::unordered_map<std::string, std::size_t> source_file_indices;
+	for (std::size_t i = 0; i < source_files.size(); ++i)
+	{
+		source_file_indices.insert({ source_files[i].file_path.generic_string(), i });
+	}
+	// headers are shared by many translation units, so every file is only stat'ed once
+	std::unordered_map<std::string, std::uintmax_t> file_sizes;
+	auto const get_file_size = [&](fs::path const &file) {
+		auto const key = file.generic_string();
+		if (auto const it = source_file_indices.find(key); it != source_file_indices.end() && source_files[it->second].file_size != 0)
+		{
+			return source_files[it->second].file_size;
+		}
+		auto const [it, is_inserted] = file_sizes.insert({ key, 0 });
+		if (is_inserted)
+		{
+			std::error_code ec;
+			auto const size = fs::file_size(file, ec);
+			it->second = ec ? std::uintmax_t(0) : size;
+		}
+		return it->second;
+	};
+	auto const get_input_size = [&](compiler_invocation_t const &invocation) {
+		return get_dependency_closure(invocation.input_file, source_files, source_file_indices)
+			.transform(get_file_size)
+			.sum();
+	};
+
+	auto const input_sizes = invocations
+		.transform([&](auto const &invocation) { return get_input_size(*invocation.first); })
+		.collect<cppb::vector>();
+
+	std::uintmax_t recorded_size = 0;
+	std::int64_t recorded_duration = 0;
+	for (std::size_t i = 0; i < invocations.size(); ++i)
+	{
+		if (*invocations[i].second != 0)
+		{
+			recorded_size += input_sizes[i];
+			recorded_duration += *invocations[i].second;
+		}
+	}
+	auto const milliseconds_per_byte = recorded_size != 0 && recorded_duration != 0
+		? static_cast<double>(recorded_duration) / static_cast<double>(recorded_size)
+		: 1.0 / static_cast<double>(default_bytes_per_millisecond);
+	for (std::size_t i = 0; i < invocations.size(); ++i)
+	{
+		if (*invocations[i].second == 0)
+		{
+			*invocations[i].second = std::max(
+				static_cast<std::int64_t>(static_cast<double>(input_sizes[i]) * milliseconds_per_byte),
+				std::int64_t(1)
+			);
+		}
+	}
+}
+
+struct expected_peak_memory_t
+{
+	std::uint64_t c_pch = 0;
+	std::uint64_t cpp_pch = 0;
+	cppb::vector<std::uint64_t> translation_units{};
+};
+
+// the peak memory use of each compilation in the previous build in bytes; files without a recorded value
+// are assumed to use the average of the others, or 0 if nothing was recorded
+static expected_peak_memory_t get_expected_peak_memory(
+	project_compiler_invocations_t const &project_invocations,
+	build_state const &state
 )
 {
-	auto const invocations = get_compiler_invocations(build_config, source_files, intermediate_bin_directory);
-	if (!invocations.has_value())
+	auto const get_recorded_peak_memory = [&](compiler_invocation_t const &invocation) {
+		auto const it = state.outputs.find(get_build_state_key(invocation.output_file));
+		return it == state.outputs.end() ? std::uint64_t(0) : it->second.usage.peak_memory;
+	};
+
+	auto result = expected_peak_memory_t{
+		.c_pch = project_invocations.c_pch.has_value() ? get_recorded_peak_memory(*project_invocations.c_pch) : 0,
+		.cpp_pch = project_invocations.cpp_pch.has_value() ? get_recorded_peak_memory(*project_invocations.cpp_pch) : 0,
+		.translation_units = project_invocations.translation_units
+			.transform(get_recorded_peak_memory)
+			.collect<cppb::vector>(),
+	};
+
+	auto const recorded_count = std::count_if(
+		result.translation_units.begin(), result.translation_units.end(),
+		[](auto const peak_memory) { return peak_memory != 0; }
+	);
+	if (recorded_count != 0)
+	{
+		auto const average = result.translation_units.sum() / static_cast<std::uint64_t>(recorded_count);
+		for (auto &peak_memory : result.translation_units)
+		{
+			if (peak_memory == 0)
+			{
+				peak_memory = average;
+			}
+		}
+	}
+	return result;
+}
+
+// state shared by every project that's built in one invocation
+struct shared_build_t
+{
+	cppb::vector<rule> const &rules;
+	fs::path const &cache_dir;
+	build_state &state;
+	remote_cache *remote;
+	// translation units are compiled on workers if the local slots are in use, pre-compiled headers are always local
+	distributed_compiler *distributed;
+	// sized for the local process slots only; nullptr if no jobserver could be created
+	jobserver *shared_jobserver;
+	// nullptr without --bypass-driver; not used for pre-compiled headers, which the driver handles differently
+	driver_bypass *bypass;
+	fs::file_time_type config_last_update;
+	// compiler output is captured and printed when a process finishes if more than one job can run at a time
+	bool capture_output;
+	output_queue &output;
+	executor &thread_pools;
+	// the name of the project is printed with every compiled file if more than one project is built
+	bool is_multi_project;
+	// with --ordered-output, every project takes a range of sequence numbers for its translation units
+	// when it's planned, so the numbers of different projects don't collide
+	std::atomic<std::size_t> sequence_number_count{ 0 };
+	// the compile_commands.json entries of every project with 'emit_compile_commands',
+	// written once after the build; guarded by 'state_mutex'
+	cppb::vector<compile_command> compile_commands{};
+
+	// 'state' is read and written by the nodes of every project
+	std::mutex state_mutex{};
+	// with --structured-diagnostics, a diagnostic is only printed the first time it's seen, e.g. a warning
+	// in a header that is included by many files; these are only used on the output thread
+	std::unordered_set<std::string> printed_diagnostics{};
+	std::size_t duplicate_diagnostic_count = 0;
+	// the same rule may be used by more than one project, so rules are run one at a time;
+	// 'state.rule_usages' is only written by rules, so it's guarded by this instead of 'state_mutex'
+	std::mutex rules_mutex{};
+	// the number of files to compile isn't known until every check has finished
+	std::atomic<std::size_t> compile_count{ 0 };
+	std::atomic<std::size_t> compiled_count{ 0 };
+};
+
+// state shared by the nodes of the build graph of a project
+struct project_build_t
+{
+	shared_build_t &shared;
+	project_config const &project;
+	config const &build_config;
+	fs::path bin_directory;
+	fs::path intermediate_bin_directory;
+	// empty without --structured-diagnostics
+	cppb::vector<std::string> diagnostics_flags{};
+
+	build_graph::node_id prelink_node = 0;
+	// the sequence number of the first translation unit in the output queue
+	std::size_t first_sequence_number = 0;
+
+	// filled by the scanner node
+	cppb::vector<source_file> source_files{};
+	project_compiler_invocations_t invocations{};
+
+	fs::file_time_type c_pch_last_update   = fs::file_time_type::min();
+	fs::file_time_type cpp_pch_last_update = fs::file_time_type::min();
+	std::optional<rebuild_reason> c_pch_reason{};
+	std::optional<rebuild_reason> cpp_pch_reason{};
+
+	// one element for every translation unit; every element is only written by one node at a time
+	cppb::vector<rebuild_reason> reasons{};
+	cppb::vector<char> is_compile_needed{};
+	cppb::vector<std::optional<process_result>> compilation_results{};
+	// in milliseconds, 0 if the file wasn't compiled successfully
+	cppb::vector<std::int64_t> compile_durations{};
+	std::int64_t c_pch_compile_duration = 0;
+	std::int64_t cpp_pch_compile_duration = 0;
+	resource_usage c_pch_usage{};
+	resource_usage cpp_pch_usage{};
+
+	fs::file_time_type link_dependency_last_update{};
+
+	// less than the number of translation units if the build was cancelled before every file was checked
+	std::atomic<std::size_t> checked_count{ 0 };
+	std::atomic<std::chrono::steady_clock::rep> check_time{ 0 };
+};
+
+static void add_check_time(project_build_t &build, std::chrono::steady_clock::time_point check_begin)
+{
+	build.check_time += (std::chrono::steady_clock::now() - check_begin).count();
+}
+
+// the compiler was run with 'diagnostics_flags', so stderr should only contain the diagnostics;
+// on success, the error and warning counts of 'result' are replaced and stderr is cleared
+static std::optional<cppb::vector<diagnostic>> take_structured_diagnostics(project_build_t const &build, process_result &result)
+{
+	if (build.diagnostics_flags.empty())
+	{
+		return std::nullopt;
+	}
+	auto diagnostics = parse_structured_diagnostics(build.build_config.compiler, result.stderr_string);
+	if (!diagnostics.has_value())
+	{
+		// e.g. the compiler crashed, the output is printed as it is
+		return std::nullopt;
+	}
+	result.error_count = diagnostics->error_count;
+	result.warning_count = diagnostics->warning_count;
+	result.stderr_string = std::string();
+	return std::move(diagnostics->diagnostics);
+}
+
+// called on the output thread
+static void print_diagnostics(shared_build_t &shared, cppb::vector<diagnostic> const &diagnostics)
+{
+	std::string output;
+	for (auto const &diag : diagnostics)
+	{
+		auto text = format_diagnostic(diag);
+		if (shared.printed_diagnostics.contains(text))
+		{
+			shared.duplicate_diagnostic_count += 1;
+			continue;
+		}
+		output += text;
+		shared.printed_diagnostics.insert(std::move(text));
+	}
+	fmt::print("{}", output);
+}
+
+static void print_compiler_output(std::string_view stdout_string, std::string_view stderr_string)
+{
+	auto const output = fmt::format("{}{}", stdout_string, stderr_string);
+	if (output != "")
+	{
+		if (output.ends_with('\n'))
+		{
+			fmt::print("{}", output);
+		}
+		else
+		{
+			fmt::print("{}\n", output);
+		}
+	}
+}
+
+static int run_prebuild_rules(project_build_t &build)
+{
+	std::string error;
+	auto const rules_guard = std::lock_guard(build.shared.rules_mutex);
+	auto const [exit_code, any_run, _] = run_rules(
+		"pre-build", build.build_config.prebuild_rules, build.shared.rules, build.shared.config_last_update, error,
+		true, &build.shared.state.rule_usages
+	);
+	if (!error.empty())
+	{
+		report_error("cppb", error);
+		return 1;
+	}
+	return exit_code;
+}
+
+// pre-link and link dependency rules don't depend on the object files, so they can run during compilation
+static int run_prelink_rules(project_build_t &build)
+{
+	std::string error;
+	auto const rules_guard = std::lock_guard(build.shared.rules_mutex);
+
+	auto const [prelink_exit_code, prelink_any_run, prelink_last_update] = run_rules(
+		"pre-link", build.build_config.prelink_rules, build.shared.rules, build.shared.config_last_update, error,
+		true, &build.shared.state.rule_usages
+	);
+	if (!error.empty())
+	{
+		report_error("cppb", error);
+		return 1;
+	}
+	if (prelink_exit_code != 0)
+	{
+		return prelink_exit_code;
+	}
+
+	auto const [link_dep_exit_code, link_dep_any_run, link_dep_last_update] = run_rules(
+		"link dependency", build.build_config.link_dependencies, build.shared.rules, build.shared.config_last_update, error,
+		false, &build.shared.state.rule_usages
+	);
+	if (!error.empty())
+	{
+		report_error("cppb", error);
+		return 1;
+	}
+	if (link_dep_exit_code != 0)
+	{
+		return link_dep_exit_code;
+	}
+
+	build.link_dependency_last_update = std::max({ build.shared.config_last_update, prelink_last_update, link_dep_last_update });
+	return 0;
+}
+
+static int build_pch(project_build_t &build, bool is_c)
+{
+	auto const &invocation = is_c ? *build.invocations.c_pch : *build.invocations.cpp_pch;
+
+	auto const check_begin = std::chrono::steady_clock::now();
+	auto reason = get_rebuild_reason(invocation, build.shared.cache_dir);
+	touch_up_to_date_output(reason, invocation, build.shared.cache_dir);
+	add_check_time(build, check_begin);
+	(is_c ? build.c_pch_reason : build.cpp_pch_reason) = reason;
+
+	if (is_out_of_date(reason))
+	{
+		auto const relative_header_filename = fs::relative(invocation.input_file).generic_string();
+		build.shared.output.push(std::nullopt, [&invocation, relative_header_filename]() {
+			fmt::print("pre-compiling {}\n", relative_header_filename);
+			if (ctcli::option_value<"build --verbose">)
+			{
+				print_command(invocation.compiler, invocation.args);
+			}
+		});
+		if (!build.shared.capture_output)
+		{
+			// the compiler writes directly to the terminal
+			build.shared.output.flush();
+		}
+		auto const compile_begin = std::chrono::steady_clock::now();
+		auto result = compile(invocation, build.shared.cache_dir, nullptr, nullptr, nullptr, nullptr, {}, build.diagnostics_flags, build.shared.capture_output);
+		if (result.was_terminated)
+		{
+			return 1;
+		}
+		auto diagnostics = take_structured_diagnostics(build, result);
+		if (result.exit_code == 0)
+		{
+			(is_c ? build.c_pch_compile_duration : build.cpp_pch_compile_duration) = get_elapsed_milliseconds(compile_begin);
+			(is_c ? build.c_pch_usage : build.cpp_pch_usage) = result.usage;
+		}
+		auto const is_failed = result.exit_code != 0;
+		if (build.shared.capture_output)
+		{
+			build.shared.output.push(std::nullopt, [
+				&shared = build.shared,
+				stdout_string = std::move(result.stdout_string),
+				stderr_string = std::move(result.stderr_string),
+				diagnostics = std::move(diagnostics).value_or(cppb::vector<diagnostic>())
+			]() {
+				print_compiler_output(stdout_string, stderr_string);
+				print_diagnostics(shared, diagnostics);
+			});
+		}
+		if (is_failed)
+		{
+			return 1;
+		}
+	}
+
+	if (fs::exists(invocation.output_file))
+	{
+		(is_c ? build.c_pch_last_update : build.cpp_pch_last_update) = get_logical_write_time(build.shared.cache_dir, invocation.output_file);
+	}
+	return 0;
+}
+
+static int check_translation_units(project_build_t &build, bool is_c)
+{
+	auto const check_begin = std::chrono::steady_clock::now();
+
+	auto const &translation_units = build.invocations.translation_units;
+	auto const indices = ranges::iota(translation_units.size())
+		.filter([&](auto const i) { return (translation_units[i].input_file.extension() == ".c") == is_c; })
+		.collect<cppb::vector>();
+	if (indices.empty())
+	{
+		return 0;
+	}
+
+	auto const &pch = is_c ? build.invocations.c_pch : build.invocations.cpp_pch;
+	auto const pch_last_update = is_c ? build.c_pch_last_update : build.cpp_pch_last_update;
+	auto const pch_file = pch.has_value() ? pch->output_file : fs::path();
+	auto const get_reason = [&](std::size_t i) {
+		return get_rebuild_reason(translation_units[i], build.shared.cache_dir, pch_last_update, pch_file);
+	};
+
+	// somewhat arbitrary limit
+	if (indices.size() > 4)
+	{
+		auto futures = indices
+			.transform([&](auto const i) {
+				return build.shared.thread_pools.push_task(task_class::cpu, [&get_reason, i]() { return get_reason(i); });
+			})
+			.collect<cppb::vector>();
+		for (std::size_t j = 0; j < indices.size(); ++j)
+		{
+			build.reasons[indices[j]] = futures[j].get();
+		}
+	}
+	else
+	{
+		for (auto const i : indices)
+		{
+			build.reasons[i] = get_reason(i);
+		}
+	}
+	// the reasons are checked concurrently, but the outputs are only touched after every check
+	for (auto const i : indices)
+	{
+		touch_up_to_date_output(build.reasons[i], translation_units[i], build.shared.cache_dir);
+	}
+	add_check_time(build, check_begin);
+	build.checked_count += indices.size();
+
+	auto const out_of_date_indices = indices
+		.filter([&](auto const i) { return is_out_of_date(build.reasons[i]); })
+		.collect<cppb::vector>();
+	for (auto const i : out_of_date_indices)
+	{
+		build.is_compile_needed[i] = true;
+	}
+
+	// files that are in the remote cache are still counted, they're fetched by their compile node
+	build.shared.compile_count += out_of_date_indices.size();
+
+	return 0;
+}
+
+static int compile_translation_unit(project_build_t &build, std::size_t index)
+{
+	if (!build.is_compile_needed[index])
 	{
-		return {
-			.exit_code = 1,
-			.any_run = false,
-			.any_cpp = false,
-			.object_files = {},
-		};
+		// with ordered output, the files after this one don't need to wait for it
+		build.shared.output.push(build.first_sequence_number + index, nullptr);
+		return 0;
 	}
 
-	auto c_pch_last_update   = fs::file_time_type::min();
-	auto cpp_pch_last_update = fs::file_time_type::min();
+	// the remote cache key is only set by this node
+	auto &invocation = build.invocations.translation_units[index];
+	auto const filename = fs::relative(invocation.input_file).generic_string();
+
+	// called on the output thread, so the progress is counted in the order it's printed
+	auto const print_progress = [&build, &invocation, filename](bool is_fetched = false) {
+		auto const note = is_fetched ? " (from the remote cache)" : "";
+		auto const compile_count = build.shared.compile_count.load();
+		int const index_width = [&]() {
+			auto i = compile_count;
+			int result = 0;
+			do
+			{
+				++result;
+				i /= 10;
+			} while (i != 0);
+			return result;
+		}();
+		if (build.shared.is_multi_project)
+		{
+			fmt::print(
+				"({:{}}/{}) {}: {}{}\n",
+				++build.shared.compiled_count, index_width, compile_count, build.project.project_name, filename, note
+			);
+		}
+		else
+		{
+			fmt::print("({:{}}/{}) {}{}\n", ++build.shared.compiled_count, index_width, compile_count, filename, note);
+		}
+		if (ctcli::option_value<"build --verbose"> && !is_fetched)
+		{
+			print_command(invocation.compiler, invocation.args);
+		}
+	};
+
+	// the preprocessor runs for the key, so it's done here, while the node holds a process slot and a job token
+	if (build.shared.remote != nullptr)
+	{
+		invocation.remote_cache_key = get_remote_cache_key(invocation, build.invocations);
+		if (fetch_from_remote_cache(invocation, build.shared.cache_dir, *build.shared.remote))
+		{
+			build.shared.output.push(build.first_sequence_number + index, [print_progress]() { print_progress(true); });
+			return 0;
+		}
+	}
 
-	if (invocations->c_pch.has_value())
+	auto const compile_begin = std::chrono::steady_clock::now();
+	if (!build.shared.capture_output)
 	{
-		auto const &pch_file = invocations->c_pch->output_file;
-		if (should_compile(*invocations->c_pch, cache_dir))
+		build.shared.output.push(build.first_sequence_number + index, print_progress);
+		// the compiler writes directly to the terminal
+		build.shared.output.flush();
+		auto result = compile(
+			invocation, build.shared.cache_dir, build.shared.remote, build.shared.distributed, build.shared.shared_jobserver,
+			build.shared.bypass, get_pch_header(build.invocations, invocation), {}, false
+		);
+		if (result.was_terminated)
 		{
-			auto const relative_header_filename = fs::relative(invocations->c_pch->input_file).generic_string();
-			fmt::print("pre-compiling {}\n", relative_header_filename);
-			std::fflush(stdout);
-			if (ctcli::option_value<"build --verbose">)
+			return 1;
+		}
+		build.compilation_results[index] = std::move(result);
+	}
+	else
+	{
+		auto result = compile(
+			invocation, build.shared.cache_dir, build.shared.remote, build.shared.distributed, build.shared.shared_jobserver,
+			build.shared.bypass, get_pch_header(build.invocations, invocation), build.diagnostics_flags, true
+		);
+		// the build was cancelled because of an error in another file, so the output would only be noise
+		if (result.was_terminated)
+		{
+			build.shared.output.push(build.first_sequence_number + index, nullptr);
+			return 1;
+		}
+		auto diagnostics = take_structured_diagnostics(build, result);
+		build.shared.output.push(build.first_sequence_number + index, [
+			print_progress,
+			&shared = build.shared,
+			stdout_string = result.stdout_string,
+			stderr_string = result.stderr_string,
+			diagnostics = std::move(diagnostics).value_or(cppb::vector<diagnostic>())
+		]() {
+			print_progress();
+			print_compiler_output(stdout_string, stderr_string);
+			print_diagnostics(shared, diagnostics);
+		});
+		build.compilation_results[index] = std::move(result);
+	}
+
+	auto const &result = *build.compilation_results[index];
+	if (result.exit_code != 0 || result.error_count != 0)
+	{
+		return 1;
+	}
+	build.compile_durations[index] = get_elapsed_milliseconds(compile_begin);
+	return 0;
+}
+
+// runs after every translation unit has been compiled, even if some of them failed or the build was cancelled
+static int report_compilation_results(project_build_t &build)
+{
+	// the summary below is printed directly, after the output of every compilation
+	build.shared.output.flush();
+
+	auto const &translation_units = build.invocations.translation_units;
+	auto const is_every_file_checked = build.checked_count.load() == translation_units.size();
+	auto state_lock = std::unique_lock(build.shared.state_mutex);
+	if (is_every_file_checked)
+	{
+		auto const out_of_date_count = static_cast<std::size_t>(std::count_if(
+			build.reasons.begin(), build.reasons.end(),
+			[](auto const &reason) { return is_out_of_date(reason); }
+		));
+		build.shared.state.cache_hits   += translation_units.size() - out_of_date_count;
+		build.shared.state.cache_misses += out_of_date_count;
+	}
+
+	auto const record_compilation = [&](compiler_invocation_t const &invocation, std::int64_t duration, resource_usage const &usage) {
+		if (duration != 0)
+		{
+			auto &output = build.shared.state.outputs[get_build_state_key(invocation.output_file)];
+			output.build_duration = duration;
+			output.usage = usage;
+		}
+	};
+	if (build.invocations.c_pch.has_value())
+	{
+		record_compilation(*build.invocations.c_pch, build.c_pch_compile_duration, build.c_pch_usage);
+	}
+	if (build.invocations.cpp_pch.has_value())
+	{
+		record_compilation(*build.invocations.cpp_pch, build.cpp_pch_compile_duration, build.cpp_pch_usage);
+	}
+	for (std::size_t i = 0; i < translation_units.size(); ++i)
+	{
+		if (build.compilation_results[i].has_value())
+		{
+			record_compilation(translation_units[i], build.compile_durations[i], build.compilation_results[i]->usage);
+		}
+	}
+	state_lock.unlock();
+
+	if (is_every_file_checked && (ctcli::option_value<"build --explain"> || ctcli::is_option_set<"build --explain-json">()))
+	{
+		explain_rebuild_reasons(
+			build.project.project_name, build.invocations,
+			build.c_pch_reason, build.cpp_pch_reason, build.reasons,
+			build.source_files, std::chrono::steady_clock::duration(build.check_time.load())
+		);
+	}
+
+	if (!build.shared.capture_output)
+	{
+		// the compiler output was already printed, we only need to know whether there was a failure
+		auto const is_any_failed = build.compilation_results.is_any([](auto const &result) {
+			return result.has_value() && result->exit_code != 0;
+		});
+		return is_any_failed || !is_every_file_checked ? 1 : 0;
+	}
+
+	bool is_good = true;
+	for (std::size_t i = 0; i < translation_units.size(); ++i)
+	{
+		if (!build.compilation_results[i].has_value())
+		{
+			continue;
+		}
+
+		auto const &result = *build.compilation_results[i];
+		if (result.exit_code != 0 || result.error_count != 0 || result.warning_count != 0)
+		{
+			is_good = is_good && result.exit_code == 0 && result.error_count == 0;
+			auto const message = [&]() {
+				if (result.error_count != 0 && result.warning_count != 0)
+				{
+					return fmt::format(
+						"compilation failed with {} error{} and {} warning{}",
+						result.error_count, result.error_count == 1 ? "" : "s",
+						result.warning_count, result.warning_count == 1 ? "" : "s"
+					);
+				}
+				else if (result.error_count != 0)
+				{
+					return fmt::format(
+						"compilation failed with {} error{}",
+						result.error_count, result.error_count == 1 ? "" : "s"
+					);
+				}
+				else if (result.warning_count != 0)
+				{
+					return fmt::format(
+						"{} warning{} emitted by compiler",
+						result.warning_count, result.warning_count == 1 ? "" : "s"
+					);
+				}
+				else // if (result.error_count == 0 && result.warning_cont == 0)
+				{
+					// this shouldn't normally happen, but we handle it anyways
+					return fmt::format("compilation failed with exit code {}", result.exit_code);
+				}
+			}();
+			auto const relative_source_file_name = fs::relative(translation_units[i].input_file).generic_string();
+			if (result.exit_code != 0 || result.error_count != 0)
 			{
-				print_command(invocations->c_pch->compiler, invocations->c_pch->args);
+				report_error(relative_source_file_name, message);
 			}
-			auto const result = compile(*invocations->c_pch, cache_dir, false);
-			if (result.exit_code != 0)
+			else
 			{
-				return { result.exit_code, false, false, {} };
+				report_warning(relative_source_file_name, message);
 			}
 		}
-		if (fs::exists(pch_file))
-		{
-			c_pch_last_update = fs::last_write_time(pch_file);
-		}
 	}
-	if (invocations->cpp_pch.has_value())
+
+	return is_good && is_every_file_checked ? 0 : 1;
+}
+
+static int link_project(project_build_t &build)
+{
+	auto const object_files = build.invocations.translation_units
+		.transform([](compiler_invocation_t const &invocation) {
+			return invocation.output_file;
+		})
+		.collect<cppb::vector>();
+
+	return link_project(
+		build.project.project_name,
+		build.build_config,
+		build.bin_directory,
+		build.shared.cache_dir,
+		object_files,
+		build.link_dependency_last_update,
+		build.invocations.is_any_cpp,
+		build.shared.state,
+		build.shared.state_mutex
+	);
+}
+
+static int run_postbuild_rules(project_build_t &build)
+{
+	std::string error;
+	auto const rules_guard = std::lock_guard(build.shared.rules_mutex);
+	auto const [exit_code, any_run, _] = run_rules(
+		"post-build", build.build_config.postbuild_rules, build.shared.rules, build.shared.config_last_update, error,
+		true, &build.shared.state.rule_usages
+	);
+	if (!error.empty())
 	{
-		auto const &pch_file = invocations->cpp_pch->output_file;
-		if (should_compile(*invocations->cpp_pch, cache_dir))
+		report_error("cppb", error);
+		return 1;
+	}
+	return exit_code;
+}
+
+static void sort_source_files(cppb::vector<source_file> &source_files)
+{
+	source_files.sort([](source_file const &lhs, source_file const &rhs) {
+		auto lhs_it = lhs.file_path.begin();
+		auto rhs_it = rhs.file_path.begin();
+		auto const lhs_end = lhs.file_path.end();
+		auto const rhs_end = rhs.file_path.end();
+
+		while (lhs_it != lhs_end && rhs_it != rhs_end)
 		{
-			auto const relative_header_filename = fs::relative(invocations->cpp_pch->input_file).generic_string();
-			fmt::print("pre-compiling {}\n", relative_header_filename);
-			std::fflush(stdout);
-			if (ctcli::option_value<"build --verbose">)
+			auto const compare_result = *lhs_it <=> *rhs_it;
+
+			++lhs_it;
+			++rhs_it;
+
+			if (lhs_it == lhs_end || rhs_it == rhs_end)
+			{
+				return lhs_it != lhs_end || (rhs_it == rhs_end && compare_result < 0);
+			}
+			else if (compare_result < 0)
 			{
-				print_command(invocations->cpp_pch->compiler, invocations->cpp_pch->args);
+				return true;
 			}
-			auto const result = compile(*invocations->cpp_pch, cache_dir, false);
-			if (result.exit_code != 0)
+			else if (compare_result > 0)
 			{
-				return { result.exit_code, false, false, {} };
+				return false;
 			}
 		}
-		if (fs::exists(pch_file))
+
+		// we should never get here...
+		return lhs_it != lhs_end;
+	});
+}
+
+// scans the source files of every project; projects with the same source directory and include paths share
+// the scan, and the dependency file is written once with the sources of all of them
+static int scan_sources(shared_build_t &shared, cppb::vector<std::unique_ptr<project_build_t>> &builds)
+{
+	std::string error;
+
+	auto const cppb_dir = fs::path(ctcli::option_value<"build --cppb-dir">);
+	auto const dependency_file_path = cppb_dir / fmt::format("dependencies/{}.json", os::config_name());
+	auto previous_source_files = read_dependency_json(dependency_file_path, error);
+	if (!error.empty())
+	{
+		report_error(dependency_file_path.generic_string(), error);
+		return 1;
+	}
+	fill_last_modified_times(previous_source_files);
+	auto const dependency_file_last_update = fs::exists(dependency_file_path)
+		? fs::last_write_time(dependency_file_path)
+		: fs::file_time_type::min();
+
+	auto all_source_files = cppb::vector<source_file>();
+	auto known_source_files = std::unordered_set<std::string>();
+	for (std::size_t i = 0; i < builds.size(); ++i)
+	{
+		auto &build = *builds[i];
+		auto const same_scan_it = std::find_if(builds.begin(), builds.begin() + static_cast<std::ptrdiff_t>(i), [&](auto const &other) {
+			return other->build_config.source_directory == build.build_config.source_directory
+				&& other->build_config.include_paths == build.build_config.include_paths;
+		});
+		if (same_scan_it != builds.begin() + static_cast<std::ptrdiff_t>(i))
+		{
+			build.source_files = (*same_scan_it)->source_files;
+			continue;
+		}
+
+		auto source_files = previous_source_files;
+		analyze_source_files(
+			get_source_files_in_directory(build.build_config.source_directory),
+			build.build_config.include_paths,
+			source_files,
+			dependency_file_last_update,
+			shared.config_last_update,
+			shared.thread_pools.get_pool(task_class::io)
+		);
+		sort_source_files(source_files);
+		for (auto const &source : source_files)
 		{
-			cpp_pch_last_update = fs::last_write_time(pch_file);
+			if (known_source_files.insert(source.file_path.generic_string()).second)
+			{
+				all_source_files.push_back(source);
+			}
 		}
+		build.source_files = std::move(source_files);
+	}
+
+	sort_source_files(all_source_files);
+	write_dependency_json(dependency_file_path, all_source_files);
+	return 0;
+}
+
+// scheduling groups of translation units with edited-first scheduling
+static constexpr int edited_source_group = 2;
+static constexpr int changed_header_group = 1;
+
+// with edited-first scheduling, the translation units whose own source was written after their object file are
+// started first, because they're the most likely to fail, then the ones that only depend on a changed header;
+// within a group the most recently edited ones start first.  Other translation units, e.g. the ones without
+// an object file, keep the critical path order.
+static build_node_options get_translation_unit_node_options(
+	project_build_t const &build,
+	compiler_invocation_t const &invocation,
+	build_node_options critical_path_options
+)
+{
+	if (ctcli::option_value<"build --schedule"> != schedule_policy::edited_first)
+	{
+		return critical_path_options;
+	}
+
+	std::error_code ec;
+	auto const output_last_write_time = fs::last_write_time(invocation.output_file, ec);
+	if (ec)
+	{
+		return critical_path_options;
+	}
+
+	auto const get_last_write_time = [](fs::path const &file) {
+		std::error_code ec;
+		auto const result = fs::last_write_time(file, ec);
+		return ec ? fs::file_time_type::min() : result;
+	};
+	// the own sources of a unity batch are the files it includes
+	auto const unity_it = std::find_if(
+		build.invocations.unity_sources.begin(), build.invocations.unity_sources.end(),
+		[&](source_file const &source) { return source.file_path == invocation.input_file; }
+	);
+	auto const own_last_write_time = unity_it == build.invocations.unity_sources.end()
+		? get_last_write_time(invocation.input_file)
+		: unity_it->dependencies
+			.filter([](auto const &file) {
+				return source_extensions.is_any([&file](auto const extension) { return file.extension().generic_string() == extension; });
+			})
+			.transform(get_last_write_time)
+			.max(fs::file_time_type::min());
+
+	auto result = critical_path_options;
+	if (own_last_write_time > output_last_write_time)
+	{
+		result.group = edited_source_group;
+		result.priority = own_last_write_time.time_since_epoch().count();
+	}
+	else if (invocation.input_file_last_modified > output_last_write_time)
+	{
+		result.group = changed_header_group;
+		result.priority = invocation.input_file_last_modified.time_since_epoch().count();
+	}
+	return result;
+}
+
+// adds the nodes of a project to the graph, once its source files are known
+static int plan_project(project_build_t &build, build_graph &graph)
+{
+	// the build state and the compile_commands.json entries are shared by every project
+	auto state_lock = std::unique_lock(build.shared.state_mutex);
+	auto const unity_excluded_sources = build.build_config.unity_build
+		? get_frequently_edited_sources(build.source_files, build.shared.state)
+		: std::unordered_set<std::string>();
+	auto invocations = get_compiler_invocations(
+		build.build_config, build.source_files, build.intermediate_bin_directory, unity_excluded_sources
+	);
+	if (!invocations.has_value())
+	{
+		return 1;
+	}
+	build.invocations = std::move(*invocations);
+	build.first_sequence_number = build.shared.sequence_number_count.fetch_add(build.invocations.translation_units.size());
+	if (build.build_config.emit_compile_commands)
+	{
+		build.shared.compile_commands.append(build.invocations.compile_commands);
+	}
+	// the generated unity files are part of the dependency graph, but not of the dependency file
+	build.source_files.append(build.invocations.unity_sources);
+
+	if (build.build_config.token_fingerprints)
+	{
+		auto const check_begin = std::chrono::steady_clock::now();
+		fill_token_fingerprints(build.invocations, build.source_files, build.shared.state, build.shared.thread_pools.get_pool(task_class::cpu));
+		add_check_time(build, check_begin);
 	}
 
-	auto const compiler_invocations = [&]() {
-		// somewhat arbitrary limit
-		if (invocations->translation_units.size() > 4)
+	// outputs used by this build are marked as recently used for cache eviction
+	auto const current_time = get_current_time();
+	auto const record_output_access = [&](compiler_invocation_t const &invocation) {
+		auto &output = build.shared.state.outputs[get_build_state_key(invocation.output_file)];
+		output.source_file = invocation.input_file.generic_string();
+		output.last_access_time = current_time;
+	};
+	if (build.invocations.c_pch.has_value())
+	{
+		record_output_access(*build.invocations.c_pch);
+	}
+	if (build.invocations.cpp_pch.has_value())
+	{
+		record_output_access(*build.invocations.cpp_pch);
+	}
+	build.invocations.translation_units.for_each(record_output_access);
+
+	auto const translation_unit_count = build.invocations.translation_units.size();
+	build.reasons.resize(translation_unit_count);
+	build.is_compile_needed.resize(translation_unit_count, false);
+	build.compilation_results.resize(translation_unit_count);
+	build.compile_durations.resize(translation_unit_count, 0);
+
+	// the priority of a node is the expected time from its start to the end of the link,
+	// so that long translation units and the headers they wait for are started first
+	auto expected_durations = get_recorded_build_durations(
+		build.invocations, build.shared.state,
+		get_executable_file(build.bin_directory, build.build_config, build.project.project_name)
+	);
+	// nodes that are expected to use a lot of memory are held back if they don't fit in the memory budget
+	auto const expected_peak_memory = get_expected_peak_memory(build.invocations, build.shared.state);
+	state_lock.unlock();
+	estimate_missing_build_durations(expected_durations, build.invocations, build.source_files);
+
+	auto const is_c_source = [&](std::size_t i) {
+		return build.invocations.translation_units[i].input_file.extension() == ".c";
+	};
+	auto const get_translation_unit_priority = [&](std::size_t i) {
+		return expected_durations.translation_units[i] + expected_durations.link;
+	};
+
+	// the two pre-compiled headers are built concurrently, and translation units of a language
+	// without a pre-compiled header don't need to wait for the other one
+	auto const add_language_nodes = [&](bool is_c) {
+		auto const check_priority = ranges::iota(translation_unit_count)
+			.filter([&](auto const i) { return is_c_source(i) == is_c; })
+			.transform(get_translation_unit_priority)
+			.max(expected_durations.link);
+		auto const &pch = is_c ? build.invocations.c_pch : build.invocations.cpp_pch;
+		auto pch_nodes = cppb::vector<build_graph::node_id>();
+		if (pch.has_value())
 		{
-			auto pool = thread_pool(std::thread::hardware_concurrency());
-			auto futures = invocations->translation_units
-				.transform([&](compiler_invocation_t const &invocation) {
-					auto const is_c_source = invocation.input_file.extension() == ".c";
-					return pool.push_task([&, pch_last_update = is_c_source ? c_pch_last_update : cpp_pch_last_update]() {
-						return should_compile(invocation, cache_dir, pch_last_update);
-					});
-				})
-				.collect<cppb::vector>();
-			return ranges::iota(invocations->translation_units.size())
-				.filter([&](auto const i) {
-					return futures[i].get();
-				})
-				.transform([&](auto const i) -> auto const & {
-					return invocations->translation_units[i];
+			auto const pch_priority = (is_c ? expected_durations.c_pch : expected_durations.cpp_pch) + check_priority;
+			auto const pch_peak_memory = is_c ? expected_peak_memory.c_pch : expected_peak_memory.cpp_pch;
+			pch_nodes.push_back(graph.add_node(
+				[&build, is_c]() { return build_pch(build, is_c); },
+				{}, { .priority = pch_priority, .memory = pch_peak_memory }
+			));
+		}
+		return graph.add_node(
+			[&build, is_c]() { return check_translation_units(build, is_c); },
+			pch_nodes, { .priority = check_priority }
+		);
+	};
+	auto const c_check_node   = add_language_nodes(true);
+	auto const cpp_check_node = add_language_nodes(false);
+
+	auto report_dependencies = ranges::iota(translation_unit_count)
+		.transform([&](auto const i) {
+			auto const check_node = is_c_source(i) ? c_check_node : cpp_check_node;
+			return graph.add_node(
+				[&build, i]() { return compile_translation_unit(build, i); },
+				cppb::array<build_graph::node_id, 1>{{ check_node }},
+				get_translation_unit_node_options(build, build.invocations.translation_units[i], {
+					.priority = get_translation_unit_priority(i),
+					.memory = expected_peak_memory.translation_units[i],
 				})
-				.collect<cppb::vector>();
+			);
+		})
+		.collect<cppb::vector>();
+	// the compile times of the pre-compiled headers are also recorded by the report node
+	report_dependencies.push_back(c_check_node);
+	report_dependencies.push_back(cpp_check_node);
+	// errors are reported even if the build was cancelled
+	auto const report_node = graph.add_node(
+		[&build]() { return report_compilation_results(build); },
+		report_dependencies, { .priority = expected_durations.link, .is_run_after_failure = true }
+	);
+
+	auto const link_dependencies = cppb::array<build_graph::node_id, 2>{{ report_node, build.prelink_node }};
+	auto const link_node = graph.add_node(
+		[&build]() { return link_project(build); },
+		link_dependencies, { .priority = expected_durations.link }
+	);
+	graph.add_node([&build]() { return run_postbuild_rules(build); }, cppb::array<build_graph::node_id, 1>{{ link_node }});
+
+	return 0;
+}
+
+static std::uint64_t get_memory_budget(void)
+{
+	if (ctcli::is_option_set<"build --memory-budget">())
+	{
+		auto const result = parse_cache_size(ctcli::option_value<"build --memory-budget">);
+		if (!result.has_value())
+		{
+			report_error(
+				fmt::format("<command-line>:{}", ctcli::option_index<"build --memory-budget">),
+				fmt::format("invalid memory budget '{}'", ctcli::option_value<"build --memory-budget">)
+			);
+			exit(1);
 		}
-		else
+		return *result;
+	}
+	return os::get_physical_memory_size();
+}
+
+// joins the jobserver of a parent make, or creates one for make invocations in rules
+static std::unique_ptr<jobserver> get_jobserver(std::size_t job_count)
+{
+	std::string error;
+	if (auto const makeflags = std::getenv("MAKEFLAGS"); makeflags != nullptr)
+	{
+		auto result = connect_to_jobserver(makeflags, error);
+		if (result != nullptr)
 		{
-			return invocations->translation_units
-				.filter([&](compiler_invocation_t const &invocation) {
-					auto const is_c_source = invocation.input_file.extension() == ".c";
-					return should_compile(invocation, cache_dir, is_c_source ? c_pch_last_update : cpp_pch_last_update);
-				})
-				.collect<cppb::vector>();
+			return result;
 		}
-	}();
+		else if (!error.empty())
+		{
+			report_warning("cppb", fmt::format("{}; using a new jobserver instead", error));
+			error.clear();
+		}
+	}
 
-	auto object_files = invocations->translation_units
-		.transform([](compiler_invocation_t const &invocation) {
-			return invocation.output_file;
-		})
-		.collect<cppb::vector>();
+	auto const style = ctcli::is_option_set<"build --jobserver-style">()
+		? ctcli::option_value<"build --jobserver-style">
+		: jobserver_style::pipe;
+	auto result = create_jobserver(job_count, style, error);
+	if (!error.empty())
+	{
+		report_warning("cppb", error);
+	}
+	return result;
+}
+
+// every project is built in the same graph, so the compilations of one project can run during the link of another
+static int build_projects(
+	executor &thread_pools,
+	cppb::vector<project_config const *> const &project_configs,
+	cppb::vector<rule> const &rules,
+	fs::path const &cache_dir,
+	build_state &state,
+	remote_cache *remote,
+	distributed_compiler *distributed,
+	driver_bypass *bypass,
+	fs::file_time_type config_last_update
+)
+{
+	auto &process_pool = thread_pools.get_pool(task_class::process);
+	auto const job_count = process_pool.thread_count();
+	// the process pool also has a slot for every remote one, but make and the rules only see the local slots
+	auto const shared_jobserver = get_jobserver(get_local_slot_count());
+	// interactive builds fail fast by default, other builds, e.g. on CI, keep going like make -k
+	auto const max_failure_count =
+		ctcli::is_option_set<"build --max-failures">() ? ctcli::option_value<"build --max-failures"> :
+		ctcli::option_value<"build --keep-going"> ? 0 :
+		os::is_interactive() ? 1 : 0;
+	// declared before the graph, so it outlives the nodes that push to it
+	auto output = output_queue(ctcli::option_value<"build --ordered-output">);
+	auto shared = shared_build_t{
+		.rules = rules,
+		.cache_dir = cache_dir,
+		.state = state,
+		.remote = remote,
+		.distributed = distributed,
+		.shared_jobserver = shared_jobserver.get(),
+		.bypass = bypass,
+		.config_last_update = config_last_update,
+		// structured diagnostics are always captured, so they can be printed as text
+		.capture_output = job_count > 1 || ctcli::option_value<"build --structured-diagnostics">,
+		.output = output,
+		.thread_pools = thread_pools,
+		.is_multi_project = project_configs.size() > 1,
+	};
+	auto builds = cppb::vector<std::unique_ptr<project_build_t>>();
+	auto graph = build_graph(process_pool, shared_jobserver.get(), get_memory_budget(), max_failure_count);
+
+	auto prebuild_nodes = cppb::vector<build_graph::node_id>();
+	for (auto const project_config : project_configs)
+	{
+		auto const &build_config = os::get_build_config(*project_config);
+
+		auto bin_directory = fs::path(ctcli::option_value<"build --bin-dir">) / os::config_name();
+		auto intermediate_bin_directory = bin_directory / fmt::format("int-{}", project_config->project_name);
+		fs::create_directories(intermediate_bin_directory);
+
+		// project_build_t can't be moved, so it's allocated in place
+		auto &build = *builds.emplace_back(new project_build_t{
+			.shared = shared,
+			.project = *project_config,
+			.build_config = build_config,
+			.bin_directory = std::move(bin_directory),
+			.intermediate_bin_directory = std::move(intermediate_bin_directory),
+			.diagnostics_flags = ctcli::option_value<"build --structured-diagnostics">
+				? get_structured_diagnostics_flags(build_config.compiler, build_config.compiler_version)
+				: cppb::vector<std::string>(),
+		});
 
-	if (compiler_invocations.empty())
-	{
-		return { 0, false, invocations->is_any_cpp, std::move(object_files) };
+		auto const prebuild_node = cppb::array<build_graph::node_id, 1>{{
+			graph.add_node([&build]() { return run_prebuild_rules(build); })
+		}};
+		prebuild_nodes.push_back(prebuild_node[0]);
+		// the link waits for the pre-link rules, but every other node waits for the scanner
+		auto const link_duration_it = state.link_durations.find(
+			get_build_state_key(get_executable_file(build.bin_directory, build_config, project_config->project_name))
+		);
+		build.prelink_node = graph.add_node(
+			[&build]() { return run_prelink_rules(build); },
+			prebuild_node, { .priority = link_duration_it == state.link_durations.end() ? 0 : link_duration_it->second }
+		);
 	}
 
-	auto const job_count = get_job_count();
+	// the rest of the graph is added by the planner node of each project, once the source files are known
+	auto const scan_node = cppb::array<build_graph::node_id, 1>{{
+		graph.add_node(
+			[&shared, &builds]() { return scan_sources(shared, builds); },
+			prebuild_nodes, { .priority = std::numeric_limits<std::int64_t>::max() }
+		)
+	}};
+	for (auto const &build : builds)
+	{
+		graph.add_node(
+			[&build = *build, &graph]() { return plan_project(build, graph); },
+			scan_node, { .priority = std::numeric_limits<std::int64_t>::max() }
+		);
+	}
 
-	if (!ctcli::option_value<"build -s"> && job_count > 1 && compiler_invocations.size() > 1)
+	auto const exit_code = graph.run();
+	output.flush();
+	if (!shared.compile_commands.empty())
 	{
-		cppb::vector<process_result> compilation_results = run_commands_async(compiler_invocations, cache_dir);
+		// the projects were appended in the order they were planned
+		shared.compile_commands.sort([](auto const &lhs, auto const &rhs) { return lhs.source_file < rhs.source_file; });
+		write_compile_commands_json(shared.compile_commands);
+	}
+	if (shared.duplicate_diagnostic_count != 0)
+	{
+		fmt::print(
+			"{} duplicate diagnostic{} not printed\n",
+			shared.duplicate_diagnostic_count, shared.duplicate_diagnostic_count == 1 ? " was" : "s were"
+		);
+		std::fflush(stdout);
+	}
+	return exit_code;
+}
 
-		bool is_good = true;
-		assert(compilation_results.size() == compiler_invocations.size());
-		for (std::size_t i = 0; i < compilation_results.size(); ++i)
+// the distinct compiler launchers of the projects that are built
+static cppb::vector<fs::path> get_compiler_launchers(cppb::vector<project_config const *> const &project_configs)
+{
+	cppb::vector<fs::path> result;
+	for (auto const project_config : project_configs)
+	{
+		auto const &build_config = os::get_build_config(*project_config);
+		for (auto const &launcher : { build_config.c_compiler_launcher, build_config.cpp_compiler_launcher })
 		{
-			auto const result = compilation_results[i];
-			if (result.exit_code != 0 || result.error_count != 0 || result.warning_count != 0)
+			if (!launcher.empty() && std::find(result.begin(), result.end(), launcher) == result.end())
 			{
-				is_good = is_good && result.exit_code == 0 && result.error_count == 0;
-				auto const message = [&]() {
-					if (result.error_count != 0 && result.warning_count != 0)
-					{
-						return fmt::format(
-							"compilation failed with {} error{} and {} warning{}",
-							result.error_count, result.error_count == 1 ? "" : "s",
-							result.warning_count, result.warning_count == 1 ? "" : "s"
-						);
-					}
-					else if (result.error_count != 0)
-					{
-						return fmt::format(
-							"compilation failed with {} error{}",
-							result.error_count, result.error_count == 1 ? "" : "s"
-						);
-					}
-					else if (result.warning_count != 0)
-					{
-						return fmt::format(
-							"{} warning{} emitted by compiler",
-							result.warning_count, result.warning_count == 1 ? "" : "s"
-						);
-					}
-					else // if (result.error_count == 0 && result.warning_cont == 0)
-					{
-						// this shouldn't normally happen, but we handle it anyways
-						return fmt::format("compilation failed with exit code {}", result.exit_code);
-					}
-				}();
-				if (result.exit_code != 0 || result.error_count != 0)
-				{
-					auto const relative_source_file_name = fs::relative(compiler_invocations[i].input_file).generic_string();
-					report_error(relative_source_file_name, message);
-				}
-				else
-				{
-					auto const relative_source_file_name = fs::relative(compiler_invocations[i].input_file).generic_string();
-					report_warning(relative_source_file_name, message);
-				}
+				result.push_back(launcher);
 			}
 		}
+	}
+	return result;
+}
 
-		if (!is_good)
+// the statistics of a launcher are for its whole cache, so only the difference is printed
+static void print_compiler_launcher_stats(
+	cppb::vector<fs::path> const &launchers,
+	cppb::vector<std::optional<compiler_launcher_stats>> const &stats_before_build
+)
+{
+	for (std::size_t i = 0; i < launchers.size(); ++i)
+	{
+		auto const stats = get_compiler_launcher_stats(launchers[i]);
+		if (!stats.has_value() || !stats_before_build[i].has_value())
 		{
-			return { 1, false, false, {} };
+			continue;
 		}
-
-		return { 0, true, invocations->is_any_cpp, std::move(object_files) };
-	}
-	else
-	{
-		auto const exit_code = run_commands_sequential(compiler_invocations, cache_dir);
-		return { exit_code, true, invocations->is_any_cpp, std::move(object_files) };
+		auto const hits = stats->hits - std::min(stats->hits, stats_before_build[i]->hits);
+		auto const misses = stats->misses - std::min(stats->misses, stats_before_build[i]->misses);
+		if (hits == 0 && misses == 0)
+		{
+			continue;
+		}
+		fmt::print(
+			"{}: {} cache hit{}, {} cache miss{}\n",
+			launchers[i].filename().generic_string(),
+			hits, hits == 1 ? "" : "s",
+			misses, misses == 1 ? "" : "es"
+		);
 	}
+	std::fflush(stdout);
 }
 
-static int build_project(project_config const &project_config, cppb::vector<rule> const &rules, fs::path const &cache_dir, fs::file_time_type config_last_update)
+static std::optional<std::uintmax_t> get_max_cache_size(std::optional<std::uintmax_t> config_max_cache_size)
 {
-	std::string error;
-
-	auto const &build_config = os::get_build_config(project_config);
-
-	auto const bin_directory = fs::path(ctcli::option_value<"build --bin-dir">) / os::config_name();
-	auto const intermediate_bin_directory = bin_directory / fmt::format("int-{}", project_config.project_name);
-	fs::create_directories(intermediate_bin_directory);
-
-	auto const cppb_dir = fs::path(ctcli::option_value<"build --cppb-dir">);
-	auto const dependency_file_path = cppb_dir / fmt::format("dependencies/{}.json", os::config_name());
-	auto source_files = read_dependency_json(dependency_file_path, error);
-	if (!error.empty())
+	if (ctcli::is_option_set<"build --max-cache-size">())
 	{
-		report_error(dependency_file_path.generic_string(), error);
-		return 1;
+		auto const result = parse_cache_size(ctcli::option_value<"build --max-cache-size">);
+		if (!result.has_value())
+		{
+			report_error(
+				fmt::format("<command-line>:{}", ctcli::option_index<"build --max-cache-size">),
+				fmt::format("invalid cache size '{}'", ctcli::option_value<"build --max-cache-size">)
+			);
+			exit(1);
+		}
+		return result;
 	}
+	return config_max_cache_size;
+}
 
-	// pre-build rules
-	auto const [prebuild_exit_code, prebuild_any_run, _] = run_rules("pre-build", build_config.prebuild_rules, rules, config_last_update, error);
-	if (!error.empty())
-	{
-		report_error("cppb", error);
-		return 1;
-	}
-	if (prebuild_exit_code != 0)
+// nullptr if no workers are given or compilations aren't run concurrently
+static std::unique_ptr<distributed_compiler> get_distributed_compiler(void)
+{
+	if (!ctcli::is_option_set<"build --workers">() || ctcli::option_value<"build -s">)
 	{
-		return prebuild_exit_code;
+		return nullptr;
 	}
 
-	fill_last_modified_times(source_files);
-	analyze_source_files(
-		get_source_files_in_directory(build_config.source_directory),
-		build_config.include_paths,
-		source_files,
-		fs::exists(dependency_file_path)
-			? fs::last_write_time(dependency_file_path)
-			: fs::file_time_type::min(),
-		config_last_update
-	);
-	source_files.sort([](source_file const &lhs, source_file const &rhs) {
-		auto lhs_it = lhs.file_path.begin();
-		auto rhs_it = rhs.file_path.begin();
-		auto const lhs_end = lhs.file_path.end();
-		auto const rhs_end = rhs.file_path.end();
-
-		while (lhs_it != lhs_end && rhs_it != rhs_end)
+	auto workers = cppb::vector<worker_address>();
+	std::string_view worker_list = ctcli::option_value<"build --workers">;
+	while (true)
+	{
+		auto const comma = worker_list.find(',');
+		auto const address = worker_list.substr(0, comma);
+		auto worker = parse_worker_address(address);
+		if (!worker.has_value())
 		{
-			auto const compare_result = *lhs_it <=> *rhs_it;
-
-			++lhs_it;
-			++rhs_it;
-
-			if (lhs_it == lhs_end || rhs_it == rhs_end)
-			{
-				return lhs_it != lhs_end || (rhs_it == rhs_end && compare_result < 0);
-			}
-			else if (compare_result < 0)
-			{
-				return true;
-			}
-			else if (compare_result > 0)
-			{
-				return false;
-			}
+			report_error(
+				fmt::format("<command-line>:{}", ctcli::option_index<"build --workers">),
+				fmt::format("invalid worker address '{}', expected '<host>:<port>'", address)
+			);
+			exit(1);
 		}
+		workers.push_back(std::move(*worker));
 
-		// we should never get here...
-		return lhs_it != lhs_end;
-	});
-	write_dependency_json(dependency_file_path, source_files);
+		if (comma == std::string_view::npos)
+		{
+			break;
+		}
+		worker_list.remove_prefix(comma + 1);
+	}
+	return std::make_unique<distributed_compiler>(workers, get_job_count());
+}
 
-	auto [exit_code, any_run, any_cpp, object_files] = build_project(
-		build_config,
-		source_files,
-		intermediate_bin_directory,
-		cache_dir
-	);
-	if (exit_code != 0)
+static std::optional<remote_cache_url> get_remote_cache_url(std::string_view config_remote_cache)
+{
+	if (ctcli::is_option_set<"build --remote-cache">())
 	{
-		return exit_code;
+		auto const result = parse_remote_cache_url(ctcli::option_value<"build --remote-cache">);
+		if (!result.has_value())
+		{
+			report_error(
+				fmt::format("<command-line>:{}", ctcli::option_index<"build --remote-cache">),
+				fmt::format("invalid remote cache url '{}', expected 'http://<host>[:<port>][/<path>]'", ctcli::option_value<"build --remote-cache">)
+			);
+			exit(1);
+		}
+		return result;
 	}
-
-	// pre-link rules
-	auto const [prelink_exit_code, prelink_any_run, prelink_last_update] = run_rules("pre-link", build_config.prelink_rules, rules, config_last_update, error);
-	if (!error.empty())
+	else if (!config_remote_cache.empty())
 	{
-		report_error("cppb", error);
-		return 1;
+		return parse_remote_cache_url(config_remote_cache);
 	}
-	if (prelink_exit_code != 0)
+	else
 	{
-		return prelink_exit_code;
+		return std::nullopt;
 	}
+}
 
-	auto const [link_dep_exit_code, link_dep_any_run, link_dep_last_update] = run_rules("link dependency", build_config.link_dependencies, rules, config_last_update, error, false);
-	if (!error.empty())
+static int build_projects_with_cache(
+	cppb::vector<project_config const *> const &project_configs,
+	cppb::vector<rule> const &rules,
+	std::optional<std::uintmax_t> max_cache_size,
+	std::optional<remote_cache_url> remote_cache_url,
+	fs::file_time_type config_last_update
+)
+{
+	auto const cppb_dir = fs::path(ctcli::option_value<"build --cppb-dir">);
+	auto const cache_dir = cppb_dir / "cache";
+	auto const build_state_file = cppb_dir / "build_state.json";
+
+	auto state = read_build_state_json(build_state_file);
+	auto const build_start_time = get_current_time();
+	auto const distributed = get_distributed_compiler();
+	auto thread_pools = create_executor(distributed == nullptr ? 0 : distributed->remote_slot_count());
+	// the remote cache is destroyed first, it waits for the uploads that run on the io pool
+	auto remote = remote_cache_url.has_value()
+		? std::make_unique<remote_cache>(std::move(*remote_cache_url), thread_pools.get_pool(task_class::io))
+		: nullptr;
+	auto bypass = ctcli::option_value<"build --bypass-driver"> ? std::make_unique<driver_bypass>() : nullptr;
+	auto const launchers = get_compiler_launchers(project_configs);
+	auto const launcher_stats_before_build = launchers
+		.transform([](auto const &launcher) { return get_compiler_launcher_stats(launcher); })
+		.collect<cppb::vector>();
+	auto const exit_code = build_projects(
+		thread_pools, project_configs, rules, cache_dir, state, remote.get(), distributed.get(), bypass.get(), config_last_update
+	);
+	// a response file may be shared by several commands, so they're only removed once every command has finished
 	{
-		report_error("cppb", error);
-		return 1;
+		std::error_code ec;
+		fs::remove_all(get_response_file_directory(cppb_dir), ec);
 	}
-	if (link_dep_exit_code != 0)
+	print_compiler_launcher_stats(launchers, launcher_stats_before_build);
+
+	if (bypass != nullptr && ctcli::option_value<"build --verbose">)
 	{
-		return link_dep_exit_code;
+		fmt::print(
+			"compiled {} file{} without the compiler driver, {} with it\n",
+			bypass->bypass_count(), bypass->bypass_count() == 1 ? "" : "s",
+			bypass->driver_count()
+		);
+		std::fflush(stdout);
 	}
 
-	auto const link_dependency_last_update = std::max({ config_last_update, prelink_last_update, link_dep_last_update });
-
-	auto const link_exit_code = link_project(project_config.project_name, build_config, bin_directory, object_files, link_dependency_last_update, any_cpp);
-	if (link_exit_code != 0)
+	if (distributed != nullptr && ctcli::option_value<"build --verbose">)
 	{
-		return link_exit_code;
+		fmt::print(
+			"compiled {} file{} on workers, {} retried locally\n",
+			distributed->remote_compile_count(), distributed->remote_compile_count() == 1 ? "" : "s",
+			distributed->local_retry_count()
+		);
+		std::fflush(stdout);
 	}
 
-	// post-build rules
-	auto const [postbuild_exit_code, postbuild_any_run, postbuild_last_update] = run_rules("post-build", build_config.postbuild_rules, rules, config_last_update, error);
-	if (!error.empty())
+	if (remote != nullptr)
 	{
-		report_error("cppb", error);
-		return 1;
+		// uploads run in the background during the build, we only need to wait for the last few
+		auto const failed_upload_count = remote->wait_for_uploads();
+		if (failed_upload_count != 0)
+		{
+			report_warning(
+				"cppb",
+				fmt::format("{} upload{} to the remote cache failed", failed_upload_count, failed_upload_count == 1 ? "" : "s")
+			);
+		}
 	}
-	if (postbuild_exit_code != 0)
+
+	if (max_cache_size.has_value())
 	{
-		return postbuild_exit_code;
+		auto const entries = collect_cache_entries(ctcli::option_value<"build --bin-dir">, cache_dir, state);
+		auto const [removed_count, removed_size, remaining_size] = collect_cache_garbage(entries, state, max_cache_size, build_start_time);
+		if (removed_count != 0)
+		{
+			fmt::print(
+				"removed {} cache entr{} ({}), cache size is {}\n",
+				removed_count, removed_count == 1 ? "y" : "ies",
+				format_cache_size(removed_size), format_cache_size(remaining_size)
+			);
+			std::fflush(stdout);
+		}
 	}
 
-	return 0;
+	write_build_state_json(build_state_file, state);
+	return exit_code;
 }
 
 static int run_project(project_config const &project_config)
@@ -1202,11 +3146,7 @@ static int run_project(project_config const &project_config)
 	auto const &build_config = os::get_build_config(project_config);
 
 	auto const bin_directory = fs::path(ctcli::option_value<"build --bin-dir">) / os::config_name();
-
-	auto const project_directory_name = fs::current_path().filename().generic_string();
-	auto const executable_file_name = get_executable_name(project_directory_name, build_config, project_config.project_name);
-
-	auto const executable_file = fs::absolute(bin_directory / executable_file_name);
+	auto const executable_file = get_executable_file(bin_directory, build_config, project_config.project_name);
 
 	std::string run_info = fmt::format("running {}", fs::relative(executable_file).generic_string());
 	for (auto const &arg : build_config.run_args)
@@ -1224,35 +3164,62 @@ static int build_command(void)
 	std::string error;
 
 	auto const config_file_path = fs::path(ctcli::option_value<"build --config-file">);
-	auto const [project_configs, rules] = read_config_json(config_file_path, error);
+	auto const [project_configs, rules, config_max_cache_size, config_remote_cache] = read_config_json(config_file_path, error);
 	if (!error.empty())
 	{
 		report_error(config_file_path.generic_string(), error);
 		return 1;
 	}
 
-	auto const &project_config = [&project_configs = project_configs]() -> auto & {
-		std::string_view const config_to_build = ctcli::option_value<"build --build-config">;
-		auto const it = std::find_if(
-			project_configs.begin(), project_configs.end(),
-			[config_to_build](auto const &config) {
-				return config_to_build == config.project_name;
-			}
-		);
-		if (it == project_configs.end())
+	auto const configs_to_build = [&project_configs = project_configs]() {
+		if (ctcli::option_value<"build --all">)
 		{
-			report_error(
-				fmt::format("<command-line>:{}", ctcli::option_index<"build --build-config">),
-				fmt::format("unknown configuration '{}'", config_to_build)
+			return project_configs
+				.transform([](auto const &config) { return &config; })
+				.collect<cppb::vector>();
+		}
+
+		auto result = cppb::vector<project_config const *>();
+		std::string_view config_names = ctcli::option_value<"build --build-config">;
+		while (true)
+		{
+			auto const comma = config_names.find(',');
+			auto const config_to_build = config_names.substr(0, comma);
+			auto const it = std::find_if(
+				project_configs.begin(), project_configs.end(),
+				[config_to_build](auto const &config) {
+					return config_to_build == config.project_name;
+				}
 			);
-			exit(1);
+			if (it == project_configs.end())
+			{
+				report_error(
+					fmt::format("<command-line>:{}", ctcli::option_index<"build --build-config">),
+					fmt::format("unknown configuration '{}'", config_to_build)
+				);
+				exit(1);
+			}
+			if (std::find(result.begin(), result.end(), &*it) == result.end())
+			{
+				result.push_back(&*it);
+			}
+
+			if (comma == std::string_view::npos)
+			{
+				break;
+			}
+			config_names.remove_prefix(comma + 1);
 		}
-		return *it;
+		return result;
 	}();
 
-	fs::path cache_dir = ctcli::option_value<"build --cppb-dir">;
-	cache_dir /= "cache";
-	return build_project(project_config, rules, cache_dir, fs::last_write_time(config_file_path));
+	return build_projects_with_cache(
+		configs_to_build,
+		rules,
+		get_max_cache_size(config_max_cache_size),
+		get_remote_cache_url(config_remote_cache),
+		fs::last_write_time(config_file_path)
+	);
 }
 
 static int run_command(void)
@@ -1260,15 +3227,33 @@ static int run_command(void)
 	std::string error;
 
 	auto const config_file_path = fs::path(ctcli::option_value<"build --config-file">);
-	auto const [project_configs, rules] = read_config_json(config_file_path, error);
+	auto const [project_configs, rules, config_max_cache_size, config_remote_cache] = read_config_json(config_file_path, error);
 	if (!error.empty())
 	{
 		report_error(config_file_path.generic_string(), error);
 		return 1;
 	}
 
+	if (ctcli::option_value<"build --all">)
+	{
+		report_error(
+			fmt::format("<command-line>:{}", ctcli::option_index<"build --all">),
+			"'--all' can't be used with 'run', use 'build --all' and run a configuration with '--build-config'"
+		);
+		return 1;
+	}
+
 	auto const &project_config = [&project_configs = project_configs]() -> auto & {
 		std::string_view const config_to_build = ctcli::option_value<"build --build-config">;
+		// only one executable is run, so a list of configurations isn't accepted like it is by 'build'
+		if (config_to_build.find(',') != std::string_view::npos)
+		{
+			report_error(
+				fmt::format("<command-line>:{}", ctcli::option_index<"build --build-config">),
+				fmt::format("'run' takes a single configuration, got '{}'", config_to_build)
+			);
+			exit(1);
+		}
 		auto const it = std::find_if(
 			project_configs.begin(), project_configs.end(),
 			[config_to_build](auto const &config) {
@@ -1286,9 +3271,15 @@ static int run_command(void)
 		return *it;
 	}();
 
-	fs::path cache_dir = ctcli::option_value<"build --cppb-dir">;
-	cache_dir /= "cache";
-	auto const build_result = build_project(project_config, rules, cache_dir, fs::last_write_time(config_file_path));
+	auto configs_to_build = cppb::vector<decltype(&project_config)>();
+	configs_to_build.push_back(&project_config);
+	auto const build_result = build_projects_with_cache(
+		configs_to_build,
+		rules,
+		get_max_cache_size(config_max_cache_size),
+		get_remote_cache_url(config_remote_cache),
+		fs::last_write_time(config_file_path)
+	);
 
 	if (build_result != 0)
 	{
@@ -1302,7 +3293,7 @@ static int run_rule_command(void)
 	std::string error;
 
 	auto const config_file_path = fs::path(ctcli::option_value<"run-rule --config-file">);
-	auto const [project_configs, rules] = read_config_json(config_file_path, error);
+	auto const [project_configs, rules, max_cache_size, remote] = read_config_json(config_file_path, error);
 	if (!error.empty())
 	{
 		report_error(config_file_path.generic_string(), error);
@@ -1321,6 +3312,155 @@ static int run_rule_command(void)
 	return exit_code;
 }
 
+static int cache_command(void)
+{
+	std::string error;
+
+	auto const action = ctcli::command_value<"cache">;
+	if (action != "gc" && action != "stats" && action != "clear")
+	{
+		report_error(
+			fmt::format("<command-line>:{}", ctcli::command_index<"cache">),
+			fmt::format("unknown cache action '{}', expected one of gc, stats or clear", action)
+		);
+		return 1;
+	}
+
+	auto const max_cache_size = [&]() -> std::optional<std::uintmax_t> {
+		if (ctcli::is_option_set<"cache --max-cache-size">())
+		{
+			auto const result = parse_cache_size(ctcli::option_value<"cache --max-cache-size">);
+			if (!result.has_value())
+			{
+				report_error(
+					fmt::format("<command-line>:{}", ctcli::option_index<"cache --max-cache-size">),
+					fmt::format("invalid cache size '{}'", ctcli::option_value<"cache --max-cache-size">)
+				);
+				exit(1);
+			}
+			return result;
+		}
+
+		auto const config_file_path = fs::path(ctcli::option_value<"cache --config-file">);
+		if (!fs::exists(config_file_path))
+		{
+			return std::nullopt;
+		}
+		auto const config = read_config_json(config_file_path, error);
+		if (!error.empty())
+		{
+			report_error(config_file_path.generic_string(), error);
+			exit(1);
+		}
+		return config.max_cache_size;
+	}();
+
+	auto const cppb_dir = fs::path(ctcli::option_value<"cache --cppb-dir">);
+	auto const bin_dir = fs::path(ctcli::option_value<"cache --bin-dir">);
+	auto const cache_dir = cppb_dir / "cache";
+	auto const build_state_file = cppb_dir / "build_state.json";
+
+	auto state = read_build_state_json(build_state_file);
+	auto const entries = collect_cache_entries(bin_dir, cache_dir, state);
+	if (action != "stats")
+	{
+		std::error_code ec;
+		fs::remove_all(get_response_file_directory(cppb_dir), ec);
+	}
+
+	if (action == "stats")
+	{
+		auto const total_size = entries.transform([](auto const &entry) { return entry.size; }).sum();
+		auto const orphan_count = entries.filter([](auto const &entry) { return entry.is_orphan; }).collect<cppb::vector>().size();
+		auto const lookup_count = state.cache_hits + state.cache_misses;
+		fmt::print("entries:           {} ({} orphaned)\n", entries.size(), orphan_count);
+		fmt::print("size:              {}\n", format_cache_size(total_size));
+		if (max_cache_size.has_value())
+		{
+			fmt::print("max size:          {}\n", format_cache_size(*max_cache_size));
+		}
+		fmt::print("reclaimable size:  {}\n", format_cache_size(get_reclaimable_size(entries, max_cache_size)));
+		if (lookup_count == 0)
+		{
+			fmt::print("hit rate:          -\n");
+		}
+		else
+		{
+			fmt::print(
+				"hit rate:          {:.1f}% ({} hits, {} misses)\n",
+				100.0 * static_cast<double>(state.cache_hits) / static_cast<double>(lookup_count),
+				state.cache_hits, state.cache_misses
+			);
+		}
+		return 0;
+	}
+	else if (action == "gc")
+	{
+		auto const [removed_count, removed_size, remaining_size] = collect_cache_garbage(
+			entries, state, max_cache_size, std::numeric_limits<std::int64_t>::max()
+		);
+		write_build_state_json(build_state_file, state);
+		fmt::print(
+			"removed {} cache entr{} ({}), cache size is {}\n",
+			removed_count, removed_count == 1 ? "y" : "ies",
+			format_cache_size(removed_size), format_cache_size(remaining_size)
+		);
+		return 0;
+	}
+	else // if (action == "clear")
+	{
+		auto const total_size = entries.transform([](auto const &entry) { return entry.size; }).sum();
+		for (auto const &entry : entries)
+		{
+			std::error_code ec;
+			fs::remove(entry.output_file, ec);
+			fs::remove(entry.info_file, ec);
+		}
+		std::error_code ec;
+		fs::remove_all(cache_dir, ec);
+		fs::remove(build_state_file, ec);
+		fmt::print("removed {} cache entr{} ({})\n", entries.size(), entries.size() == 1 ? "y" : "ies", format_cache_size(total_size));
+		return 0;
+	}
+}
+
+static int cache_server_command(void)
+{
+	return run_cache_server(
+		fs::path(ctcli::option_value<"cache-server --dir">),
+		ctcli::option_value<"cache-server --host">,
+		ctcli::option_value<"cache-server --port">
+	);
+}
+
+static int worker_command(void)
+{
+	auto const slot_count = ctcli::is_option_set<"worker --jobs">()
+		? std::max(ctcli::option_value<"worker --jobs">, uint64_t(1))
+		: std::max(std::thread::hardware_concurrency(), 1u);
+	auto compilers = cppb::vector<std::string>();
+	std::string_view compiler_list = ctcli::option_value<"worker --compilers">;
+	while (true)
+	{
+		auto const comma = compiler_list.find(',');
+		if (auto const compiler = compiler_list.substr(0, comma); !compiler.empty())
+		{
+			compilers.emplace_back(compiler);
+		}
+		if (comma == std::string_view::npos)
+		{
+			break;
+		}
+		compiler_list.remove_prefix(comma + 1);
+	}
+	return run_worker(
+		ctcli::option_value<"worker --host">,
+		ctcli::option_value<"worker --port">,
+		slot_count,
+		compilers
+	);
+}
+
 static int new_command(void)
 {
 	auto const project_directory = fs::path(ctcli::command_value<"new">);
@@ -1387,6 +3527,18 @@ int main(int argc, char const **argv)
 	{
 		return new_command();
 	}
+	else if (ctcli::is_command_set<"cache">())
+	{
+		return cache_command();
+	}
+	else if (ctcli::is_command_set<"cache-server">())
+	{
+		return cache_server_command();
+	}
+	else if (ctcli::is_command_set<"worker">())
+	{
+		return worker_command();
+	}
 
 	return 0;
 }
@@ -0,0 +1,151 @@
+#include "output_queue.h"
+
+output_queue::output_queue(bool is_ordered)
+	: _is_ordered(is_ordered),
+	  _head(nullptr),
+	  _tail(nullptr),
+	  _push_count(0),
+	  _next_sequence_number(0),
+	  _held_messages(),
+	  _thread()
+{
+	// the queue always contains at least one message, so pushing never has to check for an empty queue
+	auto const initial_message = new message_t{
+		.next = nullptr,
+		.flushed = nullptr,
+		.sequence_number = std::nullopt,
+		.write = nullptr,
+	};
+	this->_head.store(initial_message);
+	this->_tail = initial_message;
+	this->_thread = std::jthread([this](std::stop_token stop_token) { this->run(std::move(stop_token)); });
+}
+
+output_queue::~output_queue(void)
+{
+	this->_thread.request_stop();
+	this->_push_count.fetch_add(1, std::memory_order_release);
+	this->_push_count.notify_one();
+	this->_thread.join();
+
+	// every message except the last one that was taken has been deleted by the output thread
+	delete this->_tail;
+}
+
+void output_queue::push(std::optional<std::size_t> sequence_number, std::function<void(void)> write)
+{
+	this->push_message(new message_t{
+		.next = nullptr,
+		.flushed = nullptr,
+		.sequence_number = sequence_number,
+		.write = std::move(write),
+	});
+}
+
+void output_queue::flush(void)
+{
+	std::atomic<bool> flushed{ false };
+	this->push_message(new message_t{
+		.next = nullptr,
+		.flushed = &flushed,
+		.sequence_number = std::nullopt,
+		.write = nullptr,
+	});
+	flushed.wait(false, std::memory_order_acquire);
+}
+
+void output_queue::push_message(message_t *message)
+{
+	auto const previous = this->_head.exchange(message, std::memory_order_acq_rel);
+	// between the exchange and this store the message isn't reachable from the front of the queue yet,
+	// which is why '_push_count' is only incremented afterwards
+	previous->next.store(message, std::memory_order_release);
+	this->_push_count.fetch_add(1, std::memory_order_release);
+	this->_push_count.notify_one();
+}
+
+output_queue::message_t *output_queue::pop_message(void)
+{
+	auto const next = this->_tail->next.load(std::memory_order_acquire);
+	if (next == nullptr)
+	{
+		return nullptr;
+	}
+	// the previous tail has already been written, 'next' becomes the new tail once it's written
+	delete this->_tail;
+	this->_tail = next;
+	return next;
+}
+
+void output_queue::write_message(message_t &message)
+{
+	if (message.flushed != nullptr)
+	{
+		this->write_held_messages();
+		std::fflush(stdout);
+		message.flushed->store(true, std::memory_order_release);
+		message.flushed->notify_one();
+		return;
+	}
+
+	if (!this->_is_ordered || !message.sequence_number.has_value() || *message.sequence_number < this->_next_sequence_number)
+	{
+		if (message.write)
+		{
+			message.write();
+		}
+	}
+	else
+	{
+		this->_held_messages.insert({ *message.sequence_number, std::move(message.write) });
+		for (
+			auto it = this->_held_messages.begin();
+			it != this->_held_messages.end() && it->first == this->_next_sequence_number;
+			it = this->_held_messages.erase(it)
+		)
+		{
+			if (it->second)
+			{
+				it->second();
+			}
+			this->_next_sequence_number += 1;
+		}
+	}
+	message.write = nullptr;
+}
+
+void output_queue::write_held_messages(void)
+{
+	for (auto &[sequence_number, write] : this->_held_messages)
+	{
+		if (write)
+		{
+			write();
+		}
+		this->_next_sequence_number = sequence_number + 1;
+	}
+	this->_held_messages.clear();
+}
+
+void output_queue::run(std::stop_token stop_token)
+{
+	while (true)
+	{
+		auto const push_count = this->_push_count.load(std::memory_order_acquire);
+		// checked before the queue is emptied, so nothing pushed before the destructor is lost
+		auto const is_stop_requested = stop_token.stop_requested();
+		while (auto const message = this->pop_message())
+		{
+			this->write_message(*message);
+		}
+		std::fflush(stdout);
+
+		if (is_stop_requested)
+		{
+			break;
+		}
+		this->_push_count.wait(push_count, std::memory_order_acquire);
+	}
+	this->write_held_messages();
+	std::fflush(stdout);
+}
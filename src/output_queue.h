@@ -0,0 +1,65 @@
+#ifndef OUTPUT_QUEUE_H
+#define OUTPUT_QUEUE_H
+
+#include "core.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <thread>
+
+// Output of concurrent build steps is written to stdout by a dedicated thread, so a worker never waits for
+// the terminal or for another worker.  Messages are pushed to a lock-free multiple-producer single-consumer
+// queue and written in the order they were pushed, i.e. in the order the compilations finished.
+// In ordered mode, messages with a sequence number are held back until every message with a lower
+// sequence number has been written, so the output doesn't depend on timing, e.g. for CI logs.
+struct output_queue
+{
+	explicit output_queue(bool is_ordered);
+	// writes the remaining messages before returning
+	~output_queue(void);
+
+	output_queue(output_queue const &other) = delete;
+	output_queue(output_queue &&other) = delete;
+	output_queue &operator = (output_queue const &rhs) = delete;
+	output_queue &operator = (output_queue &&rhs) = delete;
+
+	// 'write' is called on the output thread; it may be empty if 'sequence_number' has no output
+	void push(std::optional<std::size_t> sequence_number, std::function<void(void)> write);
+	// blocks until every message pushed before has been written, including the ones held back in ordered mode,
+	// e.g. before a command that prints directly to the terminal is started
+	void flush(void);
+
+private:
+	struct message_t
+	{
+		std::atomic<message_t *> next;
+		// set for the messages pushed by 'flush', the output thread sets it to true after writing everything before
+		std::atomic<bool> *flushed;
+		std::optional<std::size_t> sequence_number;
+		std::function<void(void)> write;
+	};
+
+	void push_message(message_t *message);
+	// only called on the output thread, returns nullptr if the queue is empty
+	message_t *pop_message(void);
+	void write_message(message_t &message);
+	void write_held_messages(void);
+	void run(std::stop_token stop_token);
+
+	bool _is_ordered;
+	// producers append to '_head', the output thread takes messages from the front; '_tail' is the last
+	// message that was taken, or the initial empty message
+	std::atomic<message_t *> _head;
+	message_t *_tail;
+	// incremented after a message has been linked into the queue, the output thread waits on it
+	std::atomic<std::uint64_t> _push_count;
+
+	// only used on the output thread
+	std::size_t _next_sequence_number;
+	std::map<std::size_t, std::function<void(void)>> _held_messages;
+
+	// declared last, so it's started after everything else is initialized
+	std::jthread _thread;
+};
+
+#endif // OUTPUT_QUEUE_H
@@ -1,17 +1,32 @@
 #include "process.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <thread>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
 #else
+#include <atomic>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #endif // windows
 
+#ifdef __linux__
+#include <future>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif // linux
+
 #ifdef _WIN32
 
 struct handle_closer
@@ -180,6 +195,32 @@ static BOOL CreateProcessWithExplicitHandles(
 	return fSuccess;
 }
 
+static std::int64_t get_microseconds(FILETIME time)
+{
+	// FILETIME is in 100 nanosecond units
+	return static_cast<std::int64_t>((std::uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10;
+}
+
+// Windows doesn't count context switches per process, and only counts page faults without
+// distinguishing hard and soft ones, so they're all reported as minor page faults
+static resource_usage get_resource_usage(HANDLE process)
+{
+	auto result = resource_usage();
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(process, &counters, sizeof counters))
+	{
+		result.peak_memory = static_cast<std::uint64_t>(counters.PeakWorkingSetSize);
+		result.minor_page_faults = static_cast<std::uint64_t>(counters.PageFaultCount);
+	}
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	if (GetProcessTimes(process, &creation_time, &exit_time, &kernel_time, &user_time))
+	{
+		result.user_time = get_microseconds(user_time);
+		result.system_time = get_microseconds(kernel_time);
+	}
+	return result;
+}
+
 static process_result run_process_with_capture(std::string_view command_line)
 {
 	auto result = process_result();
@@ -300,6 +341,7 @@ static process_result run_process_with_capture(std::string_view command_line)
 	}
 
 	WaitForSingleObject(process_info.hProcess, INFINITE);
+	result.usage = get_resource_usage(process_info.hProcess);
 
 	DWORD exit_code = 0;
 	if(GetExitCodeProcess(process_info.hProcess, &exit_code))
@@ -367,6 +409,7 @@ static process_result run_process_without_capture(std::string_view command_line)
 	auto thread_closer = handle_closer(process_info.hThread);
 
 	WaitForSingleObject(process_info.hProcess, INFINITE);
+	result.usage = get_resource_usage(process_info.hProcess);
 	DWORD exit_code = 0;
 	if(GetExitCodeProcess(process_info.hProcess, &exit_code))
 	{
@@ -380,6 +423,14 @@ static process_result run_process_without_capture(std::string_view command_line)
 	return result;
 }
 
+// running processes aren't tracked on windows yet, so they're left to finish
+void terminate_child_processes(void)
+{}
+
+// cppb isn't terminated by a signal handler on windows, so the destructors run instead
+void add_signal_cleanup(void (*)(void))
+{}
+
 // https://stackoverflow.com/a/46348112/11488457
 static process_result run_process(std::string_view command_line, bool capture)
 {
@@ -455,7 +506,7 @@ struct pipe_closer
 
 	~pipe_closer(void)
 	{
-		if (!this->_closed)
+		if (!this->_closed && this->_pipe_id >= 0)
 		{
 			close(this->_pipe_id);
 		}
@@ -468,7 +519,10 @@ struct pipe_closer
 
 	void reset(void)
 	{
-		close(this->_pipe_id);
+		if (this->_pipe_id >= 0)
+		{
+			close(this->_pipe_id);
+		}
 		this->_closed = true;
 	}
 
@@ -477,124 +531,502 @@ private:
 	bool _closed;
 };
 
-static process_result run_process(std::string_view command_line, bool capture)
+// captured commands, i.e. compilers, run in their own process group, so they can be terminated together with
+// the processes they started.  commands that aren't captured, e.g. rules, links and the executable of 'cppb run',
+// stay in the process group of cppb, so they can still read from the terminal, and they aren't tracked here:
+// they're left to finish, because a rule or link that is killed while it writes its output leaves a partial file
+// that looks up to date.  the ids are stored in atomics, because they're also used by the signal handler;
+// a process group is stored as the negated id of its leader, like it's passed to kill
+static constexpr std::size_t max_running_process_count = 1024;
+static std::array<std::atomic<pid_t>, max_running_process_count> running_processes{};
+// incremented on every call to terminate_child_processes
+static std::atomic<std::size_t> termination_count{ 0 };
+
+static constexpr std::size_t max_signal_cleanup_count = 8;
+static std::array<std::atomic<void (*)(void)>, max_signal_cleanup_count> signal_cleanups{};
+
+static bool add_running_process(pid_t id)
 {
-	auto result = process_result();
+	for (auto &process : running_processes)
+	{
+		pid_t expected = 0;
+		if (process.compare_exchange_strong(expected, id))
+		{
+			return true;
+		}
+	}
+	return false;
+}
 
-	static constexpr size_t PIPE_READ = 0;
-	static constexpr size_t PIPE_WRITE = 1;
+static void remove_running_process(pid_t id)
+{
+	for (auto &process : running_processes)
+	{
+		pid_t expected = id;
+		if (process.compare_exchange_strong(expected, 0))
+		{
+			return;
+		}
+	}
+}
 
-	int stdout_pipe[2];
-	int stderr_pipe[2];
+static void kill_running_processes(int signal)
+{
+	for (auto &process : running_processes)
+	{
+		if (auto const id = process.load(); id != 0)
+		{
+			kill(id, signal);
+		}
+	}
+}
 
-	if (capture && pipe(stdout_pipe) < 0)
+// children in their own process groups don't get the signals sent to the terminal's foreground process group,
+// e.g. on ctrl+c, so they're forwarded before cppb exits; the other children already got the signal
+static void forward_signal_and_exit(int signal)
+{
+	kill_running_processes(signal);
+	for (auto &cleanup : signal_cleanups)
 	{
-		result.exit_code = -1;
-		return result;
+		if (auto const fn = cleanup.load(); fn != nullptr)
+		{
+			fn();
+		}
 	}
-	auto stdout_read_closer = pipe_closer(stdout_pipe[PIPE_READ]);
-	auto stdout_write_closer = pipe_closer(stdout_pipe[PIPE_WRITE]);
+	std::signal(signal, SIG_DFL);
+	std::raise(signal);
+}
+
+static void install_signal_handlers(void)
+{
+	static bool const are_signal_handlers_installed = []() {
+		for (auto const signal : { SIGINT, SIGTERM, SIGHUP })
+		{
+			struct sigaction action = {};
+			action.sa_handler = &forward_signal_and_exit;
+			sigemptyset(&action.sa_mask);
+			sigaction(signal, &action, nullptr);
+		}
+		return true;
+	}();
+	static_cast<void>(are_signal_handlers_installed);
+}
 
-	if (capture && pipe(stderr_pipe) < 0)
+void terminate_child_processes(void)
+{
+	termination_count.fetch_add(1);
+	kill_running_processes(SIGTERM);
+}
+
+void add_signal_cleanup(void (*cleanup)(void))
+{
+	install_signal_handlers();
+	for (auto &slot : signal_cleanups)
 	{
-		result.exit_code = -1;
-		return result;
+		void (*expected)(void) = nullptr;
+		if (slot.compare_exchange_strong(expected, cleanup))
+		{
+			return;
+		}
 	}
-	auto stderr_read_closer = pipe_closer(stderr_pipe[PIPE_READ]);
-	auto stderr_write_closer = pipe_closer(stderr_pipe[PIPE_WRITE]);
+}
 
-	auto command_line_str = std::string(command_line);
-	char bin_sh[] = "/bin/sh";
-	char c[] = "-c";
+#ifdef __linux__
 
-	char *argv[] = {
-		bin_sh,
-		c,
-		command_line_str.data(),
-		nullptr
+// A single thread that reads the output of every captured child process and reaps it once it exits,
+// so a running command doesn't need a thread to read stderr.  Pipes and pidfds are multiplexed with epoll.
+struct process_supervisor
+{
+	process_supervisor(void)
+		: _epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+		  _stop_event_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+		  _buffer(),
+		  _thread()
+	{
+		if (this->_epoll_fd < 0 || this->_stop_event_fd < 0)
+		{
+			return;
+		}
+		auto event = epoll_event{ .events = EPOLLIN, .data = { .ptr = nullptr } };
+		if (epoll_ctl(this->_epoll_fd, EPOLL_CTL_ADD, this->_stop_event_fd, &event) != 0)
+		{
+			return;
+		}
+		this->_thread = std::jthread([this]() { this->run(); });
+	}
+
+	~process_supervisor(void)
+	{
+		if (this->_thread.joinable())
+		{
+			std::uint64_t const value = 1;
+			[[maybe_unused]] auto const write_result = write(this->_stop_event_fd, &value, sizeof value);
+			this->_thread.join();
+		}
+		if (this->_stop_event_fd >= 0)
+		{
+			close(this->_stop_event_fd);
+		}
+		if (this->_epoll_fd >= 0)
+		{
+			close(this->_epoll_fd);
+		}
+	}
+
+	process_supervisor(process_supervisor const &other) = delete;
+	process_supervisor(process_supervisor &&other) = delete;
+	process_supervisor &operator = (process_supervisor const &rhs) = delete;
+	process_supervisor &operator = (process_supervisor &&rhs) = delete;
+
+	// blocks until process 'id' has exited and both of its output pipes are closed;
+	// returns false without touching the process if it can't be supervised, e.g. on kernels without pidfd
+	bool wait(pid_t id, int stdout_fd, int stderr_fd, process_result &result, int &status, rusage &usage)
+	{
+		if (!this->_thread.joinable())
+		{
+			return false;
+		}
+		auto const pidfd = static_cast<int>(syscall(SYS_pidfd_open, id, 0));
+		if (pidfd < 0)
+		{
+			return false;
+		}
+
+		auto process = supervised_process{
+			.id = id,
+			.sources = {},
+			.open_source_count = 3,
+			.status = status,
+			.usage = usage,
+			.finished = {},
+		};
+		process.sources[0] = { .fd = stdout_fd, .output = &result.stdout_string, .process = &process };
+		process.sources[1] = { .fd = stderr_fd, .output = &result.stderr_string, .process = &process };
+		process.sources[2] = { .fd = pidfd, .output = nullptr, .process = &process };
+		auto finished = process.finished.get_future();
+
+		for (auto &source : process.sources)
+		{
+			if (source.output != nullptr)
+			{
+				fcntl(source.fd, F_SETFL, fcntl(source.fd, F_GETFL) | O_NONBLOCK);
+			}
+			auto event = epoll_event{ .events = EPOLLIN, .data = { .ptr = &source } };
+			// this can only fail if we run out of memory, there's no way to recover from that here
+			epoll_ctl(this->_epoll_fd, EPOLL_CTL_ADD, source.fd, &event);
+		}
+
+		finished.wait();
+		close(pidfd);
+		return true;
+	}
+
+private:
+	struct supervised_process;
+
+	struct event_source
+	{
+		int fd;
+		// nullptr for the pidfd
+		std::string *output;
+		supervised_process *process;
 	};
 
-	int id = fork();
-	if (id == 0)
+	struct supervised_process
 	{
-		// child continues here
+		pid_t id;
+		std::array<event_source, 3> sources;
+		int open_source_count;
+		int &status;
+		rusage &usage;
+		std::promise<void> finished;
+	};
 
-		// redirect stdout
-		if (capture && dup2(stdout_pipe[PIPE_WRITE], STDOUT_FILENO) == -1)
+	// returns true if the source is done, i.e. the pipe was closed or the process was reaped
+	bool handle_event(event_source &source)
+	{
+		if (source.output == nullptr)
 		{
-			exit(errno);
+			auto &process = *source.process;
+			return wait4(process.id, &process.status, WNOHANG, &process.usage) != 0;
 		}
-		stdout_write_closer.reset();
-		stdout_read_closer.reset();
 
-		// redirect stderr
-		if (capture && dup2(stderr_pipe[PIPE_WRITE], STDERR_FILENO) == -1)
+		// compiler output can be large, so it's read in big chunks until the pipe is empty
+		while (true)
 		{
-			exit(errno);
+			auto const read_size = read(source.fd, this->_buffer.data(), this->_buffer.size());
+			if (read_size > 0)
+			{
+				source.output->append(this->_buffer.data(), static_cast<std::size_t>(read_size));
+			}
+			else if (read_size == 0)
+			{
+				return true;
+			}
+			else if (errno == EINTR)
+			{
+				continue;
+			}
+			else
+			{
+				return errno != EAGAIN;
+			}
 		}
-		stderr_write_closer.reset();
-		stderr_read_closer.reset();
+	}
+
+	void run(void)
+	{
+		std::array<epoll_event, 64> events = {};
+		while (true)
+		{
+			auto const event_count = epoll_wait(this->_epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+			for (int i = 0; i < event_count; ++i)
+			{
+				auto const source = static_cast<event_source *>(events[static_cast<std::size_t>(i)].data.ptr);
+				if (source == nullptr)
+				{
+					return;
+				}
+				if (!this->handle_event(*source))
+				{
+					continue;
+				}
+
+				epoll_ctl(this->_epoll_fd, EPOLL_CTL_DEL, source->fd, nullptr);
+				auto &process = *source->process;
+				process.open_source_count -= 1;
+				if (process.open_source_count == 0)
+				{
+					// the waiting thread destroys 'process' as soon as the promise is set, so it's moved out first
+					auto finished = std::move(process.finished);
+					finished.set_value();
+				}
+			}
+		}
+	}
+
+	int _epoll_fd;
+	int _stop_event_fd;
+	// only used on the supervisor thread
+	std::array<char, 65536> _buffer;
+	std::jthread _thread;
+};
+
+static process_supervisor &get_process_supervisor(void)
+{
+	static process_supervisor supervisor;
+	return supervisor;
+}
+
+#endif // linux
+
+// the pipes are closed on exec, so a child doesn't keep the pipes of commands started concurrently by other threads
+// open; the ends that are redirected to stdout and stderr of the child lose the flag with dup2
+static bool create_pipe(int (&pipe_ids)[2])
+{
+#ifdef __linux__
+	return pipe2(pipe_ids, O_CLOEXEC) == 0;
+#else
+	if (pipe(pipe_ids) != 0)
+	{
+		return false;
+	}
+	fcntl(pipe_ids[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pipe_ids[1], F_SETFD, FD_CLOEXEC);
+	return true;
+#endif // linux
+}
+
+static std::int64_t get_microseconds(timeval time)
+{
+	return static_cast<std::int64_t>(time.tv_sec) * 1'000'000 + static_cast<std::int64_t>(time.tv_usec);
+}
+
+// the child shares the address space of cppb until exec, and linux keeps the high-water mark across exec,
+// so the peak memory of a small command is at least the resident set size cppb had when it was started
+static resource_usage get_resource_usage(rusage const &usage)
+{
+	return resource_usage{
+		.user_time = get_microseconds(usage.ru_utime),
+		.system_time = get_microseconds(usage.ru_stime),
+#ifdef __APPLE__
+		.peak_memory = static_cast<std::uint64_t>(usage.ru_maxrss),
+#else
+		.peak_memory = static_cast<std::uint64_t>(usage.ru_maxrss) * 1024,
+#endif // __APPLE__
+		.minor_page_faults = static_cast<std::uint64_t>(usage.ru_minflt),
+		.major_page_faults = static_cast<std::uint64_t>(usage.ru_majflt),
+		.voluntary_context_switches = static_cast<std::uint64_t>(usage.ru_nvcsw),
+		.involuntary_context_switches = static_cast<std::uint64_t>(usage.ru_nivcsw),
+	};
+}
 
-		// run child process image
-		// replace this with any exec* function find easier to use ("man exec")
-		auto const execv_result = execv(bin_sh, argv);
+extern char **environ;
 
-		perror("execv");
-		// if we get here at all, an error occurred, but we are in the child
-		// process, so just exit
-		exit(execv_result);
+// Commands are started with posix_spawn instead of fork, because fork copies the page tables of the parent,
+// which gets slow during large builds with many threads starting processes at the same time.  glibc and macOS
+// implement it without copying the address space, e.g. with clone(CLONE_VM | CLONE_VFORK) on linux.
+// If 'new_process_group' is true, the child gets its own process group before exec, so it can be terminated
+// together with its own children.  'argv[0]' is looked up in PATH like with execvp, 'argv' ends with nullptr;
+// 'stdout_pipe_id' and 'stderr_pipe_id' are -1 if the output isn't redirected; returns 0 or an error number.
+static int spawn_process(char *const *argv, int stdout_pipe_id, int stderr_pipe_id, bool new_process_group, pid_t &id)
+{
+	posix_spawn_file_actions_t file_actions;
+	if (auto const error = posix_spawn_file_actions_init(&file_actions); error != 0)
+	{
+		return error;
 	}
-	else if (id > 0)
+	posix_spawnattr_t attributes;
+	if (auto const error = posix_spawnattr_init(&attributes); error != 0)
 	{
-		// parent continues here
+		posix_spawn_file_actions_destroy(&file_actions);
+		return error;
+	}
+
+	auto result = 0;
+	if (stdout_pipe_id >= 0 && result == 0)
+	{
+		result = posix_spawn_file_actions_adddup2(&file_actions, stdout_pipe_id, STDOUT_FILENO);
+	}
+	if (stderr_pipe_id >= 0 && result == 0)
+	{
+		result = posix_spawn_file_actions_adddup2(&file_actions, stderr_pipe_id, STDERR_FILENO);
+	}
+	if (new_process_group && result == 0)
+	{
+		result = posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+	}
+	if (new_process_group && result == 0)
+	{
+		result = posix_spawnattr_setpgroup(&attributes, 0);
+	}
+	if (result == 0)
+	{
+		result = posix_spawnp(&id, argv[0], &file_actions, &attributes, argv, environ);
+	}
+
+	posix_spawnattr_destroy(&attributes);
+	posix_spawn_file_actions_destroy(&file_actions);
+	return result;
+}
+
+// 'arguments' starts with the executable
+static process_result run_process(cppb::vector<std::string> const &arguments, bool capture)
+{
+	auto result = process_result();
+
+	static constexpr size_t PIPE_READ = 0;
+	static constexpr size_t PIPE_WRITE = 1;
+
+	int stdout_pipe[2] = { -1, -1 };
+	int stderr_pipe[2] = { -1, -1 };
+
+	if (capture && !create_pipe(stdout_pipe))
+	{
+		result.exit_code = -1;
+		return result;
+	}
+	auto stdout_read_closer = pipe_closer(stdout_pipe[PIPE_READ]);
+	auto stdout_write_closer = pipe_closer(stdout_pipe[PIPE_WRITE]);
+
+	if (capture && !create_pipe(stderr_pipe))
+	{
+		result.exit_code = -1;
+		return result;
+	}
+	auto stderr_read_closer = pipe_closer(stderr_pipe[PIPE_READ]);
+	auto stderr_write_closer = pipe_closer(stderr_pipe[PIPE_WRITE]);
+
+	auto argv = arguments
+		.transform([](std::string const &argument) { return const_cast<char *>(argument.c_str()); })
+		.collect<cppb::vector>();
+	argv.push_back(nullptr);
+
+	install_signal_handlers();
+	auto const termination_count_before_start = termination_count.load();
+
+	pid_t id = -1;
+	// a captured command can't read from the terminal anyway, so only these leave its foreground process group
+	if (auto const spawn_error = spawn_process(argv.data(), stdout_pipe[PIPE_WRITE], stderr_pipe[PIPE_WRITE], capture, id); spawn_error == 0)
+	{
+		auto const is_running_process_added = capture && add_running_process(-id);
 
 		// close unused file descriptors, these are for child only
 		stdout_write_closer.reset();
 		stderr_write_closer.reset();
 
-		if (capture)
+		int status = 0;
+		rusage usage = {};
+		pid_t wait_result = id;
+#ifdef __linux__
+		auto const is_supervised = capture && get_process_supervisor().wait(
+			id, stdout_pipe[PIPE_READ], stderr_pipe[PIPE_READ], result, status, usage
+		);
+#else
+		auto const is_supervised = false;
+#endif // linux
+		if (!is_supervised)
 		{
-			// stdout and stderr need to be read simultaneously, otherwise the buffer fills up, and blocks reads
-			auto stderr_reader_thread = std::jthread([&result, stderr_read_pipe = stderr_pipe[PIPE_READ]]() {
+			if (capture)
+			{
+				// stdout and stderr need to be read simultaneously, otherwise the buffer fills up, and blocks reads
+				auto stderr_reader_thread = std::jthread([&result, stderr_read_pipe = stderr_pipe[PIPE_READ]]() {
+					std::array<char, 1024> buffer = {};
+					while (true)
+					{
+						auto const read_size = read(stderr_read_pipe, buffer.data(), buffer.size());
+						if (read_size == 0)
+						{
+							break;
+						}
+						result.stderr_string += std::string_view(buffer.data(), static_cast<size_t>(read_size));
+					}
+				});
+
+				auto const stdout_read_pipe = stdout_pipe[PIPE_READ];
 				std::array<char, 1024> buffer = {};
 				while (true)
 				{
-					auto const read_size = read(stderr_read_pipe, buffer.data(), buffer.size());
+					auto const read_size = read(stdout_read_pipe, buffer.data(), buffer.size());
 					if (read_size == 0)
 					{
 						break;
 					}
-					result.stderr_string += std::string_view(buffer.data(), static_cast<size_t>(read_size));
+					result.stdout_string += std::string_view(buffer.data(), static_cast<size_t>(read_size));
 				}
-			});
-
-			auto const stdout_read_pipe = stdout_pipe[PIPE_READ];
-			std::array<char, 1024> buffer = {};
-			while (true)
-			{
-				auto const read_size = read(stdout_read_pipe, buffer.data(), buffer.size());
-				if (read_size == 0)
-				{
-					break;
-				}
-				result.stdout_string += std::string_view(buffer.data(), static_cast<size_t>(read_size));
 			}
+			wait_result = wait4(id, &status, 0, &usage);
 		}
-
-		int status;
-		if (waitpid(id, &status, 0) < 0)
+		if (is_running_process_added)
+		{
+			remove_running_process(-id);
+		}
+		if (wait_result < 0)
 		{
 			result.exit_code = -1;
 		}
 		else
 		{
 			result.exit_code = status;
+			result.was_terminated = WIFSIGNALED(status) && termination_count.load() != termination_count_before_start;
+			// this includes the processes started by the child, e.g. cc1plus started by g++
+			result.usage = get_resource_usage(usage);
 		}
 	}
 	else
 	{
-		// failed to create child
+		// failed to create child, e.g. because the executable doesn't exist;
+		// the message is reported like the output of the command would be
 		result.exit_code = -1;
+		auto message = fmt::format("cppb: error: unable to run '{}': {}\n", arguments[0], std::strerror(spawn_error));
+		if (capture)
+		{
+			result.stderr_string = std::move(message);
+		}
+		else
+		{
+			std::fputs(message.c_str(), stderr);
+		}
 	}
 
 	if (capture)
@@ -669,6 +1101,17 @@ static void write_escaped_string(std::string &buffer, std::string_view str)
 
 #endif // windows
 
+void add_resource_usage(resource_usage &lhs, resource_usage const &rhs)
+{
+	lhs.user_time += rhs.user_time;
+	lhs.system_time += rhs.system_time;
+	lhs.peak_memory = std::max(lhs.peak_memory, rhs.peak_memory);
+	lhs.minor_page_faults += rhs.minor_page_faults;
+	lhs.major_page_faults += rhs.major_page_faults;
+	lhs.voluntary_context_switches += rhs.voluntary_context_switches;
+	lhs.involuntary_context_switches += rhs.involuntary_context_switches;
+}
+
 std::string make_command_string(std::string_view command, cppb::span<std::string const> args)
 {
 	std::string command_string = "";
@@ -683,6 +1126,8 @@ std::string make_command_string(std::string_view command, cppb::span<std::string
 	return command_string;
 }
 
+#ifdef _WIN32
+
 process_result run_command(std::string_view command, bool capture)
 {
 	return run_process(command, capture);
@@ -690,11 +1135,35 @@ process_result run_command(std::string_view command, bool capture)
 
 process_result run_command(std::string_view executable, cppb::vector<std::string> const &arguments, bool capture)
 {
-	return run_command(make_command_string(executable, arguments), capture);
+	return run_process(make_command_string(executable, arguments), capture);
+}
+
+#else
+
+process_result run_command(std::string_view command, bool capture)
+{
+	auto arguments = cppb::vector<std::string>();
+	arguments.emplace_back("/bin/sh");
+	arguments.emplace_back("-c");
+	arguments.emplace_back(command);
+	return run_process(arguments, capture);
+}
+
+// the executable is started directly instead of through the shell, which saves a process and
+// doesn't need the arguments to be quoted
+process_result run_command(std::string_view executable, cppb::vector<std::string> const &arguments, bool capture)
+{
+	auto argv = cppb::vector<std::string>();
+	argv.reserve(arguments.size() + 1);
+	argv.emplace_back(executable);
+	argv.append(arguments);
+	return run_process(argv, capture);
 }
 
+#endif // windows
+
 std::pair<std::string, bool> capture_command_output(std::string_view executable, cppb::vector<std::string> const &arguments)
 {
-	auto const process_result = run_process(make_command_string(executable, arguments), true);
+	auto const process_result = run_command(executable, arguments, true);
 	return { process_result.stdout_string + process_result.stderr_string, process_result.exit_code == 0 };
 }
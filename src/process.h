@@ -4,11 +4,30 @@
 #include "core.h"
 #include <span>
 
+// resources used by a command, including the processes started by it, e.g. cc1plus started by g++;
+// every field is 0 if it's unknown
+struct resource_usage
+{
+	std::int64_t  user_time   = 0; // microseconds
+	std::int64_t  system_time = 0; // microseconds
+	std::uint64_t peak_memory = 0; // maximum resident set size in bytes
+	std::uint64_t minor_page_faults = 0;
+	std::uint64_t major_page_faults = 0;
+	std::uint64_t voluntary_context_switches   = 0;
+	std::uint64_t involuntary_context_switches = 0;
+};
+
+// adds up the times and counts of two usages; the peak memory is the larger of the two,
+// because the commands of a rule run one after the other
+void add_resource_usage(resource_usage &lhs, resource_usage const &rhs);
+
 struct process_result
 {
 	int error_count = 0;
 	int warning_count = 0;
 	int exit_code = 0;
+	resource_usage usage;
+	bool was_terminated = false; // by terminate_child_processes
 	std::string stdout_string;
 	std::string stderr_string;
 };
@@ -18,4 +37,11 @@ process_result run_command(std::string_view command, bool capture);
 process_result run_command(std::string_view executable, cppb::vector<std::string> const &arguments, bool capture);
 std::pair<std::string, bool> capture_command_output(std::string_view executable, cppb::vector<std::string> const &arguments);
 
+// sends SIGTERM to the process group of every running captured command, i.e. the compilers, so the processes
+// started by them are terminated too; rules and links aren't captured, and they're left to finish
+void terminate_child_processes(void);
+// 'cleanup' is called when cppb is terminated by SIGINT, SIGTERM or SIGHUP, when destructors don't run;
+// it's called from a signal handler, so it must be async-signal-safe
+void add_signal_cleanup(void (*cleanup)(void));
+
 #endif // PROCESS_H
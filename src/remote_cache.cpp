@@ -0,0 +1,159 @@
+#include "remote_cache.h"
+#include "http.h"
+#include <atomic>
+#include <fstream>
+#include <iterator>
+
+std::optional<remote_cache_url> parse_remote_cache_url(std::string_view url)
+{
+	constexpr std::string_view http_prefix = "http://";
+	if (!url.starts_with(http_prefix))
+	{
+		return std::nullopt;
+	}
+	url.remove_prefix(http_prefix.size());
+
+	auto const path_begin = url.find('/');
+	auto const authority = url.substr(0, path_begin);
+	auto path = path_begin == std::string_view::npos ? std::string_view() : url.substr(path_begin);
+	while (path.ends_with('/'))
+	{
+		path.remove_suffix(1);
+	}
+
+	auto const port_begin = authority.rfind(':');
+	auto const host = authority.substr(0, port_begin);
+	auto const port = port_begin == std::string_view::npos ? std::string_view("80") : authority.substr(port_begin + 1);
+	if (host.empty() || !parse_decimal(port).has_value())
+	{
+		return std::nullopt;
+	}
+
+	return remote_cache_url{
+		.host = std::string(host),
+		.port = std::string(port),
+		.path = std::string(path),
+	};
+}
+
+remote_cache::remote_cache(remote_cache_url url, thread_pool &upload_pool)
+	: _url(std::move(url)),
+	  _upload_pool(upload_pool),
+	  _uploads_mutex(),
+	  _uploads()
+{}
+
+remote_cache::~remote_cache(void)
+{
+	this->wait_for_uploads();
+}
+
+std::optional<std::string> remote_cache::get(std::string_view key)
+{
+	// no key is computed for sources that can't be preprocessed
+	if (key.empty())
+	{
+		return std::nullopt;
+	}
+	auto response = send_http_request(this->_url.host, this->_url.port, "GET", fmt::format("{}/{}", this->_url.path, key), "");
+	if (!response.has_value() || response->status != 200)
+	{
+		return std::nullopt;
+	}
+	return std::move(response->body);
+}
+
+void remote_cache::put_async(std::string key, std::string data)
+{
+	auto future = this->_upload_pool.push_task([this, key = std::move(key), data = std::move(data)]() {
+		auto const response = send_http_request(this->_url.host, this->_url.port, "PUT", fmt::format("{}/{}", this->_url.path, key), data);
+		return response.has_value() && response->status >= 200 && response->status < 300;
+	});
+	auto const uploads_guard = std::lock_guard(this->_uploads_mutex);
+	this->_uploads.push_back(std::move(future));
+}
+
+std::size_t remote_cache::wait_for_uploads(void)
+{
+	auto const uploads_guard = std::lock_guard(this->_uploads_mutex);
+	std::size_t failed_count = 0;
+	for (auto &upload : this->_uploads)
+	{
+		if (!upload.get())
+		{
+			failed_count += 1;
+		}
+	}
+	this->_uploads.clear();
+	return failed_count;
+}
+
+static bool is_valid_cache_key(std::string_view key)
+{
+	return !key.empty() && key.size() <= 128 && ranges::basic_range(key).is_all([](auto const c) {
+		return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '_';
+	});
+}
+
+static fs::path get_cache_server_file(fs::path const &directory, std::string_view key)
+{
+	return directory / key.substr(0, 2) / key;
+}
+
+static http_response handle_cache_server_request(http_request const &request, fs::path const &directory)
+{
+	auto const key = std::string_view(request.target).substr(request.target.rfind('/') + 1);
+	if (!is_valid_cache_key(key))
+	{
+		return { 400, "" };
+	}
+
+	auto const file = get_cache_server_file(directory, key);
+	if (request.method == "GET")
+	{
+		std::ifstream input(file, std::ios::binary);
+		if (!input.is_open())
+		{
+			return { 404, "" };
+		}
+		return { 200, std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()) };
+	}
+	else if (request.method == "PUT")
+	{
+		// write to a temporary file first, so concurrent readers never see a partial entry
+		std::error_code ec;
+		fs::create_directories(file.parent_path(), ec);
+		static std::atomic<std::uint64_t> temp_file_counter = 0;
+		auto temp_file = file;
+		temp_file += fmt::format(".tmp{}", temp_file_counter.fetch_add(1));
+		{
+			std::ofstream output(temp_file, std::ios::binary);
+			output.write(request.body.data(), static_cast<std::streamsize>(request.body.size()));
+			if (!output)
+			{
+				return { 500, "" };
+			}
+		}
+		fs::rename(temp_file, file, ec);
+		if (ec)
+		{
+			fs::remove(temp_file, ec);
+			return { 500, "" };
+		}
+		return { 200, "" };
+	}
+	else
+	{
+		return { 405, "" };
+	}
+}
+
+int run_cache_server(fs::path const &directory, std::string_view host, std::uint16_t port)
+{
+	fs::create_directories(directory);
+	return run_http_server(
+		host, port, std::max(std::thread::hardware_concurrency(), 4u),
+		fmt::format("serving cache directory '{}'", directory.generic_string()),
+		[&directory](http_request const &request) { return handle_cache_server_request(request, directory); }
+	);
+}
@@ -0,0 +1,46 @@
+#ifndef REMOTE_CACHE_H
+#define REMOTE_CACHE_H
+
+#include "core.h"
+#include "thread_pool.h"
+#include <mutex>
+
+struct remote_cache_url
+{
+	std::string host;
+	std::string port;
+	std::string path; // without a trailing '/'
+};
+
+std::optional<remote_cache_url> parse_remote_cache_url(std::string_view url);
+
+// a content-addressed object store that is accessed with plain HTTP GET/PUT requests on '<url>/<key>',
+// which is compatible with e.g. bazel-remote's '/ac' endpoint or the local 'cppb cache-server'
+struct remote_cache
+{
+	// uploads run on 'upload_pool', which must outlive the remote cache
+	remote_cache(remote_cache_url url, thread_pool &upload_pool);
+	~remote_cache(void);
+
+	remote_cache(remote_cache const &other) = delete;
+	remote_cache(remote_cache &&other) = delete;
+	remote_cache &operator = (remote_cache const &rhs) = delete;
+	remote_cache &operator = (remote_cache &&rhs) = delete;
+
+	// looks up 'key' on the calling thread; a missing or unreachable entry results in std::nullopt
+	std::optional<std::string> get(std::string_view key);
+	// queues an upload and returns immediately
+	void put_async(std::string key, std::string data);
+	// blocks until all queued uploads have finished, returns the number of failed uploads
+	std::size_t wait_for_uploads(void);
+
+private:
+	remote_cache_url _url;
+	thread_pool &_upload_pool;
+	std::mutex _uploads_mutex;
+	cppb::vector<std::future<bool>> _uploads;
+};
+
+int run_cache_server(fs::path const &directory, std::string_view host, std::uint16_t port);
+
+#endif // REMOTE_CACHE_H
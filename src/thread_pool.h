@@ -3,114 +3,595 @@
 
 #include "core.h"
 
-#include <optional>
+#include <atomic>
+#include <cstddef>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <thread>
-#include <semaphore>
+#include <type_traits>
+#include <utility>
 
+// a move-only type-erased 'void()' callable; callables that fit into the buffer are stored inline,
+// which covers the usual lambda with a few captured references and a 'std::promise'
+struct small_task
+{
+	static constexpr std::size_t buffer_size = 64;
+
+	template<typename Func>
+	explicit small_task(Func &&func)
+	{
+		using func_t = std::decay_t<Func>;
+		if constexpr (
+			sizeof(func_t) <= buffer_size
+			&& alignof(func_t) <= alignof(std::max_align_t)
+			&& std::is_nothrow_move_constructible_v<func_t>
+		)
+		{
+			::new (static_cast<void *>(this->_buffer)) func_t(std::forward<Func>(func));
+			this->_vtable = &inline_vtable<func_t>;
+		}
+		else
+		{
+			::new (static_cast<void *>(this->_buffer)) func_t *(new func_t(std::forward<Func>(func)));
+			this->_vtable = &heap_vtable<func_t>;
+		}
+	}
+
+	small_task(small_task &&other) noexcept
+		: _vtable(other._vtable)
+	{
+		this->_vtable->move(this->_buffer, other._buffer);
+	}
+
+	small_task(small_task const &other) = delete;
+	small_task &operator = (small_task const &rhs) = delete;
+	small_task &operator = (small_task &&rhs) = delete;
+
+	~small_task(void)
+	{
+		this->_vtable->destroy(this->_buffer);
+	}
+
+	void operator () (void)
+	{
+		this->_vtable->invoke(this->_buffer);
+	}
+
+private:
+	struct vtable_t
+	{
+		void (*invoke)(void *buffer);
+		void (*move)(void *dest, void *source) noexcept;
+		void (*destroy)(void *buffer) noexcept;
+	};
+
+	template<typename Func>
+	static constexpr vtable_t inline_vtable = {
+		.invoke  = [](void *buffer) { (*static_cast<Func *>(buffer))(); },
+		.move    = [](void *dest, void *source) noexcept {
+			::new (dest) Func(std::move(*static_cast<Func *>(source)));
+		},
+		.destroy = [](void *buffer) noexcept { static_cast<Func *>(buffer)->~Func(); },
+	};
+
+	// the source is left with a null pointer after a move, which is safe to delete
+	template<typename Func>
+	static constexpr vtable_t heap_vtable = {
+		.invoke  = [](void *buffer) { (**static_cast<Func **>(buffer))(); },
+		.move    = [](void *dest, void *source) noexcept {
+			::new (dest) Func *(std::exchange(*static_cast<Func **>(source), nullptr));
+		},
+		.destroy = [](void *buffer) noexcept { delete *static_cast<Func **>(buffer); },
+	};
+
+	alignas(std::max_align_t) unsigned char _buffer[buffer_size];
+	vtable_t const *_vtable;
+};
+
+// storage for a 'small_task' that is reused once the task has run, so pushing a task doesn't allocate
+// in the steady state; 'next_free' is used while the storage is in a free list
+union task_storage
+{
+	task_storage(void)
+		: next_free(nullptr)
+	{}
+	~task_storage(void)
+	{}
+
+	task_storage(task_storage const &other) = delete;
+	task_storage(task_storage &&other) = delete;
+	task_storage &operator = (task_storage const &rhs) = delete;
+	task_storage &operator = (task_storage &&rhs) = delete;
+
+	small_task task;
+	task_storage *next_free;
+};
+
+// Chase-Lev work-stealing deque, see "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al., 2013);
+// the owning worker pushes and pops at the bottom, other workers steal from the top without taking a lock
+struct work_stealing_deque
+{
+	work_stealing_deque(void)
+		: _top(0),
+		  _bottom(0),
+		  _buffer(nullptr),
+		  _buffers()
+	{
+		this->_buffers.push_back(std::make_unique<ring_buffer>(initial_capacity));
+		this->_buffer.store(this->_buffers.back().get(), std::memory_order_relaxed);
+	}
+
+	work_stealing_deque(work_stealing_deque const &other) = delete;
+	work_stealing_deque(work_stealing_deque &&other) = delete;
+	work_stealing_deque &operator = (work_stealing_deque const &rhs) = delete;
+	work_stealing_deque &operator = (work_stealing_deque &&rhs) = delete;
+
+	// called from the owning worker thread only
+	void push(small_task *task)
+	{
+		auto const bottom = this->_bottom.load(std::memory_order_relaxed);
+		auto const top = this->_top.load(std::memory_order_acquire);
+		auto buffer = this->_buffer.load(std::memory_order_relaxed);
+		if (bottom - top > buffer->capacity - 1)
+		{
+			buffer = this->grow(buffer, top, bottom);
+		}
+		buffer->store(bottom, task);
+		// pairs with the acquire load in 'steal', so a thief sees the fully constructed task
+		this->_bottom.store(bottom + 1, std::memory_order_release);
+	}
+
+	// called from the owning worker thread only
+	small_task *pop(void)
+	{
+		auto const bottom = this->_bottom.load(std::memory_order_relaxed) - 1;
+		auto const buffer = this->_buffer.load(std::memory_order_relaxed);
+		this->_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto top = this->_top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			// the deque was empty
+			this->_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		auto result = buffer->load(bottom);
+		if (top == bottom)
+		{
+			// this is the last element, so we race with the thieves for it
+			if (!this->_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				result = nullptr;
+			}
+			this->_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return result;
+	}
+
+	// can be called from any thread
+	small_task *steal(void)
+	{
+		auto top = this->_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto const bottom = this->_bottom.load(std::memory_order_acquire);
+		if (top >= bottom)
+		{
+			return nullptr;
+		}
+
+		auto const buffer = this->_buffer.load(std::memory_order_acquire);
+		auto const result = buffer->load(top);
+		if (!this->_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			// another thread got this element first
+			return nullptr;
+		}
+		return result;
+	}
+
+	bool is_empty(void) const
+	{
+		return this->_top.load(std::memory_order_relaxed) >= this->_bottom.load(std::memory_order_relaxed);
+	}
+
+private:
+	static constexpr std::int64_t initial_capacity = 256;
+
+	struct ring_buffer
+	{
+		explicit ring_buffer(std::int64_t capacity_)
+			: capacity(capacity_),
+			  elements(std::make_unique<std::atomic<small_task *>[]>(static_cast<std::size_t>(capacity_)))
+		{}
+
+		small_task *load(std::int64_t index) const
+		{
+			return this->elements[static_cast<std::size_t>(index & (this->capacity - 1))].load(std::memory_order_relaxed);
+		}
+
+		void store(std::int64_t index, small_task *task)
+		{
+			this->elements[static_cast<std::size_t>(index & (this->capacity - 1))].store(task, std::memory_order_relaxed);
+		}
+
+		std::int64_t capacity;
+		std::unique_ptr<std::atomic<small_task *>[]> elements;
+	};
+
+	ring_buffer *grow(ring_buffer *buffer, std::int64_t top, std::int64_t bottom)
+	{
+		auto new_buffer = std::make_unique<ring_buffer>(buffer->capacity * 2);
+		for (auto i = top; i < bottom; ++i)
+		{
+			new_buffer->store(i, buffer->load(i));
+		}
+		// old buffers are kept alive, because a thief may still be reading from them
+		this->_buffers.push_back(std::move(new_buffer));
+		auto const result = this->_buffers.back().get();
+		this->_buffer.store(result, std::memory_order_release);
+		return result;
+	}
+
+	alignas(64) std::atomic<std::int64_t> _top;
+	alignas(64) std::atomic<std::int64_t> _bottom;
+	std::atomic<ring_buffer *> _buffer;
+	cppb::vector<std::unique_ptr<ring_buffer>> _buffers;
+};
+
+// A work-stealing thread pool.  Every worker has its own deque; tasks pushed from a worker go to the
+// bottom of its deque, and tasks pushed from other threads are distributed round-robin between
+// per-worker injection queues.  Idle workers steal from the other workers before going to sleep.
 struct thread_pool
 {
 	thread_pool(std::size_t thread_count)
-		: _thread_count(thread_count),
-		  _task_wait_semaphore(0), // we don't have any tasks yet, so we start with 0
-		  _tasks_mutex(),
-		  _threads(),
-		  _tasks()
+		: _thread_count(std::max(thread_count, std::size_t(1))),
+		  _workers(std::make_unique<worker_t[]>(this->_thread_count)),
+		  _started_count(0),
+		  _start_mutex(),
+		  _next_injection_index(0),
+		  _epoch(0),
+		  _sleeping_count(0),
+		  _is_stopping(false),
+		  _free_storages_mutex(),
+		  _free_storages(nullptr),
+		  _threads()
 	{
-		this->_threads.reserve(thread_count);
+		this->_threads.reserve(this->_thread_count);
 	}
 
+	thread_pool(thread_pool const &other) = delete;
+	thread_pool(thread_pool &&other) = delete;
+	thread_pool &operator = (thread_pool const &rhs) = delete;
+	thread_pool &operator = (thread_pool &&rhs) = delete;
+
 	~thread_pool(void)
 	{
+		// tasks that haven't started yet are discarded, like with the previous implementation;
+		// their futures will report a broken promise
+		this->_is_stopping.store(true);
+		this->_epoch.fetch_add(1);
+		this->_epoch.notify_all();
+		this->_threads.clear();
+
+		for (std::size_t i = 0; i < this->_thread_count; ++i)
 		{
-			auto const tasks_guard = std::lock_guard(this->_tasks_mutex);
-			if (this->_tasks.empty())
+			auto &worker = this->_workers[i];
+			while (auto const task = worker.deque.pop())
 			{
-				// all queued tasks have finished, so we need to notify the worker threads to shut down
-				this->_task_wait_semaphore.release();
+				task->~small_task();
+				delete get_storage(task);
 			}
-			else
+			for (auto const task : worker.injected_tasks)
 			{
-				// some tasks haven't finished yet, so we just discard them
-				this->_tasks.clear();
-				// the semaphore doesn't need to be released here
+				task->~small_task();
+				delete get_storage(task);
 			}
+			delete_storages(worker.free_storages);
 		}
-		// the threads should clean themselves up here
-		// this needs to happen before the destructor finishes, because the threads call 'get_next_task()'
-		this->_threads.clear();
+		delete_storages(this->_free_storages);
 	}
 
-	// called from main thread
+	// can be called from any thread, including the pool's own worker threads
 	auto push_task(auto callable) -> std::future<decltype(callable())>
 	{
 		using R = decltype(callable());
-		auto const tasks_guard = std::lock_guard(this->_tasks_mutex);
+		auto promise = std::promise<R>();
+		auto result = promise.get_future();
+		auto const storage = this->allocate_storage();
+		auto const task = ::new (static_cast<void *>(&storage->task)) small_task([promise = std::move(promise), callable = std::move(callable)]() mutable {
+			if constexpr (std::is_void_v<R>)
+			{
+				callable();
+				promise.set_value();
+			}
+			else
+			{
+				promise.set_value(callable());
+			}
+		});
 
-		// we fill the thread pool here, to avoid unnecessary thread starting
-		if (this->_threads.size() < this->_thread_count)
+		if (current_pool == this)
 		{
-			this->_threads.push_back(std::jthread([this]() {
-				while (auto task = this->get_next_task())
-				{
-					(*task)();
-				}
+			this->_workers[current_worker_index].deque.push(task);
+			// tasks pushed by a worker may be the only ones, so other workers must be started to steal them
+			this->start_worker_if_needed();
+		}
+		else
+		{
+			// we fill the thread pool here, to avoid unnecessary thread starting
+			auto const started_count = this->start_worker_if_needed();
+			auto const index = this->_next_injection_index.fetch_add(1, std::memory_order_relaxed) % started_count;
+			auto &worker = this->_workers[index];
+			auto const injected_tasks_guard = std::lock_guard(worker.injected_tasks_mutex);
+			worker.injected_tasks.push_back(task);
+			worker.injected_task_count.store(worker.injected_tasks.size(), std::memory_order_release);
+		}
+
+		this->notify_one();
+		return result;
+	}
+
+	std::size_t thread_count(void) const
+	{
+		return this->_thread_count;
+	}
+
+private:
+	struct alignas(64) worker_t
+	{
+		work_stealing_deque deque{};
+		std::mutex injected_tasks_mutex{};
+		cppb::vector<small_task *> injected_tasks{};
+		std::atomic<std::size_t> injected_task_count{ 0 };
+		// only used by the worker's own thread
+		task_storage *free_storages = nullptr;
+		std::size_t free_storage_count = 0;
+	};
+
+	// a worker keeps up to this many storages of the tasks it ran; the rest are moved to the shared free list,
+	// which is used by threads outside of the pool, and by workers whose own list is empty
+	static constexpr std::size_t max_worker_free_storage_count = 32;
+
+	inline static thread_local thread_pool *current_pool = nullptr;
+	inline static thread_local std::size_t current_worker_index = 0;
+
+	static task_storage *get_storage(small_task *task)
+	{
+		// a union and its members are pointer-interconvertible
+		return reinterpret_cast<task_storage *>(task);
+	}
+
+	static void delete_storages(task_storage *storages)
+	{
+		while (storages != nullptr)
+		{
+			delete std::exchange(storages, storages->next_free);
+		}
+	}
+
+	task_storage *allocate_storage(void)
+	{
+		if (current_pool == this)
+		{
+			auto &worker = this->_workers[current_worker_index];
+			if (worker.free_storages != nullptr)
+			{
+				worker.free_storage_count -= 1;
+				return std::exchange(worker.free_storages, worker.free_storages->next_free);
+			}
+		}
+		{
+			auto const free_storages_guard = std::lock_guard(this->_free_storages_mutex);
+			if (this->_free_storages != nullptr)
+			{
+				return std::exchange(this->_free_storages, this->_free_storages->next_free);
+			}
+		}
+		return new task_storage();
+	}
+
+	// runs and destroys a task on worker 'index', and keeps its storage for the next push
+	void run_task(std::size_t index, small_task *task)
+	{
+		(*task)();
+		task->~small_task();
+
+		auto &worker = this->_workers[index];
+		auto const storage = get_storage(task);
+		storage->next_free = worker.free_storages;
+		worker.free_storages = storage;
+		worker.free_storage_count += 1;
+		if (worker.free_storage_count > max_worker_free_storage_count)
+		{
+			// half of the storages are moved at once, so the lock is only taken once in a while
+			auto first = worker.free_storages;
+			auto last = first;
+			for (std::size_t i = 1; i < max_worker_free_storage_count / 2; ++i)
+			{
+				last = last->next_free;
+			}
+			worker.free_storages = last->next_free;
+			worker.free_storage_count -= max_worker_free_storage_count / 2;
+
+			auto const free_storages_guard = std::lock_guard(this->_free_storages_mutex);
+			last->next_free = this->_free_storages;
+			this->_free_storages = first;
+		}
+	}
+
+	std::size_t start_worker_if_needed(void)
+	{
+		auto const started_count = this->_started_count.load(std::memory_order_acquire);
+		if (started_count == this->_thread_count)
+		{
+			return started_count;
+		}
+
+		auto const start_guard = std::lock_guard(this->_start_mutex);
+		auto const index = this->_started_count.load(std::memory_order_relaxed);
+		if (index < this->_thread_count)
+		{
+			// the count is updated first, because the new worker already uses it to look for victims
+			this->_started_count.store(index + 1, std::memory_order_release);
+			this->_threads.push_back(std::jthread([this, index]() {
+				this->run_worker(index);
 			}));
+			return index + 1;
 		}
+		return index;
+	}
 
-		// the promise needs to be copyable, because we convert it to a 'std::function' object,
-		// so we use a 'shared_ptr'
-		auto promise = std::make_shared<std::promise<R>>();
-		auto result = promise->get_future();
-		this->_tasks.push_back([promise = std::move(promise), callable = std::move(callable)]() {
-			promise->set_value(callable());
-		});
+	void notify_one(void)
+	{
+		// the seq_cst operations here and in 'run_worker' make sure that a worker can't go to sleep
+		// after missing a new task
+		this->_epoch.fetch_add(1);
+		if (this->_sleeping_count.load() != 0)
+		{
+			this->_epoch.notify_one();
+		}
+	}
+
+	small_task *take_injected_tasks(std::size_t index)
+	{
+		auto &worker = this->_workers[index];
+		if (worker.injected_task_count.load(std::memory_order_acquire) == 0)
+		{
+			return nullptr;
+		}
+
+		auto tasks = cppb::vector<small_task *>();
+		{
+			auto const injected_tasks_guard = std::lock_guard(worker.injected_tasks_mutex);
+			std::swap(tasks, worker.injected_tasks);
+			worker.injected_task_count.store(0, std::memory_order_relaxed);
+		}
+		if (tasks.empty())
+		{
+			return nullptr;
+		}
+
+		// tasks are pushed in reverse, so they are run in the order they were submitted
+		for (auto it = tasks.rbegin(), end = tasks.rend() - 1; it != end; ++it)
+		{
+			worker.deque.push(*it);
+		}
+		if (tasks.size() > 1)
+		{
+			// there's more work available for the thieves
+			this->notify_one();
+		}
+		return tasks.front();
+	}
 
-		// release if a new task is pushed into an empty queue
-		if (this->_tasks.size() == 1)
+	small_task *steal_injected_task(std::size_t index)
+	{
+		auto &worker = this->_workers[index];
+		if (worker.injected_task_count.load(std::memory_order_acquire) == 0)
 		{
-			this->_task_wait_semaphore.release();
+			return nullptr;
 		}
 
+		auto injected_tasks_lock = std::unique_lock(worker.injected_tasks_mutex, std::try_to_lock);
+		if (!injected_tasks_lock.owns_lock() || worker.injected_tasks.empty())
+		{
+			return nullptr;
+		}
+		auto const result = worker.injected_tasks.back();
+		worker.injected_tasks.pop_back();
+		worker.injected_task_count.store(worker.injected_tasks.size(), std::memory_order_relaxed);
 		return result;
 	}
 
-	// called from worker threads
-	std::optional<std::function<void()>> get_next_task()
+	small_task *find_task(std::size_t index, std::uint64_t &random_state)
 	{
-		// try to acquire the semaphore
-		// blocks until there is at least one task in the queue, or the thread_pool is destructed
-		this->_task_wait_semaphore.acquire();
-		auto const tasks_guard = std::lock_guard(this->_tasks_mutex);
+		if (auto const task = this->_workers[index].deque.pop())
+		{
+			return task;
+		}
+		if (auto const task = this->take_injected_tasks(index))
+		{
+			return task;
+		}
 
-		if (this->_tasks.empty())
+		// xorshift, so not all idle workers try to steal from the same victim
+		random_state ^= random_state << 13;
+		random_state ^= random_state >> 7;
+		random_state ^= random_state << 17;
+		auto const started_count = this->_started_count.load(std::memory_order_acquire);
+		auto const offset = static_cast<std::size_t>(random_state % started_count);
+		for (std::size_t i = 0; i < started_count; ++i)
 		{
-			this->_task_wait_semaphore.release();
-			return {};
+			auto const victim = (offset + i) % started_count;
+			if (victim == index)
+			{
+				continue;
+			}
+			if (auto const task = this->_workers[victim].deque.steal())
+			{
+				return task;
+			}
 		}
-		else if (this->_tasks.size() == 1)
+		for (std::size_t i = 0; i < started_count; ++i)
 		{
-			// don't release, as we don't have any more tasks
-			auto result = std::move(this->_tasks[0]);
-			this->_tasks.erase(this->_tasks.begin());
-			return result;
+			auto const victim = (offset + i) % started_count;
+			if (victim == index)
+			{
+				continue;
+			}
+			if (auto const task = this->steal_injected_task(victim))
+			{
+				return task;
+			}
 		}
-		else
+		return nullptr;
+	}
+
+	void run_worker(std::size_t index)
+	{
+		current_pool = this;
+		current_worker_index = index;
+		std::uint64_t random_state = 0x9e3779b97f4a7c15ull * (index + 1);
+
+		while (true)
 		{
-			auto result = std::move(this->_tasks[0]);
-			this->_tasks.erase(this->_tasks.begin());
-			// release the semaphore, as there are more tasks left in the queue
-			this->_task_wait_semaphore.release();
-			return result;
+			auto const epoch = this->_epoch.load();
+			// checked after loading the epoch: the destructor sets '_is_stopping' before it increments the epoch,
+			// so either the epoch loaded here is the old one and the wait returns right away, or the flag is seen
+			if (this->_is_stopping.load())
+			{
+				break;
+			}
+			if (auto const task = this->find_task(index, random_state))
+			{
+				this->run_task(index, task);
+				continue;
+			}
+
+			this->_sleeping_count.fetch_add(1);
+			this->_epoch.wait(epoch);
+			this->_sleeping_count.fetch_sub(1);
 		}
+
+		current_pool = nullptr;
 	}
 
-private:
 	std::size_t _thread_count;
-	std::binary_semaphore _task_wait_semaphore;
-	std::mutex _tasks_mutex;
+	std::unique_ptr<worker_t[]> _workers;
+	std::atomic<std::size_t> _started_count;
+	std::mutex _start_mutex;
+	std::atomic<std::size_t> _next_injection_index;
+	std::atomic<std::uint64_t> _epoch;
+	std::atomic<std::size_t> _sleeping_count;
+	std::atomic<bool> _is_stopping;
+	std::mutex _free_storages_mutex;
+	task_storage *_free_storages;
+	// declared last, so the threads are joined before anything else is destroyed
 	cppb::vector<std::jthread> _threads;
-	cppb::vector<std::function<void()>> _tasks;
 };
 
-#endif // CONFIG_H
+#endif // THREAD_POOL_H